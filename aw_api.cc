@@ -0,0 +1,217 @@
+#include "aw_api.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+
+namespace visca2uvc {
+namespace {
+
+// Zoom and focus positions.
+constexpr int kAwMin = 0x555;
+constexpr int kAwMax = 0xFFF;
+// Pan and tilt positions are angles around 0x8000, with +-175 degrees at
+// 0x2D08 and 0xD2F7. UVC uses arc seconds.
+constexpr int kAwCentre = 0x8000;
+constexpr double kArcSecondsPerStep = 175.0 * 3600 / (0xD2F7 - kAwCentre);
+
+// Speed controls remembered between #P and #T commands.
+struct AwState {
+  float pan_speed = 0;
+  float tilt_speed = 0;
+};
+
+// Parses exactly `digits` digits in base 16 or 10.
+bool ParseNumber(absl::string_view text, size_t digits, bool hex, int& value) {
+  if (text.size() != digits) return false;
+  for (const char c : text) {
+    if (hex ? !absl::ascii_isxdigit(c) : !absl::ascii_isdigit(c)) return false;
+  }
+  return hex ? absl::SimpleHexAtoi(text, &value)
+             : absl::SimpleAtoi(text, &value);
+}
+
+// Upper case with 3 or 4 digits.
+std::string Hex(int value, int digits) {
+  return absl::AsciiStrToUpper(absl::StrCat(
+      absl::Hex(value, digits == 3 ? absl::kZeroPad3 : absl::kZeroPad4)));
+}
+
+std::string Decimal(int value) {
+  return absl::StrCat(absl::Dec(value, absl::kZeroPad2));
+}
+
+// 01..99 with 50 as stop, onto -1..1.
+float Speed(int value) {
+  return std::clamp((value - 50) / 49.0f, -1.0f, 1.0f);
+}
+
+int32_t FromAw(int value, const Range& range) {
+  const double fraction =
+      static_cast<double>(std::clamp(value, kAwMin, kAwMax) - kAwMin) /
+      (kAwMax - kAwMin);
+  return range.min +
+         static_cast<int32_t>(std::lround(fraction * (int64_t{range.max} -
+                                                      range.min)));
+}
+
+int ToAw(int32_t value, const Range& range) {
+  if (range.max <= range.min) return kAwMin;
+  const double fraction = static_cast<double>(range.Clamp(value) - range.min) /
+                          (int64_t{range.max} - range.min);
+  return kAwMin + static_cast<int>(std::lround(fraction * (kAwMax - kAwMin)));
+}
+
+int32_t AngleFromAw(int value) {
+  return std::lround((value - kAwCentre) * kArcSecondsPerStep);
+}
+
+int AngleToAw(int32_t value) {
+  return std::clamp<int>(kAwCentre + std::lround(value / kArcSecondsPerStep),
+                         0, 0xFFFF);
+}
+
+std::string HandlePtz(Bridge& bridge, int id, AwState& aw,
+                      absl::string_view command) {
+  Camera& camera = *bridge.camera(id);
+  MotionController& motion = *bridge.motion(id);
+  const Capabilities& caps = camera.capabilities();
+  const CameraState& state = camera.state();
+  int a, b;
+  // Busy until the camera is probed.
+  if (!camera.ready()) return "E2";
+
+  if (absl::ConsumePrefix(&command, "PTS")) {
+    if (!ParseNumber(command.substr(0, 2), 2, false, a) ||
+        !ParseNumber(command.substr(2), 2, false, b)) {
+      return "E3";
+    }
+    aw.pan_speed = Speed(a);
+    aw.tilt_speed = Speed(b);
+    motion.MovePanTilt(aw.pan_speed, aw.tilt_speed);
+    return absl::StrCat("pTS", command);
+  }
+  if (absl::ConsumePrefix(&command, "APC")) {
+    if (command.empty()) {
+      if (!state[Control::kPan].has_value() ||
+          !state[Control::kTilt].has_value()) {
+        return "E3";
+      }
+      return absl::StrCat("aPC", Hex(AngleToAw(*state[Control::kPan]), 4),
+                          Hex(AngleToAw(*state[Control::kTilt]), 4));
+    }
+    if (!ParseNumber(command.substr(0, 4), 4, true, a) ||
+        !ParseNumber(command.substr(4), 4, true, b)) {
+      return "E3";
+    }
+    if (!caps.pan.has_value() || !caps.tilt.has_value()) return "E3";
+    motion.SetPanTiltAbs(AngleFromAw(a), AngleFromAw(b));
+    return absl::StrCat("aPC", absl::AsciiStrToUpper(command));
+  }
+  if (absl::ConsumePrefix(&command, "AXZ")) {
+    if (!ParseNumber(command, 3, true, a)) return "E3";
+    if (!caps.zoom_abs.has_value()) return "E3";
+    motion.SetZoomAbs(FromAw(a, *caps.zoom_abs));
+    return absl::StrCat("axz", absl::AsciiStrToUpper(command));
+  }
+  if (absl::ConsumePrefix(&command, "AXF")) {
+    if (!ParseNumber(command, 3, true, a)) return "E3";
+    if (!caps.focus_abs.has_value()) return "E3";
+    motion.SetFocusAbs(FromAw(a, *caps.focus_abs));
+    return absl::StrCat("axf", absl::AsciiStrToUpper(command));
+  }
+  if (command == "GZ") {
+    if (!caps.zoom_abs.has_value() || !state[Control::kZoomAbs].has_value()) {
+      return "E3";
+    }
+    return absl::StrCat(
+        "gz", Hex(ToAw(*state[Control::kZoomAbs], *caps.zoom_abs), 3));
+  }
+  if (command == "GF") {
+    if (!caps.focus_abs.has_value() ||
+        !state[Control::kFocusAbs].has_value()) {
+      return "E3";
+    }
+    return absl::StrCat(
+        "gf", Hex(ToAw(*state[Control::kFocusAbs], *caps.focus_abs), 3));
+  }
+  if (absl::ConsumePrefix(&command, "D1")) {
+    if (command.empty()) {
+      if (!state[Control::kFocusAuto].has_value()) return "E3";
+      return absl::StrCat("d1", *state[Control::kFocusAuto] ? 1 : 0);
+    }
+    if (command != "0" && command != "1") return "E3";
+    motion.SetFocusAuto(command == "1");
+    return absl::StrCat("d1", command);
+  }
+  if (command == "O" || command == "O1") return "p1";
+  // Single letter commands with two decimal digits.
+  if (command.size() != 3 || !ParseNumber(command.substr(1), 2, false, a)) {
+    return "E1";
+  }
+  switch (command[0]) {
+    case 'P':
+      aw.pan_speed = Speed(a);
+      motion.MovePanTilt(aw.pan_speed, aw.tilt_speed);
+      return absl::StrCat("pS", Decimal(a));
+    case 'T':
+      aw.tilt_speed = Speed(a);
+      motion.MovePanTilt(aw.pan_speed, aw.tilt_speed);
+      return absl::StrCat("tS", Decimal(a));
+    case 'Z':
+      motion.MoveZoom(Speed(a));
+      return absl::StrCat("zS", Decimal(a));
+    case 'F':
+      // 01 is near and 99 far, UVC's positive focus direction is near.
+      motion.MoveFocus(-Speed(a));
+      return absl::StrCat("fS", Decimal(a));
+    case 'M':
+      camera.SavePreset(a);
+      return absl::StrCat("s", Decimal(a));
+    case 'R':
+      if (const CameraState* preset = camera.preset(a)) {
+        motion.Recall(*preset);
+        return absl::StrCat("s", Decimal(a));
+      }
+      return "E3";
+    default:
+      return "E1";
+  }
+}
+
+HttpResponse Text(std::string body) {
+  HttpResponse response;
+  response.content_type = "text/plain";
+  response.body = std::move(body);
+  return response;
+}
+
+}  // namespace
+
+void AddAwApi(HttpServer& server, Bridge& bridge, int camera_id) {
+  auto aw = std::make_shared<AwState>();
+  server.AddHandler(
+      "/cgi-bin/aw_ptz", [&bridge, camera_id, aw](const HttpRequest& request) {
+        auto it = request.query.find("cmd");
+        if (it == request.query.end()) return Text("E1");
+        absl::string_view command = it->second;
+        if (!absl::ConsumePrefix(&command, "#")) return Text("E1");
+        return Text(HandlePtz(bridge, camera_id, *aw, command));
+      });
+  server.AddHandler("/cgi-bin/aw_cam", [](const HttpRequest& request) {
+    auto it = request.query.find("cmd");
+    if (it == request.query.end()) return Text("ER1");
+    if (it->second == "QID") return Text("OID:AW-UE150");
+    return Text(absl::StrCat("ER1:", it->second));
+  });
+}
+
+}  // namespace visca2uvc
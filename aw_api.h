@@ -0,0 +1,35 @@
+#ifndef VISCA2UVC_AW_API_H_
+#define VISCA2UVC_AW_API_H_
+
+#include "bridge.h"
+#include "http_server.h"
+
+namespace visca2uvc {
+
+// Emulates the Panasonic AW remote camera CGI for one camera, for control
+// desks that speak it:
+//
+//   /cgi-bin/aw_ptz?cmd=%23<command>&res=1
+//   /cgi-bin/aw_cam?cmd=<command>&res=1
+//
+// aw_ptz commands, speeds are 01..99 with 50 as stop:
+//
+//   #PTSxxyy       pan and tilt speed
+//   #Pxx, #Txx     pan or tilt speed
+//   #Zxx, #Fxx     zoom or focus speed
+//   #AXZxxx, #GZ   set or query the zoom position, 555..FFF
+//   #AXFxxx, #GF   set or query the focus position, 555..FFF
+//   #APCpppptttt   pan and tilt position, 8000 is the centre, higher is
+//                  right and up. #APC queries it.
+//   #D1x, #D1      set or query auto focus
+//   #Mxx, #Rxx     save or recall preset xx
+//   #O, #O1        power, always on
+//
+// Positions are mapped onto the camera's probed ranges. Unknown commands get
+// "E1", ones the camera can't do "E3". aw_cam only answers the model query
+// QID, which desks use to detect the camera.
+void AddAwApi(HttpServer& server, Bridge& bridge, int camera_id);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_AW_API_H_
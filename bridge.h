@@ -0,0 +1,73 @@
+#ifndef VISCA2UVC_BRIDGE_H_
+#define VISCA2UVC_BRIDGE_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "camera.h"
+#include "motion.h"
+#include "profile.h"
+#include "tracking.h"
+
+namespace visca2uvc {
+
+// The cameras served by the daemon, shared by all protocol frontends.
+class Bridge {
+ public:
+  void Add(std::unique_ptr<Camera> camera,
+           std::unique_ptr<MotionController> motion,
+           std::unique_ptr<Tracker> tracker) {
+    camera_ptrs_.push_back(camera.get());
+    devices_.push_back(
+        {std::move(camera), std::move(motion), std::move(tracker)});
+  }
+
+  // `id` is 1-based, returns nullptr for unknown cameras.
+  Camera* camera(int id) const {
+    return id >= 1 && id <= size() ? devices_[id - 1].camera.get() : nullptr;
+  }
+  MotionController* motion(int id) const {
+    return id >= 1 && id <= size() ? devices_[id - 1].motion.get() : nullptr;
+  }
+  Tracker* tracker(int id) const {
+    return id >= 1 && id <= size() ? devices_[id - 1].tracker.get() : nullptr;
+  }
+
+  const std::vector<Camera*>& cameras() const { return camera_ptrs_; }
+  int size() const { return devices_.size(); }
+
+  // Set before adding cameras, whose backends refer to it.
+  void set_profile(DeviceProfile profile) { profile_ = std::move(profile); }
+  const DeviceProfile& profile() const { return profile_; }
+
+ private:
+  struct Device {
+    std::unique_ptr<Camera> camera;
+    std::unique_ptr<MotionController> motion;
+    // Declared last, it drives `motion`.
+    std::unique_ptr<Tracker> tracker;
+  };
+  DeviceProfile profile_;
+  std::vector<Device> devices_;
+  std::vector<Camera*> camera_ptrs_;
+};
+
+// Holds back the transfers of all cameras while in scope, so that a batch of
+// changes is flushed together.
+class BridgeBatch {
+ public:
+  explicit BridgeBatch(const Bridge& bridge) : bridge_(bridge) {
+    for (int id = 1; id <= bridge_.size(); ++id) bridge_.motion(id)->Hold();
+  }
+  ~BridgeBatch() {
+    for (int id = 1; id <= bridge_.size(); ++id) bridge_.motion(id)->Release();
+  }
+
+ private:
+  const Bridge& bridge_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_BRIDGE_H_
@@ -0,0 +1,96 @@
+#include "camera.h"
+
+#include <utility>
+
+#include "absl/container/inlined_vector.h"
+
+namespace visca2uvc {
+
+absl::string_view ControlName(Control control) {
+  switch (control) {
+    case Control::kZoomAbs:
+      return "zoom_abs";
+    case Control::kPan:
+      return "pan";
+    case Control::kTilt:
+      return "tilt";
+    case Control::kFocusAbs:
+      return "focus_abs";
+    case Control::kFocusAuto:
+      return "focus_auto";
+    case Control::kDigitalZoom:
+      return "digital_zoom";
+  }
+  return "unknown";
+}
+
+Camera::Camera(int id, std::unique_ptr<Backend> backend)
+    : id_(id), backend_(std::move(backend)) {
+  backend_->set_observer([this](absl::Span<const Backend::Value> values) {
+    absl::InlinedVector<Control, kNumControls> changed;
+    for (const auto& [control, value] : values) {
+      if (Store(control, value)) changed.push_back(control);
+    }
+    if (!changed.empty()) Notify(changed);
+  });
+  backend_->set_extension_observer([this](int index, absl::string_view data) {
+    extensions_[index] = std::string(data);
+  });
+  backend_->AddRecoveryListener([this] { Restore(); });
+}
+
+void Camera::Restore() {
+  // Failures show in the next transfers, which the backend watches.
+  if (state_[Control::kPan].has_value() &&
+      state_[Control::kTilt].has_value()) {
+    backend_->SetPanTiltAbs({*state_[Control::kPan], *state_[Control::kTilt]})
+        .IgnoreError();
+  }
+  if (state_[Control::kZoomAbs].has_value()) {
+    backend_->SetZoomAbs(*state_[Control::kZoomAbs]).IgnoreError();
+  }
+  if (state_[Control::kDigitalZoom].has_value()) {
+    backend_->SetDigitalZoom(*state_[Control::kDigitalZoom]).IgnoreError();
+  }
+  if (state_[Control::kFocusAuto].value_or(0)) {
+    backend_->SetFocusAuto(true).IgnoreError();
+  } else if (state_[Control::kFocusAbs].has_value()) {
+    if (state_[Control::kFocusAuto].has_value()) {
+      backend_->SetFocusAuto(false).IgnoreError();
+    }
+    backend_->SetFocusAbs(*state_[Control::kFocusAbs]).IgnoreError();
+  }
+}
+
+void Camera::SetCapabilities(Capabilities capabilities) {
+  capabilities_ = std::move(capabilities);
+  const std::optional<Range>& optical = capabilities_.zoom_abs;
+  const std::optional<Range>& digital = capabilities_.digital_zoom;
+  if (optical.has_value()) {
+    capabilities_.zoom_axis = *optical;
+    if (digital.has_value() && digital->max > digital->min) {
+      capabilities_.zoom_axis->max += digital->max - digital->min;
+    }
+  }
+  ready_ = true;
+}
+
+void Camera::Update(Control control, int32_t value) {
+  if (Store(control, value)) {
+    const Control changed[] = {control};
+    Notify(changed);
+  }
+}
+
+bool Camera::Store(Control control, int32_t value) {
+  std::optional<int32_t>& slot = state_[control];
+  if (slot == value) return false;
+  slot = value;
+  return true;
+}
+
+void Camera::Notify(absl::Span<const Control> changed) {
+  for (const Listener& listener : listeners_) listener(*this, changed);
+}
+
+}  // namespace visca2uvc
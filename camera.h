@@ -0,0 +1,238 @@
+#ifndef VISCA2UVC_CAMERA_H_
+#define VISCA2UVC_CAMERA_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "command_queue.h"
+#include "uvc.h"
+
+namespace visca2uvc {
+
+// Controls mirrored in the shadow state. The values are part of the state
+// stream wire format, only append.
+enum class Control : uint8_t {
+  kZoomAbs = 0,
+  kPan = 1,
+  kTilt = 2,
+  kFocusAbs = 3,
+  kFocusAuto = 4,
+  // Digital zoom multiplier, on top of the optical zoom.
+  kDigitalZoom = 5,
+};
+inline constexpr int kNumControls = 6;
+
+absl::string_view ControlName(Control control);
+
+// Last known value of every control, absent if the camera doesn't support it
+// or it hasn't been read yet.
+struct CameraState {
+  std::array<std::optional<int32_t>, kNumControls> values;
+
+  const std::optional<int32_t>& operator[](Control control) const {
+    return values[static_cast<int>(control)];
+  }
+  std::optional<int32_t>& operator[](Control control) {
+    return values[static_cast<int>(control)];
+  }
+};
+
+struct Range {
+  int32_t min = 0;
+  int32_t max = 0;
+
+  int32_t Clamp(int32_t value) const {
+    return value < min ? min : value > max ? max : value;
+  }
+};
+
+// What the camera supports, probed once when it's opened.
+struct Capabilities {
+  std::optional<Range> zoom_abs;
+  std::optional<Range> pan;
+  std::optional<Range> tilt;
+  std::optional<Range> focus_abs;
+  std::optional<Range> digital_zoom;
+  // Optical zoom followed by the digital zoom steps as one axis, so the
+  // optical maximum is where digital zoom takes over. Derived from the
+  // ranges above when probing.
+  std::optional<Range> zoom_axis;
+  // Maximum speeds of the relative controls, 0 if unsupported.
+  uint8_t zoom_speed = 0;
+  uint8_t pan_speed = 0;
+  uint8_t tilt_speed = 0;
+  uint8_t focus_speed = 0;
+  // Size in bytes of each extension control of the device profile, 0 if the
+  // camera lacks it.
+  std::vector<int> extension_sizes;
+};
+
+// The device behind a camera, a UVC camera or an upstream VISCA camera.
+// Values are in the device's units and the relative controls follow UVC.
+class Backend {
+ public:
+  using Value = std::pair<Control, int32_t>;
+  // Receives control values read from the device.
+  using Observer = std::function<void(absl::Span<const Value> values)>;
+  // Receives the value of extension control `index` read from or written to
+  // the device.
+  using ExtensionObserver =
+      std::function<void(int index, absl::string_view data)>;
+
+  virtual ~Backend() = default;
+
+  void set_observer(Observer observer) { observer_ = std::move(observer); }
+  void set_extension_observer(ExtensionObserver observer) {
+    extension_observer_ = std::move(observer);
+  }
+  // `listener` is called after the device was reset and is usable again.
+  // What it was doing, and the values written to it, may be lost.
+  void AddRecoveryListener(std::function<void()> listener) {
+    recovery_listeners_.push_back(std::move(listener));
+  }
+  // How often the device was reset and recovered.
+  uint64_t recoveries() const { return recoveries_; }
+
+  // Returns what the device supports, called once after opening.
+  virtual Capabilities Probe() = 0;
+  // Reads the device's controls. The values reach the observer right away
+  // or once the device answers.
+  virtual void Refresh() = 0;
+  // Reads the optical zoom position, like Refresh, e.g. while a zoom drive
+  // approaches its end.
+  virtual void RefreshZoom() { Refresh(); }
+
+  virtual absl::Status SetZoomAbs(int32_t value) = 0;
+  virtual absl::Status SetZoomRel(const ZoomRel& zoom) = 0;
+  virtual absl::Status SetPanTiltAbs(const PanTiltAbs& pantilt) = 0;
+  virtual absl::Status SetPanTiltRel(const PanTiltRel& pantilt) = 0;
+  virtual absl::Status SetFocusAbs(int32_t value) = 0;
+  virtual absl::Status SetFocusRel(const FocusRel& focus) = 0;
+  virtual absl::Status SetFocusAuto(bool enabled) = 0;
+  virtual absl::Status SetDigitalZoom(int32_t value) {
+    return absl::UnimplementedError("No digital zoom");
+  }
+
+  // Vendor controls, by index into the device profile's extensions. Values
+  // read or written reach the extension observer.
+  virtual absl::StatusOr<std::string> GetExtension(int index) {
+    return absl::UnimplementedError("No extension controls");
+  }
+  virtual absl::Status SetExtension(int index, absl::string_view data) {
+    return absl::UnimplementedError("No extension controls");
+  }
+
+  // Counters of the queue in front of the device, nullptr if requests go
+  // straight to it.
+  virtual const CommandQueueStats* queue_stats() const { return nullptr; }
+  // Whether the device can't take requests now, e.g. its queue is full so
+  // that they would be refused or shed, or it is being reset.
+  virtual bool congested() const { return false; }
+
+  // Set calls between BeginBatch and EndBatch may be deferred and written
+  // together by EndBatch, which returns the status of that write.
+  virtual void BeginBatch() {}
+  virtual absl::Status EndBatch() { return absl::OkStatus(); }
+
+ protected:
+  void Report(absl::Span<const Value> values) {
+    if (observer_) observer_(values);
+  }
+  void ReportExtension(int index, absl::string_view data) {
+    if (extension_observer_) extension_observer_(index, data);
+  }
+  void Recovered() {
+    ++recoveries_;
+    for (const auto& listener : recovery_listeners_) listener();
+  }
+
+ private:
+  Observer observer_;
+  ExtensionObserver extension_observer_;
+  std::vector<std::function<void()>> recovery_listeners_;
+  uint64_t recoveries_ = 0;
+};
+
+// A camera served by the daemon, with a shadow copy of its controls and
+// extension controls so that readers don't need to wait for the device.
+class Camera {
+ public:
+  using Listener =
+      std::function<void(const Camera& camera, absl::Span<const Control>)>;
+
+  Camera(int id, std::unique_ptr<Backend> backend);
+
+  // 1-based, as used in addresses of all the control protocols.
+  int id() const { return id_; }
+  const CameraState& state() const { return state_; }
+  // Last known value of extension control `index`, nullptr until it was read
+  // or written.
+  const std::string* extension(int index) const {
+    auto it = extensions_.find(index);
+    return it == extensions_.end() ? nullptr : &it->second;
+  }
+  const Capabilities& capabilities() const { return capabilities_; }
+  // Whether the capabilities are known. Until then the camera is served but
+  // refuses control.
+  bool ready() const { return ready_; }
+  Backend& backend() { return *backend_; }
+  const Backend& backend() const { return *backend_; }
+
+  // Reads the control ranges from the device.
+  void Probe() { SetCapabilities(backend_->Probe()); }
+  // Takes what the backend's Probe returned and makes the camera ready.
+  void SetCapabilities(Capabilities capabilities);
+
+  // Reads all supported controls from the device, listeners learn about
+  // changes once the values arrive.
+  void Refresh() { backend_->Refresh(); }
+  void RefreshZoom() { backend_->RefreshZoom(); }
+
+  // Writes the absolute positions and focus mode of the shadow state to the
+  // device, e.g. after it was reset.
+  void Restore();
+
+  // Records a value written to or read from the device.
+  void Update(Control control, int32_t value);
+
+  // Remembers the current state as preset `number`.
+  void SavePreset(int number) { presets_[number] = state_; }
+  void ClearPreset(int number) { presets_.erase(number); }
+  // Returns nullptr if the preset was never saved.
+  const CameraState* preset(int number) const {
+    auto it = presets_.find(number);
+    return it == presets_.end() ? nullptr : &it->second;
+  }
+
+  // `listener` is called with the controls whose value changed.
+  void AddListener(Listener listener) {
+    listeners_.push_back(std::move(listener));
+  }
+
+ private:
+  // Stores `value`, returns whether it changed.
+  bool Store(Control control, int32_t value);
+  void Notify(absl::Span<const Control> changed);
+
+  const int id_;
+  std::unique_ptr<Backend> backend_;
+  Capabilities capabilities_;
+  bool ready_ = false;
+  CameraState state_;
+  absl::flat_hash_map<int, std::string> extensions_;
+  absl::flat_hash_map<int, CameraState> presets_;
+  std::vector<Listener> listeners_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_CAMERA_H_
@@ -0,0 +1,81 @@
+#include "client.h"
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+
+namespace visca2uvc {
+
+ClientScope* ClientScope::current_ = nullptr;
+
+const ClientId& ClientScope::current() {
+  static const ClientId* const daemon = new ClientId{"daemon", "", ""};
+  return current_ != nullptr ? current_->client_ : *daemon;
+}
+
+void ClientScope::MarkCongested() {
+  if (current_ != nullptr) current_->congested_ = true;
+}
+
+const char* ClientClassName(ClientClass client_class) {
+  switch (client_class) {
+    case ClientClass::kOperator:
+      return "operator";
+    case ClientClass::kAutomation:
+      return "automation";
+    case ClientClass::kMonitoring:
+      return "monitoring";
+  }
+  return "";
+}
+
+int ClientWeight(ClientClass client_class) {
+  switch (client_class) {
+    case ClientClass::kOperator:
+      return 8;
+    case ClientClass::kAutomation:
+      return 2;
+    case ClientClass::kMonitoring:
+      return 1;
+  }
+  return 1;
+}
+
+absl::StatusOr<ClientClasses> ClientClasses::Parse(
+    const std::vector<std::string>& entries) {
+  ClientClasses result;
+  for (const std::string& entry : entries) {
+    const std::vector<std::string> parts =
+        absl::StrSplit(entry, absl::MaxSplits('=', 1));
+    bool found = false;
+    for (const ClientClass client_class :
+         {ClientClass::kOperator, ClientClass::kAutomation,
+          ClientClass::kMonitoring}) {
+      if (parts.size() == 2 && !parts[0].empty() &&
+          parts[1] == ClientClassName(client_class)) {
+        result.classes_[parts[0]] = client_class;
+        found = true;
+      }
+    }
+    if (!found) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Expected <listener or address>=operator|automation|monitoring, "
+          "got: ",
+          entry));
+    }
+  }
+  return result;
+}
+
+ClientClass ClientClasses::Of(const ClientId& client) const {
+  if (!client.address.empty()) {
+    if (auto it = classes_.find(client.address); it != classes_.end()) {
+      return it->second;
+    }
+  }
+  if (auto it = classes_.find(client.listener); it != classes_.end()) {
+    return it->second;
+  }
+  return ClientClass::kOperator;
+}
+
+}  // namespace visca2uvc
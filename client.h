@@ -0,0 +1,89 @@
+#ifndef VISCA2UVC_CLIENT_H_
+#define VISCA2UVC_CLIENT_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+
+namespace visca2uvc {
+
+// Who a request came from: the listener it arrived on, e.g. "tcp:8080",
+// "udp:9000", a serial line's path or "shm", the peer's IPv4 address if it
+// has one, and what tells the peers of one address apart.
+struct ClientId {
+  std::string listener;
+  std::string address;
+  // The peer's port, or the number of a shared memory client. Empty where
+  // there's one client per address, e.g. on a serial line or over HTTP.
+  std::string session;
+
+  // Unique per client, "<listener>/<address>[/<session>]".
+  std::string key() const {
+    return session.empty() ? listener + "/" + address
+                           : listener + "/" + address + "/" + session;
+  }
+};
+
+// How much of a camera's transfers a client gets when clients compete.
+enum class ClientClass { kOperator, kAutomation, kMonitoring };
+
+const char* ClientClassName(ClientClass client_class);
+// Transfers per round of fair scheduling, see MotionController.
+int ClientWeight(ClientClass client_class);
+
+// Assigns classes to clients by listener or address.
+class ClientClasses {
+ public:
+  // From "<listener or address>=operator|automation|monitoring" entries.
+  static absl::StatusOr<ClientClasses> Parse(
+      const std::vector<std::string>& entries);
+
+  // An entry for the address wins over one for the listener. Unlisted
+  // clients are operators, so that nothing changes without configuration.
+  ClientClass Of(const ClientId& client) const;
+
+ private:
+  absl::flat_hash_map<std::string, ClientClass> classes_;
+};
+
+// Attributes the requests made while in scope to `client`. Frontends open
+// one around handling each input, timers of a frontend around each tick.
+class ClientScope {
+ public:
+  explicit ClientScope(ClientId client)
+      : client_(std::move(client)), previous_(current_) {
+    current_ = this;
+  }
+  // A nested scope's congestion is its enclosing scope's too, since the
+  // frontend checks the outermost one.
+  ~ClientScope() {
+    current_ = previous_;
+    if (congested_ && previous_ != nullptr) previous_->congested_ = true;
+  }
+
+  ClientScope(const ClientScope&) = delete;
+  ClientScope& operator=(const ClientScope&) = delete;
+
+  // The innermost client in scope, the daemon itself outside any scope.
+  static const ClientId& current();
+  // Tells the innermost scope, and through it the enclosing ones, that its
+  // client's requests back up, see MotionController::Congested.
+  static void MarkCongested();
+
+  // Whether a request in this scope backed up. The frontend then pushes
+  // back on the client.
+  bool congested() const { return congested_; }
+
+ private:
+  const ClientId client_;
+  bool congested_ = false;
+  ClientScope* const previous_;
+  static ClientScope* current_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_CLIENT_H_
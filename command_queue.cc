@@ -0,0 +1,141 @@
+#include "command_queue.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+
+namespace visca2uvc {
+namespace {
+
+int Index(CommandClass command_class) {
+  return static_cast<int>(command_class);
+}
+
+// Which commands rank below others when the queue is full: the shadow state
+// can do without a refresh sooner than a camera without a motion command.
+int Rank(CommandClass command_class) {
+  switch (command_class) {
+    case CommandClass::kRefresh:
+      return 0;
+    case CommandClass::kMotion:
+      return 1;
+    case CommandClass::kAbsolute:
+      return 2;
+    case CommandClass::kStop:
+      return 3;
+  }
+  return 0;
+}
+
+bool Sheddable(CommandClass command_class) {
+  return command_class == CommandClass::kRefresh;
+}
+
+bool Droppable(CommandClass command_class) {
+  return command_class != CommandClass::kStop &&
+         command_class != CommandClass::kAbsolute;
+}
+
+}  // namespace
+
+const char* CommandClassName(CommandClass command_class) {
+  switch (command_class) {
+    case CommandClass::kStop:
+      return "stop";
+    case CommandClass::kMotion:
+      return "motion";
+    case CommandClass::kAbsolute:
+      return "absolute";
+    case CommandClass::kRefresh:
+      return "refresh";
+  }
+  return "";
+}
+
+absl::Duration CommandDeadlines::For(CommandClass command_class) const {
+  switch (command_class) {
+    case CommandClass::kStop:
+      return stop;
+    case CommandClass::kMotion:
+      return motion;
+    case CommandClass::kAbsolute:
+      return absolute;
+    case CommandClass::kRefresh:
+      return refresh;
+  }
+  return absolute;
+}
+
+std::string CommandQueueStats::ToJson() const {
+  std::vector<std::string> classes;
+  for (int i = 0; i < kNumCommandClasses; ++i) {
+    classes.push_back(absl::StrCat(
+        "\"", CommandClassName(static_cast<CommandClass>(i)),
+        "\":{\"sent\":", sent[i], ",\"dropped\":", dropped[i],
+        ",\"collapsed\":", collapsed[i], ",\"shed\":", shed[i], "}"));
+  }
+  return absl::StrCat("{", absl::StrJoin(classes, ","), "}");
+}
+
+bool CommandQueue::Push(std::string key, std::string message,
+                        CommandClass command_class, absl::Time now) {
+  const absl::Time deadline = now + deadlines_.For(command_class);
+  auto it = std::find_if(queue_.begin(), queue_.end(),
+                         [&](const Command& c) { return c.key == key; });
+  if (it == queue_.end()) {
+    if (full()) {
+      // The lowest ranked, and of those the latest, sheddable command.
+      auto victim = queue_.end();
+      for (auto c = queue_.begin(); c != queue_.end(); ++c) {
+        if (Sheddable(c->command_class) &&
+            Rank(c->command_class) < Rank(command_class) &&
+            (victim == queue_.end() ||
+             Rank(c->command_class) <= Rank(victim->command_class))) {
+          victim = c;
+        }
+      }
+      if (victim != queue_.end()) {
+        ++stats_.shed[Index(victim->command_class)];
+        queue_.erase(victim);
+      } else if (command_class != CommandClass::kStop) {
+        ++stats_.shed[Index(command_class)];
+        return false;
+      }
+    }
+    queue_.push_back(
+        Command{std::move(key), std::move(message), command_class, deadline});
+    return true;
+  }
+  ++stats_.collapsed[Index(it->command_class)];
+  it->message = std::move(message);
+  it->command_class = command_class;
+  // The newer command is as fresh as its own deadline says.
+  it->deadline = deadline;
+  return true;
+}
+
+std::optional<CommandQueue::Command> CommandQueue::Pop(absl::Time now) {
+  for (auto it = queue_.begin(); it != queue_.end();) {
+    if (it->deadline < now && Droppable(it->command_class)) {
+      ++stats_.dropped[Index(it->command_class)];
+      it = queue_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (queue_.empty()) return std::nullopt;
+  // The first of equal deadlines, so ties go by arrival.
+  auto next = std::min_element(
+      queue_.begin(), queue_.end(), [](const Command& a, const Command& b) {
+        return a.deadline < b.deadline;
+      });
+  Command command = std::move(*next);
+  queue_.erase(next);
+  ++stats_.sent[Index(command.command_class)];
+  return command;
+}
+
+}  // namespace visca2uvc
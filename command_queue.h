@@ -0,0 +1,93 @@
+#ifndef VISCA2UVC_COMMAND_QUEUE_H_
+#define VISCA2UVC_COMMAND_QUEUE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+
+#include "absl/time/time.h"
+
+namespace visca2uvc {
+
+// What a command does, which decides how long it may wait for its device
+// and whether it's still worth sending late.
+enum class CommandClass { kStop, kMotion, kAbsolute, kRefresh };
+constexpr int kNumCommandClasses = 4;
+
+const char* CommandClassName(CommandClass command_class);
+
+// How long each class of command may wait, from when it was queued.
+struct CommandDeadlines {
+  absl::Duration stop = absl::Milliseconds(20);
+  // A joystick drive that comes late moves the camera after the operator
+  // let go, and joysticks repeat their drives anyway.
+  absl::Duration motion = absl::Milliseconds(150);
+  absl::Duration absolute = absl::Milliseconds(500);
+  absl::Duration refresh = absl::Seconds(1);
+
+  absl::Duration For(CommandClass command_class) const;
+};
+
+// Per class counters of a CommandQueue.
+struct CommandQueueStats {
+  std::array<uint64_t, kNumCommandClasses> sent = {};
+  // Expired before the device was free.
+  std::array<uint64_t, kNumCommandClasses> dropped = {};
+  // Replaced by a newer command of the same kind while queued.
+  std::array<uint64_t, kNumCommandClasses> collapsed = {};
+  // Evicted or refused because the queue was full.
+  std::array<uint64_t, kNumCommandClasses> shed = {};
+
+  // {"<class>":{"sent":n,"dropped":n,"collapsed":n,"shed":n},...}
+  std::string ToJson() const;
+};
+
+// The commands waiting for one device, which handles one at a time.
+//
+// Each command gets a deadline by its class and the device is given the
+// command with the earliest deadline next. Commands of the same kind, e.g.
+// two pan-tilt drives, collapse into the newer one, so the queue holds at
+// most one command per kind. Motion and refreshes that expire while queued
+// are dropped, stops and absolute moves are always sent.
+//
+// The queue holds at most `capacity` commands. When it's full, a refresh is
+// shed to make room for a more important command, and a command no queued
+// one ranks below is refused. Stops are never refused.
+class CommandQueue {
+ public:
+  struct Command {
+    // Commands with equal keys collapse.
+    std::string key;
+    std::string message;
+    CommandClass command_class = CommandClass::kAbsolute;
+    absl::Time deadline;
+  };
+
+  CommandQueue(const CommandDeadlines& deadlines, size_t capacity)
+      : deadlines_(deadlines), capacity_(capacity) {}
+
+  // Returns false if the command was refused.
+  bool Push(std::string key, std::string message, CommandClass command_class,
+            absl::Time now);
+  // The next command for the device, if any is left after dropping the
+  // expired ones.
+  std::optional<Command> Pop(absl::Time now);
+
+  bool empty() const { return queue_.empty(); }
+  bool full() const { return queue_.size() >= capacity_; }
+  const CommandQueueStats& stats() const { return stats_; }
+
+ private:
+  const CommandDeadlines deadlines_;
+  const size_t capacity_;
+  // In arrival order, which breaks ties between equal deadlines.
+  std::deque<Command> queue_;
+  CommandQueueStats stats_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_COMMAND_QUEUE_H_
@@ -0,0 +1,110 @@
+#include "command_queue.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "gtest/gtest.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr absl::Time kStart = absl::UnixEpoch();
+
+int Index(CommandClass command_class) {
+  return static_cast<int>(command_class);
+}
+
+// Pops until the queue is empty, returns the keys in order.
+std::vector<std::string> Drain(CommandQueue& queue, absl::Time now) {
+  std::vector<std::string> keys;
+  while (std::optional<CommandQueue::Command> command = queue.Pop(now)) {
+    keys.push_back(command->key);
+  }
+  return keys;
+}
+
+TEST(CommandQueueTest, SendsEarliestDeadlineFirst) {
+  CommandQueue queue(CommandDeadlines{}, 8);
+  queue.Push("refresh", "r", CommandClass::kRefresh, kStart);
+  queue.Push("zoom_abs", "a", CommandClass::kAbsolute, kStart);
+  queue.Push("pantilt", "m", CommandClass::kMotion, kStart);
+  queue.Push("zoom", "s", CommandClass::kStop, kStart);
+  EXPECT_EQ(Drain(queue, kStart),
+            (std::vector<std::string>{"zoom", "pantilt", "zoom_abs",
+                                      "refresh"}));
+}
+
+TEST(CommandQueueTest, OrdersByDeadlineNotByClass) {
+  CommandQueue queue(CommandDeadlines{}, 8);
+  // Queued long before, the refresh is due before the fresh drive.
+  queue.Push("refresh", "r", CommandClass::kRefresh, kStart);
+  queue.Push("pantilt", "m", CommandClass::kMotion,
+             kStart + absl::Milliseconds(900));
+  EXPECT_EQ(Drain(queue, kStart + absl::Milliseconds(900)),
+            (std::vector<std::string>{"refresh", "pantilt"}));
+}
+
+TEST(CommandQueueTest, BreaksTiesByArrival) {
+  CommandQueue queue(CommandDeadlines{}, 8);
+  queue.Push("pan", "1", CommandClass::kMotion, kStart);
+  queue.Push("zoom", "2", CommandClass::kMotion, kStart);
+  queue.Push("focus", "3", CommandClass::kMotion, kStart);
+  EXPECT_EQ(Drain(queue, kStart),
+            (std::vector<std::string>{"pan", "zoom", "focus"}));
+}
+
+TEST(CommandQueueTest, DropsStaleDrives) {
+  CommandDeadlines deadlines;
+  deadlines.motion = absl::Milliseconds(150);
+  CommandQueue queue(deadlines, 8);
+  queue.Push("pantilt", "m", CommandClass::kMotion, kStart);
+  queue.Push("zoom", "z", CommandClass::kMotion,
+             kStart + absl::Milliseconds(100));
+  EXPECT_EQ(Drain(queue, kStart + absl::Milliseconds(200)),
+            (std::vector<std::string>{"zoom"}));
+  EXPECT_EQ(queue.stats().dropped[Index(CommandClass::kMotion)], 1u);
+  EXPECT_EQ(queue.stats().sent[Index(CommandClass::kMotion)], 1u);
+}
+
+TEST(CommandQueueTest, SendsLateStopsAndAbsoluteMoves) {
+  CommandQueue queue(CommandDeadlines{}, 8);
+  queue.Push("zoom", "s", CommandClass::kStop, kStart);
+  queue.Push("zoom_abs", "a", CommandClass::kAbsolute, kStart);
+  queue.Push("refresh", "r", CommandClass::kRefresh, kStart);
+  EXPECT_EQ(Drain(queue, kStart + absl::Seconds(10)),
+            (std::vector<std::string>{"zoom", "zoom_abs"}));
+  EXPECT_EQ(queue.stats().dropped[Index(CommandClass::kRefresh)], 1u);
+}
+
+TEST(CommandQueueTest, CollapsesIntoTheNewerCommand) {
+  CommandQueue queue(CommandDeadlines{}, 8);
+  queue.Push("pantilt", "old", CommandClass::kMotion, kStart);
+  queue.Push("pantilt", "new", CommandClass::kMotion,
+             kStart + absl::Milliseconds(100));
+  // The old drive would have expired, the newer one has its own deadline.
+  std::optional<CommandQueue::Command> command =
+      queue.Pop(kStart + absl::Milliseconds(200));
+  ASSERT_TRUE(command.has_value());
+  EXPECT_EQ(command->message, "new");
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(queue.stats().collapsed[Index(CommandClass::kMotion)], 1u);
+}
+
+TEST(CommandQueueTest, ShedsRefreshesWhenFull) {
+  CommandQueue queue(CommandDeadlines{}, 2);
+  EXPECT_TRUE(queue.Push("refresh", "r", CommandClass::kRefresh, kStart));
+  EXPECT_TRUE(queue.Push("pantilt", "m", CommandClass::kMotion, kStart));
+  EXPECT_TRUE(queue.Push("zoom_abs", "a", CommandClass::kAbsolute, kStart));
+  EXPECT_EQ(queue.stats().shed[Index(CommandClass::kRefresh)], 1u);
+  // Nothing sheddable is left, only stops get in.
+  EXPECT_FALSE(queue.Push("focus", "f", CommandClass::kMotion, kStart));
+  EXPECT_EQ(queue.stats().shed[Index(CommandClass::kMotion)], 1u);
+  EXPECT_TRUE(queue.Push("zoom", "s", CommandClass::kStop, kStart));
+  EXPECT_EQ(Drain(queue, kStart),
+            (std::vector<std::string>{"zoom", "pantilt", "zoom_abs"}));
+}
+
+}  // namespace
+}  // namespace visca2uvc
@@ -0,0 +1,221 @@
+#include "device_index.h"
+
+// For struct uvc_device, to wrap devices found by hotplug.
+#include <libuvc/libuvc_internal.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "usb.h"
+#include "usb_topology.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr uint8_t kClassVideo = 0x0e;
+constexpr uint8_t kSubclassVideoControl = 0x01;
+
+// Whether any interface of the device is a UVC VideoControl interface. The
+// descriptors are cached by libusb, so this doesn't talk to the device.
+bool IsUvc(libusb_device* device) {
+  libusb_config_descriptor* config;
+  if (libusb_get_config_descriptor(device, 0, &config) < 0) return false;
+  bool result = false;
+  for (int i = 0; i < config->bNumInterfaces && !result; ++i) {
+    const libusb_interface& interface = config->interface[i];
+    for (int j = 0; j < interface.num_altsetting; ++j) {
+      if (interface.altsetting[j].bInterfaceClass == kClassVideo &&
+          interface.altsetting[j].bInterfaceSubClass ==
+              kSubclassVideoControl) {
+        result = true;
+        break;
+      }
+    }
+  }
+  libusb_free_config_descriptor(config);
+  return result;
+}
+
+absl::StatusOr<std::string> ReadSerial(libusb_device* device) {
+  libusb_device_descriptor descriptor;
+  RETURN_IF_USB_ERROR(libusb_get_device_descriptor(device, &descriptor));
+  if (descriptor.iSerialNumber == 0) {
+    return absl::NotFoundError("No serial number");
+  }
+  libusb_device_handle* handle;
+  RETURN_IF_USB_ERROR(libusb_open(device, &handle));
+  unsigned char serial[256];
+  const int length = libusb_get_string_descriptor_ascii(
+      handle, descriptor.iSerialNumber, serial, sizeof(serial));
+  libusb_close(handle);
+  RETURN_IF_USB_ERROR(length);
+  return std::string(reinterpret_cast<char*>(serial), length);
+}
+
+// libuvc has no call to wrap a single libusb device, this is what
+// uvc_get_device_list does for each device.
+UvcDevice Wrap(uvc_context_t* ctx, libusb_device* usb_dev) {
+  auto* dev = static_cast<uvc_device_t*>(malloc(sizeof(uvc_device_t)));
+  dev->ctx = ctx;
+  dev->ref = 0;
+  dev->usb_dev = usb_dev;
+  uvc_ref_device(dev);
+  return UvcDevice(UvcDevice::Ptr(dev));
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<UvcDeviceIndex>> UvcDeviceIndex::Create(
+    UvcContext& uvc, EventLoop* loop) {
+  libusb_context* const usb = uvc.get()->usb_ctx;
+  std::unique_ptr<UvcDeviceIndex> index(new UvcDeviceIndex(uvc, usb, loop));
+  // The callback sees all present devices before registration returns.
+  index->hotplug_ =
+      loop != nullptr && libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) &&
+      libusb_hotplug_register_callback(
+          usb,
+          LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
+              LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+          LIBUSB_HOTPLUG_ENUMERATE, LIBUSB_HOTPLUG_MATCH_ANY,
+          LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, &OnHotplug,
+          index.get(), &index->callback_) == LIBUSB_SUCCESS;
+  if (!index->hotplug_) {
+    libusb_device** list;
+    const ssize_t count = libusb_get_device_list(usb, &list);
+    RETURN_IF_USB_ERROR(count);
+    for (ssize_t i = 0; i < count; ++i) {
+      index->arrived_.push_back(libusb_ref_device(list[i]));
+    }
+    libusb_free_device_list(list, /*unref_devices=*/1);
+  }
+  index->IndexArrived();
+  return index;
+}
+
+UvcDeviceIndex::~UvcDeviceIndex() {
+  if (hotplug_) {
+    libusb_hotplug_deregister_callback(usb_, callback_);
+    loop_->CancelTimer(arrived_timer_);
+  }
+  for (libusb_device* device : arrived_) libusb_unref_device(device);
+  for (const auto& [device, selectors] : selectors_) {
+    libusb_unref_device(device);
+  }
+}
+
+absl::StatusOr<UvcDevice> UvcDeviceIndex::Find(absl::string_view selector) {
+  if (!absl::StartsWith(selector, "serial:") &&
+      !absl::StartsWith(selector, "port:")) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Device selector ", selector, " isn't serial:... or port:..."));
+  }
+  IndexArrived();
+  auto it = devices_.find(selector);
+  if (it == devices_.end()) {
+    return absl::NotFoundError(absl::StrCat("No camera at ", selector));
+  }
+  if (it->second.size() > 1) {
+    std::vector<std::string> ports;
+    for (libusb_device* device : it->second) ports.push_back(PortOf(device));
+    return absl::FailedPreconditionError(
+        absl::StrCat(selector, " is shared by the cameras at ",
+                     absl::StrJoin(ports, ", "), ", select one by port"));
+  }
+  return Wrap(uvc_.get(), it->second.front());
+}
+
+std::vector<std::string> UvcDeviceIndex::selectors() {
+  IndexArrived();
+  std::vector<std::string> result;
+  for (const auto& [selector, devices] : devices_) {
+    if (devices.size() == 1) result.push_back(selector);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+int UvcDeviceIndex::OnHotplug(libusb_context* ctx, libusb_device* device,
+                              libusb_hotplug_event event, void* user_data) {
+  auto* index = static_cast<UvcDeviceIndex*>(user_data);
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+    index->arrived_.push_back(libusb_ref_device(device));
+    if (index->arrived_timer_ == 0) {
+      index->arrived_timer_ =
+          index->loop_->AddTimer(absl::ZeroDuration(), [index] {
+            index->arrived_timer_ = 0;
+            index->IndexArrived();
+          });
+    }
+  } else {
+    index->Remove(device);
+  }
+  return 0;
+}
+
+void UvcDeviceIndex::IndexArrived() {
+  std::vector<libusb_device*> arrived = std::move(arrived_);
+  arrived_.clear();
+  for (libusb_device* device : arrived) {
+    if (IsUvc(device) && !selectors_.contains(device)) {
+      Add(device);
+    } else {
+      libusb_unref_device(device);
+    }
+  }
+}
+
+void UvcDeviceIndex::Add(libusb_device* device) {
+  std::vector<std::string> selectors;
+  if (absl::StatusOr<UsbLocation> location = UsbLocation::Of(device);
+      location.ok()) {
+    selectors.push_back(absl::StrCat("port:", location->path()));
+  }
+  // Without access the serial number is unknown, the port still works.
+  if (absl::StatusOr<std::string> serial = ReadSerial(device); serial.ok()) {
+    selectors.push_back(absl::StrCat("serial:", *serial));
+  }
+  for (const std::string& selector : selectors) {
+    std::vector<libusb_device*>& devices = devices_[selector];
+    devices.push_back(device);
+    // Cheap cameras often share a serial number.
+    if (devices.size() == 2) {
+      std::cerr << selector << " isn't unique, select the cameras by port\n";
+    }
+  }
+  selectors_[device] = std::move(selectors);
+}
+
+void UvcDeviceIndex::Remove(libusb_device* device) {
+  if (auto it = std::find(arrived_.begin(), arrived_.end(), device);
+      it != arrived_.end()) {
+    arrived_.erase(it);
+    libusb_unref_device(device);
+  }
+  auto it = selectors_.find(device);
+  if (it == selectors_.end()) return;
+  // A selector the device shared may be unambiguous again.
+  for (const std::string& selector : it->second) {
+    std::vector<libusb_device*>& devices = devices_[selector];
+    devices.erase(std::remove(devices.begin(), devices.end(), device),
+                  devices.end());
+    if (devices.empty()) devices_.erase(selector);
+  }
+  selectors_.erase(it);
+  libusb_unref_device(device);
+}
+
+std::string UvcDeviceIndex::PortOf(libusb_device* device) const {
+  if (auto it = selectors_.find(device); it != selectors_.end()) {
+    for (const std::string& selector : it->second) {
+      if (absl::StartsWith(selector, "port:")) return selector;
+    }
+  }
+  return "an unknown port";
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,78 @@
+#ifndef VISCA2UVC_DEVICE_INDEX_H_
+#define VISCA2UVC_DEVICE_INDEX_H_
+
+#include <libusb.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "event_loop.h"
+#include "uvc.h"
+
+namespace visca2uvc {
+
+// Finds UVC cameras by what identifies them across reboots and re-plugging
+// rather than by enumeration order. Selectors are
+//
+//   serial:<serial number>    The device's iSerialNumber string.
+//   port:<bus>-<port>.<port>  Where it's plugged in, see UsbLocation::path.
+//
+// The index is built from libusb's device list once and then updated device
+// by device from hotplug events, so lookups never enumerate.
+//
+// A serial number that several cameras share selects none of them, since
+// which one would be found depends on enumeration order. It works again once
+// only one of them is left.
+class UvcDeviceIndex {
+ public:
+  // Indexes the devices of `uvc`'s libusb context. With `loop`, which must
+  // handle that context's events, the index follows hotplug events while
+  // the loop runs, without it the index is a snapshot. `uvc` and `loop`
+  // outlive the index.
+  static absl::StatusOr<std::unique_ptr<UvcDeviceIndex>> Create(
+      UvcContext& uvc, EventLoop* loop);
+  ~UvcDeviceIndex();
+
+  // Fails with FAILED_PRECONDITION, naming the cameras' ports, if `selector`
+  // is ambiguous.
+  absl::StatusOr<UvcDevice> Find(absl::string_view selector);
+
+  // The unambiguous selectors of all indexed devices.
+  std::vector<std::string> selectors();
+
+ private:
+  UvcDeviceIndex(UvcContext& uvc, libusb_context* usb, EventLoop* loop)
+      : uvc_(uvc), usb_(usb), loop_(loop) {}
+
+  static int OnHotplug(libusb_context* ctx, libusb_device* device,
+                       libusb_hotplug_event event, void* user_data);
+  // Indexes the devices that arrived since the last call.
+  void IndexArrived();
+  void Add(libusb_device* device);
+  void Remove(libusb_device* device);
+  // The port selector of `device`, or a placeholder if its port is unknown.
+  std::string PortOf(libusb_device* device) const;
+
+  UvcContext& uvc_;
+  libusb_context* const usb_;
+  EventLoop* const loop_;
+  bool hotplug_ = false;
+  libusb_hotplug_callback_handle callback_;
+  // Referenced devices waiting to be indexed. Reading a serial number is a
+  // transfer, which the hotplug callback must not make.
+  std::vector<libusb_device*> arrived_;
+  EventLoop::TimerId arrived_timer_ = 0;
+  // Selector to the referenced devices that have it, in the order they were
+  // indexed. More than one make the selector ambiguous.
+  absl::flat_hash_map<std::string, std::vector<libusb_device*>> devices_;
+  // Device to its selectors, for removal.
+  absl::flat_hash_map<libusb_device*, std::vector<std::string>> selectors_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_DEVICE_INDEX_H_
@@ -0,0 +1,101 @@
+#include "event_loop.h"
+
+#include <poll.h>
+
+#include <cerrno>
+#include <vector>
+
+namespace visca2uvc {
+
+void EventLoop::WatchFd(int fd, short events, FdCallback callback) {
+  watches_[fd] = Watch{events, std::move(callback)};
+}
+
+void EventLoop::UpdateFd(int fd, short events) {
+  if (auto it = watches_.find(fd); it != watches_.end()) {
+    it->second.events = events;
+  }
+}
+
+void EventLoop::UnwatchFd(int fd) { watches_.erase(fd); }
+
+EventLoop::TimerId EventLoop::AddTimer(absl::Duration delay,
+                                       Callback callback) {
+  return Schedule(absl::Now() + delay, absl::ZeroDuration(),
+                  std::move(callback));
+}
+
+EventLoop::TimerId EventLoop::AddPeriodic(absl::Duration period,
+                                          Callback callback) {
+  return Schedule(absl::Now() + period, period, std::move(callback));
+}
+
+void EventLoop::CancelTimer(TimerId id) {
+  // The stale deadline entry is skipped when it expires.
+  timers_.erase(id);
+}
+
+EventLoop::TimerId EventLoop::Schedule(absl::Time when, absl::Duration period,
+                                       Callback callback) {
+  const TimerId id = next_timer_id_++;
+  timers_[id] = Timer{period, std::move(callback)};
+  deadlines_.emplace(when, id);
+  return id;
+}
+
+void EventLoop::RunExpiredTimers() {
+  const absl::Time now = absl::Now();
+  while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+    const auto [when, id] = *deadlines_.begin();
+    deadlines_.erase(deadlines_.begin());
+    auto it = timers_.find(id);
+    if (it == timers_.end()) continue;
+    // Copy, the callback may cancel its own timer.
+    Callback callback = it->second.callback;
+    if (it->second.period > absl::ZeroDuration()) {
+      // Don't try to catch up after a stall, just keep the cadence.
+      absl::Time next = when + it->second.period;
+      if (next <= now) next = now + it->second.period;
+      deadlines_.emplace(next, id);
+    } else {
+      timers_.erase(it);
+    }
+    callback();
+  }
+}
+
+absl::Status EventLoop::Run() {
+  running_ = true;
+  std::vector<pollfd> pollfds;
+  while (running_) {
+    pollfds.clear();
+    for (const auto& [fd, watch] : watches_) {
+      pollfds.push_back({fd, watch.events, 0});
+    }
+    int timeout_ms = -1;
+    if (!deadlines_.empty()) {
+      const absl::Duration wait = deadlines_.begin()->first - absl::Now();
+      timeout_ms = wait <= absl::ZeroDuration()
+                       ? 0
+                       : static_cast<int>(absl::ToInt64Milliseconds(
+                             absl::Ceil(wait, absl::Milliseconds(1))));
+    }
+    const int ready = poll(pollfds.data(), pollfds.size(), timeout_ms);
+    if (ready < 0) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "poll");
+    }
+    for (const pollfd& pfd : pollfds) {
+      if (pfd.revents == 0) continue;
+      // Earlier callbacks may have removed this fd.
+      auto it = watches_.find(pfd.fd);
+      if (it == watches_.end()) continue;
+      FdCallback callback = it->second.callback;
+      callback(pfd.revents);
+    }
+    RunExpiredTimers();
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace visca2uvc
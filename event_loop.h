@@ -0,0 +1,58 @@
+#ifndef VISCA2UVC_EVENT_LOOP_H_
+#define VISCA2UVC_EVENT_LOOP_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+
+namespace visca2uvc {
+
+// Single-threaded poll(2) loop that drives every listener of the daemon.
+class EventLoop {
+ public:
+  using FdCallback = std::function<void(short revents)>;
+  using Callback = std::function<void()>;
+  using TimerId = uint64_t;
+
+  // Calls `callback` whenever `fd` reports any of `events`.
+  void WatchFd(int fd, short events, FdCallback callback);
+  void UpdateFd(int fd, short events);
+  void UnwatchFd(int fd);
+
+  // Calls `callback` once after `delay`.
+  TimerId AddTimer(absl::Duration delay, Callback callback);
+  // Calls `callback` every `period` until cancelled.
+  TimerId AddPeriodic(absl::Duration period, Callback callback);
+  void CancelTimer(TimerId id);
+
+  absl::Status Run();
+  void Stop() { running_ = false; }
+
+ private:
+  struct Watch {
+    short events;
+    FdCallback callback;
+  };
+  struct Timer {
+    absl::Duration period;  // Zero for one-shot timers.
+    Callback callback;
+  };
+
+  TimerId Schedule(absl::Time when, absl::Duration period, Callback callback);
+  void RunExpiredTimers();
+
+  absl::flat_hash_map<int, Watch> watches_;
+  absl::flat_hash_map<TimerId, Timer> timers_;
+  std::multimap<absl::Time, TimerId> deadlines_;
+  TimerId next_timer_id_ = 1;
+  bool running_ = false;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_EVENT_LOOP_H_
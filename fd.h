@@ -0,0 +1,45 @@
+#ifndef VISCA2UVC_FD_H_
+#define VISCA2UVC_FD_H_
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <utility>
+
+#include "absl/status/status.h"
+
+#define RETURN_IF_ERRNO(expr)                                  \
+  if ((expr) < 0) {                                            \
+    return absl::ErrnoToStatus(errno, #expr);                  \
+  }
+
+namespace visca2uvc {
+
+// Owns a file descriptor.
+class Fd {
+ public:
+  Fd() = default;
+  explicit Fd(int fd) : fd_(fd) {}
+  Fd(Fd&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+  Fd& operator=(Fd&& other) noexcept {
+    Reset(std::exchange(other.fd_, -1));
+    return *this;
+  }
+  ~Fd() { Reset(); }
+
+  int get() const { return fd_; }
+  bool valid() const { return fd_ >= 0; }
+  int Release() { return std::exchange(fd_, -1); }
+
+  void Reset(int fd = -1) {
+    if (fd_ >= 0) close(fd_);
+    fd_ = fd;
+  }
+
+ private:
+  int fd_ = -1;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_FD_H_
@@ -0,0 +1,144 @@
+#include "frame_image.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+
+#include <jpeglib.h>
+
+#include "absl/strings/str_cat.h"
+
+namespace visca2uvc {
+namespace {
+
+// libjpeg reports errors through a callback that must not return.
+struct JpegError {
+  jpeg_error_mgr manager;
+  std::jmp_buf jump;
+  char message[JMSG_LENGTH_MAX];
+};
+
+void OnJpegError(j_common_ptr info) {
+  JpegError* error = reinterpret_cast<JpegError*>(info->err);
+  info->err->format_message(info, error->message);
+  std::longjmp(error->jump, 1);
+}
+
+// UVC MJPEG frames often lack Huffman tables, libjpeg-turbo falls back to
+// the standard ones.
+absl::Status DecodeScaled(const FrameRing::Frame& frame, int scale,
+                          Image& image) {
+  jpeg_decompress_struct info;
+  JpegError error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = OnJpegError;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_decompress(&info);
+    return absl::InvalidArgumentError(error.message);
+  }
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, frame.data, frame.size);
+  jpeg_read_header(&info, TRUE);
+  info.scale_num = 1;
+  info.scale_denom = scale;
+  info.out_color_space = JCS_YCbCr;
+  info.dct_method = JDCT_IFAST;
+  jpeg_start_decompress(&info);
+  image.width = info.output_width;
+  image.height = info.output_height;
+  image.pixels.resize(size_t{info.output_width} * info.output_height * 3);
+  while (info.output_scanline < info.output_height) {
+    JSAMPROW row =
+        &image.pixels[size_t{info.output_scanline} * info.output_width * 3];
+    jpeg_read_scanlines(&info, &row, 1);
+  }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  return absl::OkStatus();
+}
+
+// Averages `scale` x `scale` blocks, with plain loops over whole rows that
+// the compiler vectorizes.
+absl::Status DownsampleYuyv(const FrameRing::Frame& frame, int width,
+                            int height, int scale, Image& image) {
+  if (frame.size < size_t{2} * width * height) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Short YUYV frame: ", frame.size, " bytes"));
+  }
+  image.width = width / scale;
+  image.height = height / scale;
+  image.pixels.resize(size_t{3} * image.width * image.height);
+  // Per output column, the sums of Y, U and V over a block row.
+  std::vector<uint32_t> sums(3 * image.width);
+  const uint32_t area = scale * scale;
+  for (int y = 0; y < image.height; ++y) {
+    std::fill(sums.begin(), sums.end(), 0);
+    for (int row = 0; row < scale; ++row) {
+      const uint8_t* line = frame.data + size_t{2} * width * (y * scale + row);
+      for (int x = 0; x < image.width; ++x) {
+        uint32_t luma = 0, cb = 0, cr = 0;
+        for (int i = 0; i < scale; ++i) {
+          const int column = x * scale + i;
+          // Each pair of pixels shares one U and one V.
+          const uint8_t* pair = line + 4 * (column / 2);
+          luma += line[2 * column];
+          cb += pair[1];
+          cr += pair[3];
+        }
+        sums[3 * x] += luma;
+        sums[3 * x + 1] += cb;
+        sums[3 * x + 2] += cr;
+      }
+    }
+    uint8_t* out = &image.pixels[size_t{3} * image.width * y];
+    for (int i = 0; i < 3 * image.width; ++i) out[i] = sums[i] / area;
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status Downscale(const FrameRing& ring, const FrameRing::Frame& frame,
+                       int scale, Image& image) {
+  return ring.format() == UVC_FRAME_FORMAT_MJPEG
+             ? DecodeScaled(frame, scale, image)
+             : DownsampleYuyv(frame, ring.width(), ring.height(), scale,
+                              image);
+}
+
+absl::StatusOr<std::string> EncodeJpeg(const Image& image, int quality) {
+  jpeg_compress_struct info;
+  JpegError error;
+  unsigned char* buffer = nullptr;
+  unsigned long size = 0;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = OnJpegError;
+  if (setjmp(error.jump)) {
+    jpeg_destroy_compress(&info);
+    std::free(buffer);
+    return absl::InternalError(error.message);
+  }
+  jpeg_create_compress(&info);
+  jpeg_mem_dest(&info, &buffer, &size);
+  info.image_width = image.width;
+  info.image_height = image.height;
+  info.input_components = 3;
+  info.in_color_space = JCS_YCbCr;
+  jpeg_set_defaults(&info);
+  jpeg_set_quality(&info, quality, TRUE);
+  info.dct_method = JDCT_IFAST;
+  jpeg_start_compress(&info, TRUE);
+  while (info.next_scanline < info.image_height) {
+    JSAMPROW row = const_cast<JSAMPROW>(
+        &image.pixels[size_t{info.next_scanline} * image.width * 3]);
+    jpeg_write_scanlines(&info, &row, 1);
+  }
+  jpeg_finish_compress(&info);
+  jpeg_destroy_compress(&info);
+  std::string jpeg(reinterpret_cast<const char*>(buffer), size);
+  std::free(buffer);
+  return jpeg;
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,31 @@
+#ifndef VISCA2UVC_FRAME_IMAGE_H_
+#define VISCA2UVC_FRAME_IMAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "frame_ring.h"
+
+namespace visca2uvc {
+
+// A small picture made from a video frame.
+struct Image {
+  int width = 0;
+  int height = 0;
+  // YCbCr, 3 bytes per pixel.
+  std::vector<uint8_t> pixels;
+};
+
+// Shrinks `frame` of `ring` to 1/`scale` of its size, `scale` is 1, 2, 4 or
+// 8. MJPEG frames are decoded at a reduced DCT scale, which skips most of the
+// IDCT work, and YUYV frames are box filtered.
+absl::Status Downscale(const FrameRing& ring, const FrameRing::Frame& frame,
+                       int scale, Image& image);
+
+absl::StatusOr<std::string> EncodeJpeg(const Image& image, int quality);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_FRAME_IMAGE_H_
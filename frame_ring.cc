@@ -0,0 +1,301 @@
+#include "frame_ring.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "net.h"
+#include "visca2uvc_frames.h"
+
+namespace visca2uvc {
+namespace {
+
+size_t RoundUpToPage(size_t size) {
+  const size_t page = sysconf(_SC_PAGESIZE);
+  return (size + page - 1) / page * page;
+}
+
+}  // namespace
+
+FrameRing::FrameRing(UvcDeviceHandle& handle, uvc_frame_format format,
+                     uvc_stream_ctrl_t ctrl, Fd memfd, v2u_frames* frames,
+                     size_t size)
+    : handle_(handle), format_(format), ctrl_(ctrl),
+      memfd_(std::move(memfd)), frames_(frames), size_(size) {}
+
+absl::StatusOr<std::unique_ptr<FrameRing>> FrameRing::Create(
+    const FrameRingOptions& options, FrameSource source) {
+  uint32_t format;
+  switch (options.format) {
+    case UVC_FRAME_FORMAT_MJPEG:
+      format = V2U_FRAME_MJPEG;
+      break;
+    case UVC_FRAME_FORMAT_YUYV:
+      format = V2U_FRAME_YUYV;
+      break;
+    default:
+      return absl::InvalidArgumentError("Frames must be MJPEG or YUYV");
+  }
+  if (options.slots < 1 || options.slots > int{V2U_MAX_FRAME_SLOTS}) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Frame slots must be 1 to ", V2U_MAX_FRAME_SLOTS));
+  }
+  absl::StatusOr<uvc_stream_ctrl_t> ctrl = source.handle->GetStreamCtrl(
+      options.format, options.width, options.height, options.fps);
+  if (!ctrl.ok()) return ctrl.status();
+
+  const size_t data_offset = RoundUpToPage(sizeof(v2u_frames));
+  const size_t slot_size = RoundUpToPage(ctrl->dwMaxVideoFrameSize);
+  const size_t size = data_offset + options.slots * slot_size;
+  Fd memfd(memfd_create("visca2uvc-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+  RETURN_IF_ERRNO(memfd.get());
+  RETURN_IF_ERRNO(ftruncate(memfd.get(), size));
+  void* frames = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      memfd.get(), 0);
+  if (frames == MAP_FAILED) return absl::ErrnoToStatus(errno, "mmap");
+  // Consumers can neither resize the ring nor map it writable.
+  int seals = F_SEAL_SHRINK | F_SEAL_GROW;
+#ifdef F_SEAL_FUTURE_WRITE
+  seals |= F_SEAL_FUTURE_WRITE;
+#endif
+  if (fcntl(memfd.get(), F_ADD_SEALS, seals | F_SEAL_SEAL) < 0) {
+    const int error = errno;
+    munmap(frames, size);
+    return absl::ErrnoToStatus(error, "fcntl(F_ADD_SEALS)");
+  }
+
+  std::unique_ptr<FrameRing> ring(new FrameRing(
+      *source.handle, options.format, *ctrl, std::move(memfd),
+      static_cast<v2u_frames*>(frames), size));
+  v2u_frames& header = *ring->frames_;
+  header.magic = V2U_FRAMES_MAGIC;
+  header.version = V2U_FRAMES_VERSION;
+  header.camera = source.camera;
+  header.format = format;
+  header.width = options.width;
+  header.height = options.height;
+  header.slot_count = options.slots;
+  header.slot_size = slot_size;
+  header.data_offset = data_offset;
+  return ring;
+}
+
+FrameRing::~FrameRing() {
+  if (streaming_) handle_.StopStreaming();
+  munmap(frames_, size_);
+}
+
+int FrameRing::width() const { return frames_->width; }
+
+int FrameRing::height() const { return frames_->height; }
+
+std::optional<FrameRing::Frame> FrameRing::Latest() const {
+  const v2u_frame_client client = {-1, -1, frames_, size_};
+  v2u_frame frame;
+  if (v2u_frame_latest(&client, &frame) < 0) return std::nullopt;
+  return Frame{frame.number, frame.capture_ns, frame.data, frame.size};
+}
+
+std::optional<FrameRing::Frame> FrameRing::Get(uint64_t number) const {
+  const v2u_frame_client client = {-1, -1, frames_, size_};
+  v2u_frame frame;
+  if (v2u_frame_get(&client, number, &frame) < 0) return std::nullopt;
+  return Frame{frame.number, frame.capture_ns, frame.data, frame.size};
+}
+
+uint64_t FrameRing::head() const {
+  return __atomic_load_n(&frames_->head, __ATOMIC_ACQUIRE);
+}
+
+bool FrameRing::Valid(const Frame& frame) const {
+  const v2u_frame_client client = {-1, -1, frames_, size_};
+  v2u_frame ring_frame = {};
+  ring_frame.number = frame.number;
+  return v2u_frame_valid(&client, &ring_frame);
+}
+
+absl::Status FrameRing::AddConsumer(int event_fd) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    event_fds_.push_back(event_fd);
+  }
+  if (streaming_) return absl::OkStatus();
+  if (absl::Status status = handle_.StartStreaming(ctrl_, &OnFrame, this);
+      !status.ok()) {
+    RemoveConsumer(event_fd);
+    return status;
+  }
+  streaming_ = true;
+  return absl::OkStatus();
+}
+
+void FrameRing::RemoveConsumer(int event_fd) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    event_fds_.erase(
+        std::remove(event_fds_.begin(), event_fds_.end(), event_fd),
+        event_fds_.end());
+    if (!event_fds_.empty()) return;
+  }
+  // Frees the bus bandwidth, the ring keeps its frames for the next
+  // consumer.
+  if (streaming_) handle_.StopStreaming();
+  streaming_ = false;
+}
+
+void FrameRing::Resume() {
+  if (!streaming_) return;
+  if (absl::Status status = handle_.StartStreaming(ctrl_, &OnFrame, this);
+      !status.ok()) {
+    std::cerr << "Frames: " << status << "\n";
+    streaming_ = false;
+  }
+}
+
+void FrameRing::OnFrame(uvc_frame* frame, void* user_ptr) {
+  static_cast<FrameRing*>(user_ptr)->Write(*frame);
+}
+
+void FrameRing::Write(const uvc_frame& frame) {
+  v2u_frames& frames = *frames_;
+  // Dropping the frame beats handing out a truncated one.
+  if (frame.data_bytes > frames.slot_size) return;
+
+  // Only this thread writes the ring.
+  const uint64_t number = frames.head;
+  const uint64_t index = number % frames.slot_count;
+  v2u_frame_slot& slot = frames.slots[index];
+  __atomic_store_n(&slot.sequence, 2 * number + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  std::memcpy(reinterpret_cast<char*>(frames_) + frames.data_offset +
+                  index * frames.slot_size,
+              frame.data, frame.data_bytes);
+  const uint64_t capture_ns =
+      uint64_t{1000000000} * frame.capture_time_finished.tv_sec +
+      frame.capture_time_finished.tv_nsec;
+  __atomic_store_n(&slot.capture_ns, capture_ns, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot.uvc_sequence, frame.sequence, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot.size, frame.data_bytes, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot.sequence, 2 * number + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&frames.head, number + 1, __ATOMIC_RELEASE);
+
+  const uint64_t one = 1;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const int fd : event_fds_) {
+    // A full counter means the consumer is asleep anyway.
+    (void)write(fd, &one, sizeof(one));
+  }
+}
+
+struct FrameServer::Consumer {
+  Fd socket;
+  Fd event;
+  FrameRing* ring = nullptr;
+};
+
+FrameServer::FrameServer(EventLoop& loop, std::string path, Fd fd)
+    : loop_(loop), path_(std::move(path)), fd_(std::move(fd)) {}
+
+absl::StatusOr<std::unique_ptr<FrameServer>> FrameServer::Create(
+    EventLoop& loop, const FrameRingOptions& options,
+    absl::Span<const FrameSource> sources) {
+  absl::StatusOr<Fd> fd = ListenUnix(options.socket_path);
+  if (!fd.ok()) return fd.status();
+  std::unique_ptr<FrameServer> server(
+      new FrameServer(loop, options.socket_path, *std::move(fd)));
+  for (const FrameSource& source : sources) {
+    absl::StatusOr<std::unique_ptr<FrameRing>> ring =
+        FrameRing::Create(options, source);
+    if (!ring.ok()) {
+      std::cerr << "No frames of camera " << source.camera << ": "
+                << ring.status() << "\n";
+      continue;
+    }
+    server->rings_[source.camera] = *std::move(ring);
+  }
+  loop.WatchFd(server->fd_.get(), POLLIN,
+               [s = server.get()](short) { s->Accept(); });
+  return server;
+}
+
+FrameServer::~FrameServer() {
+  loop_.UnwatchFd(fd_.get());
+  while (!consumers_.empty()) RemoveConsumer(consumers_.begin()->first);
+  unlink(path_.c_str());
+}
+
+void FrameServer::Accept() {
+  while (true) {
+    Fd fd(accept4(fd_.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+    if (!fd.valid()) {
+      if (errno != EAGAIN && errno != EINTR) {
+        std::cerr << absl::ErrnoToStatus(errno, "accept4") << "\n";
+      }
+      if (errno != EINTR) return;
+      continue;
+    }
+    auto consumer = std::make_unique<Consumer>();
+    consumer->socket = std::move(fd);
+    Consumer* ptr = consumer.get();
+    consumers_[ptr] = std::move(consumer);
+    loop_.WatchFd(ptr->socket.get(), POLLIN,
+                  [this, ptr](short) { Receive(ptr); });
+  }
+}
+
+void FrameServer::Receive(Consumer* consumer) {
+  char buffer[64];
+  const ssize_t n = recv(consumer->socket.get(), buffer, sizeof(buffer), 0);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+    RemoveConsumer(consumer);
+    return;
+  }
+  // After the camera number, the socket only tells when the consumer is
+  // gone.
+  if (n < 0 || consumer->ring != nullptr) return;
+  if (absl::Status status = Attach(*consumer, buffer[0]); !status.ok()) {
+    std::cerr << "Frame consumer: " << status << "\n";
+    RemoveConsumer(consumer);
+  }
+}
+
+absl::Status FrameServer::Attach(Consumer& consumer, int camera) {
+  auto it = rings_.find(camera);
+  if (it == rings_.end()) {
+    return absl::NotFoundError(absl::StrCat("No frames of camera ", camera));
+  }
+  consumer.event.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  RETURN_IF_ERRNO(consumer.event.get());
+  // A fresh socket has room for one byte.
+  if (absl::Status status = SendFds(
+          consumer.socket.get(), {it->second->memfd(), consumer.event.get()});
+      !status.ok()) {
+    return status;
+  }
+  if (absl::Status status = it->second->AddConsumer(consumer.event.get());
+      !status.ok()) {
+    return status;
+  }
+  consumer.ring = it->second.get();
+  return absl::OkStatus();
+}
+
+void FrameServer::RemoveConsumer(Consumer* consumer) {
+  loop_.UnwatchFd(consumer->socket.get());
+  if (consumer->ring != nullptr) {
+    consumer->ring->RemoveConsumer(consumer->event.get());
+  }
+  consumers_.erase(consumer);
+}
+
+}  // namespace visca2uvc
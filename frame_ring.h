@@ -0,0 +1,136 @@
+#ifndef VISCA2UVC_FRAME_RING_H_
+#define VISCA2UVC_FRAME_RING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "event_loop.h"
+#include "fd.h"
+#include "uvc.h"
+
+struct uvc_frame;
+struct v2u_frames;
+
+namespace visca2uvc {
+
+struct FrameRingOptions {
+  std::string socket_path;
+  uvc_frame_format format = UVC_FRAME_FORMAT_MJPEG;
+  int width = 1920;
+  int height = 1080;
+  int fps = 30;
+  // Frames kept in the ring, how far a consumer may fall behind.
+  int slots = 8;
+};
+
+// A UVC camera whose video is exported, `camera` is its 1-based id.
+struct FrameSource {
+  int camera;
+  UvcDeviceHandle* handle;
+};
+
+// The video of one camera in a memfd shared with all its consumers, see
+// visca2uvc_frames.h for the layout.
+//
+// libuvc delivers frames on its own thread, which copies each one into the
+// next slot and wakes the consumers. The camera only streams while it has
+// consumers.
+class FrameRing {
+ public:
+  // A frame read in place, like with visca2uvc_frames.h.
+  struct Frame {
+    uint64_t number;
+    // CLOCK_MONOTONIC time at which the frame was completely received.
+    uint64_t capture_ns;
+    const uint8_t* data;
+    uint32_t size;
+  };
+
+  static absl::StatusOr<std::unique_ptr<FrameRing>> Create(
+      const FrameRingOptions& options, FrameSource source);
+  ~FrameRing();
+
+  int memfd() const { return memfd_.get(); }
+  uvc_frame_format format() const { return format_; }
+  int width() const;
+  int height() const;
+
+  // The newest complete frame, nullopt if there is none yet.
+  std::optional<Frame> Latest() const;
+  // Frame `number`, nullopt if it wasn't written yet or was overwritten.
+  std::optional<Frame> Get(uint64_t number) const;
+  // Number of frames written so far.
+  uint64_t head() const;
+  // False if `frame` was overwritten since Latest, so its data is torn.
+  bool Valid(const Frame& frame) const;
+
+  // Starts streaming with the first consumer. `event_fd` is written once per
+  // frame until RemoveConsumer.
+  absl::Status AddConsumer(int event_fd);
+  void RemoveConsumer(int event_fd);
+  // Streams again for the consumers after the handle was re-opened.
+  void Resume();
+
+ private:
+  FrameRing(UvcDeviceHandle& handle, uvc_frame_format format,
+            uvc_stream_ctrl_t ctrl, Fd memfd, v2u_frames* frames, size_t size);
+
+  static void OnFrame(uvc_frame* frame, void* user_ptr);
+  void Write(const uvc_frame& frame);
+
+  UvcDeviceHandle& handle_;
+  const uvc_frame_format format_;
+  uvc_stream_ctrl_t ctrl_;
+  Fd memfd_;
+  v2u_frames* const frames_;
+  const size_t size_;
+  bool streaming_ = false;
+  // Shared with the libuvc thread.
+  std::mutex mutex_;
+  std::vector<int> event_fds_;
+};
+
+// Hands out the frame rings to consumers connecting to a Unix socket.
+class FrameServer {
+ public:
+  // Cameras whose stream can't be negotiated are skipped.
+  static absl::StatusOr<std::unique_ptr<FrameServer>> Create(
+      EventLoop& loop, const FrameRingOptions& options,
+      absl::Span<const FrameSource> sources);
+  ~FrameServer();
+
+  // nullptr if the frames of `camera` aren't exported.
+  FrameRing* ring(int camera) const {
+    auto it = rings_.find(camera);
+    return it != rings_.end() ? it->second.get() : nullptr;
+  }
+
+ private:
+  struct Consumer;
+
+  FrameServer(EventLoop& loop, std::string path, Fd fd);
+
+  void Accept();
+  // Reads the camera number and attaches the consumer to its ring.
+  void Receive(Consumer* consumer);
+  absl::Status Attach(Consumer& consumer, int camera);
+  void RemoveConsumer(Consumer* consumer);
+
+  EventLoop& loop_;
+  const std::string path_;
+  Fd fd_;
+  absl::flat_hash_map<int, std::unique_ptr<FrameRing>> rings_;
+  absl::flat_hash_map<Consumer*, std::unique_ptr<Consumer>> consumers_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_FRAME_RING_H_
@@ -0,0 +1,209 @@
+#include "http_server.h"
+
+#include <algorithm>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "client.h"
+#include "json.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr size_t kMaxHeader = 16384;
+constexpr size_t kMaxBody = 1 << 20;
+
+absl::string_view StatusText(int status) {
+  switch (status) {
+    case 200:
+      return "OK";
+    case 204:
+      return "No Content";
+    case 304:
+      return "Not Modified";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 405:
+      return "Method Not Allowed";
+    case 409:
+      return "Conflict";
+    case 413:
+      return "Payload Too Large";
+    case 503:
+      return "Service Unavailable";
+    default:
+      return "Error";
+  }
+}
+
+int HexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+std::string UrlDecode(absl::string_view value) {
+  std::string result;
+  result.reserve(value.size());
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '+') {
+      result.push_back(' ');
+    } else if (value[i] == '%' && i + 2 < value.size() &&
+               HexDigit(value[i + 1]) >= 0 && HexDigit(value[i + 2]) >= 0) {
+      result.push_back(HexDigit(value[i + 1]) * 16 + HexDigit(value[i + 2]));
+      i += 2;
+    } else {
+      result.push_back(value[i]);
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+HttpResponse HttpError(int status, absl::string_view message) {
+  HttpResponse response;
+  response.status = status;
+  response.body = absl::StrCat("{\"error\":", JsonString(message), "}");
+  return response;
+}
+
+class HttpServer::Session : public TcpConnection::Handler {
+ public:
+  Session(const HttpServer& server, TcpConnection& connection)
+      : server_(server), connection_(connection) {}
+
+  size_t OnData(absl::string_view data) override {
+    size_t consumed = 0;
+    while (consumed < data.size()) {
+      const size_t request = HandleRequest(data.substr(consumed));
+      if (request == 0) break;
+      consumed += request;
+    }
+    return consumed;
+  }
+
+ private:
+  // Returns the size of the request at the start of `data`, 0 if incomplete.
+  size_t HandleRequest(absl::string_view data) {
+    const size_t header_end = data.find("\r\n\r\n");
+    if (header_end == absl::string_view::npos) {
+      if (data.size() > kMaxHeader) Fail(413);
+      return 0;
+    }
+    std::vector<absl::string_view> lines =
+        absl::StrSplit(data.substr(0, header_end), "\r\n");
+    std::vector<absl::string_view> request_line =
+        absl::StrSplit(lines[0], ' ', absl::SkipEmpty());
+    if (request_line.size() != 3) {
+      Fail(400);
+      return data.size();
+    }
+
+    HttpRequest request;
+    bool keep_alive = request_line[2] != "HTTP/1.0";
+    size_t content_length = 0;
+    for (size_t i = 1; i < lines.size(); ++i) {
+      std::pair<absl::string_view, absl::string_view> header =
+          absl::StrSplit(lines[i], absl::MaxSplits(':', 1));
+      const absl::string_view value = absl::StripAsciiWhitespace(header.second);
+      request.headers[absl::AsciiStrToLower(header.first)] =
+          std::string(value);
+      if (absl::EqualsIgnoreCase(header.first, "Content-Length")) {
+        if (!absl::SimpleAtoi(value, &content_length)) {
+          Fail(400);
+          return data.size();
+        }
+      } else if (absl::EqualsIgnoreCase(header.first, "Connection")) {
+        if (absl::EqualsIgnoreCase(value, "close")) keep_alive = false;
+        if (absl::EqualsIgnoreCase(value, "keep-alive")) keep_alive = true;
+      }
+    }
+    if (content_length > kMaxBody) {
+      Fail(413);
+      return data.size();
+    }
+    const size_t size = header_end + 4 + content_length;
+    if (data.size() < size) return 0;
+
+    request.method = std::string(request_line[0]);
+    const absl::string_view target = request_line[1];
+    const size_t query_start = target.find('?');
+    request.path = UrlDecode(target.substr(0, query_start));
+    if (query_start != absl::string_view::npos) {
+      for (absl::string_view param : absl::StrSplit(
+               target.substr(query_start + 1), '&', absl::SkipEmpty())) {
+        std::pair<absl::string_view, absl::string_view> kv =
+            absl::StrSplit(param, absl::MaxSplits('=', 1));
+        request.query[UrlDecode(kv.first)] = UrlDecode(kv.second);
+      }
+    }
+    request.body = std::string(data.substr(header_end + 4, content_length));
+
+    // Requests carry no session, and clients often connect for each one, so
+    // a host's requests are one client's.
+    const ClientId& peer = ClientScope::current();
+    ClientScope scope({peer.listener, peer.address, ""});
+    Respond(server_.Handle(request), keep_alive);
+    if (!keep_alive) connection_.Close();
+    return size;
+  }
+
+  void Respond(const HttpResponse& response, bool keep_alive) {
+    std::string headers;
+    for (const auto& [name, value] : response.headers) {
+      absl::StrAppend(&headers, "\r\n", name, ": ", value);
+    }
+    connection_.Send(absl::StrCat(
+        "HTTP/1.1 ", response.status, " ", StatusText(response.status),
+        "\r\nContent-Type: ", response.content_type,
+        "\r\nContent-Length: ", response.body.size(), headers,
+        keep_alive ? "" : "\r\nConnection: close", "\r\n\r\n",
+        response.body));
+  }
+
+  void Fail(int status) {
+    Respond(HttpError(status, StatusText(status)), /*keep_alive=*/false);
+    connection_.Close();
+  }
+
+  const HttpServer& server_;
+  TcpConnection& connection_;
+};
+
+absl::StatusOr<std::unique_ptr<HttpServer>> HttpServer::Create(
+    EventLoop& loop, uint16_t port) {
+  std::unique_ptr<HttpServer> server(new HttpServer());
+  absl::StatusOr<std::unique_ptr<TcpServer>> tcp_server = TcpServer::Create(
+      loop, port, [s = server.get()](TcpConnection& connection) {
+        return std::make_unique<Session>(*s, connection);
+      });
+  if (!tcp_server.ok()) return tcp_server.status();
+  server->tcp_server_ = *std::move(tcp_server);
+  return server;
+}
+
+void HttpServer::AddHandler(std::string prefix, Handler handler) {
+  handlers_.emplace_back(std::move(prefix), std::move(handler));
+  // Longest prefix first.
+  std::sort(handlers_.begin(), handlers_.end(),
+            [](const auto& a, const auto& b) {
+              return a.first.size() > b.first.size();
+            });
+}
+
+HttpResponse HttpServer::Handle(const HttpRequest& request) const {
+  for (const auto& [prefix, handler] : handlers_) {
+    if (absl::StartsWith(request.path, prefix)) return handler(request);
+  }
+  return HttpError(404, "Not found");
+}
+
+}  // namespace visca2uvc
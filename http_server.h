@@ -0,0 +1,68 @@
+#ifndef VISCA2UVC_HTTP_SERVER_H_
+#define VISCA2UVC_HTTP_SERVER_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "event_loop.h"
+#include "tcp_server.h"
+
+namespace visca2uvc {
+
+struct HttpRequest {
+  std::string method;
+  // Without the query string.
+  std::string path;
+  // Decoded query parameters.
+  absl::flat_hash_map<std::string, std::string> query;
+  // Names in lower case.
+  absl::flat_hash_map<std::string, std::string> headers;
+  std::string body;
+};
+
+struct HttpResponse {
+  int status = 200;
+  std::string content_type = "application/json";
+  // Further headers, e.g. {"Cache-Control", "no-cache"}.
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+};
+
+// Minimal HTTP/1.1 server. Connections are persistent unless the client asks
+// otherwise and pipelined requests are answered in order, so automation can
+// send many requests over one connection without waiting for each reply.
+class HttpServer {
+ public:
+  using Handler = std::function<HttpResponse(const HttpRequest&)>;
+
+  static absl::StatusOr<std::unique_ptr<HttpServer>> Create(EventLoop& loop,
+                                                            uint16_t port);
+
+  // Serves requests whose path starts with `prefix`. The longest matching
+  // prefix wins.
+  void AddHandler(std::string prefix, Handler handler);
+
+ private:
+  class Session;
+
+  HttpServer() = default;
+
+  HttpResponse Handle(const HttpRequest& request) const;
+
+  std::unique_ptr<TcpServer> tcp_server_;
+  std::vector<std::pair<std::string, Handler>> handlers_;
+};
+
+// Response with `{"error":"<message>"}` as the body.
+HttpResponse HttpError(int status, absl::string_view message);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_HTTP_SERVER_H_
@@ -0,0 +1,111 @@
+#include "http_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "camera.h"
+#include "event_loop.h"
+#include "fd.h"
+#include "gtest/gtest.h"
+#include "motion.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr uint16_t kPort = 18731;
+
+// A device whose queue is always full.
+class CongestedBackend : public Backend {
+ public:
+  Capabilities Probe() override {
+    Capabilities capabilities;
+    capabilities.pan_speed = 10;
+    capabilities.tilt_speed = 10;
+    return capabilities;
+  }
+  void Refresh() override {}
+  absl::Status SetZoomAbs(int32_t value) override { return absl::OkStatus(); }
+  absl::Status SetZoomRel(const ZoomRel& zoom) override {
+    return absl::OkStatus();
+  }
+  absl::Status SetPanTiltAbs(const PanTiltAbs& pantilt) override {
+    return absl::OkStatus();
+  }
+  absl::Status SetPanTiltRel(const PanTiltRel& pantilt) override {
+    return absl::OkStatus();
+  }
+  absl::Status SetFocusAbs(int32_t value) override {
+    return absl::OkStatus();
+  }
+  absl::Status SetFocusRel(const FocusRel& focus) override {
+    return absl::OkStatus();
+  }
+  absl::Status SetFocusAuto(bool enabled) override {
+    return absl::OkStatus();
+  }
+  bool congested() const override { return true; }
+};
+
+// Runs `loop` for `duration`.
+void RunFor(EventLoop& loop, absl::Duration duration) {
+  loop.AddTimer(duration, [&loop] { loop.Stop(); });
+  ASSERT_TRUE(loop.Run().ok());
+}
+
+Fd Connect() {
+  Fd fd(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(kPort);
+  if (connect(fd.get(), reinterpret_cast<const sockaddr*>(&addr),
+              sizeof(addr)) < 0) {
+    fd.Reset();
+  }
+  return fd;
+}
+
+bool SendRequest(const Fd& fd) {
+  const std::string request = "PUT /drive HTTP/1.1\r\nHost: test\r\n\r\n";
+  return write(fd.get(), request.data(), request.size()) ==
+         static_cast<ssize_t>(request.size());
+}
+
+TEST(HttpServerTest, PausesClientsWhoseRequestsBackUp) {
+  EventLoop loop;
+  Camera camera(1, std::make_unique<CongestedBackend>());
+  camera.Probe();
+  MotionController motion(loop, camera, absl::Milliseconds(20));
+  absl::StatusOr<std::unique_ptr<HttpServer>> server =
+      HttpServer::Create(loop, kPort);
+  ASSERT_TRUE(server.ok()) << server.status();
+  int handled = 0;
+  (*server)->AddHandler("/drive", [&](const HttpRequest& request) {
+    ++handled;
+    motion.MovePanTilt(1, 0);
+    return HttpResponse();
+  });
+
+  Fd client = Connect();
+  ASSERT_TRUE(client.valid());
+  ASSERT_TRUE(SendRequest(client));
+  RunFor(loop, absl::Milliseconds(10));
+  EXPECT_EQ(handled, 1);
+
+  // The congested drive paused the connection, the next request waits.
+  ASSERT_TRUE(SendRequest(client));
+  RunFor(loop, absl::Milliseconds(20));
+  EXPECT_EQ(handled, 1);
+  RunFor(loop, absl::Milliseconds(100));
+  EXPECT_EQ(handled, 2);
+}
+
+}  // namespace
+}  // namespace visca2uvc
@@ -0,0 +1,160 @@
+#include "json.h"
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+
+namespace visca2uvc {
+namespace {
+
+class Parser {
+ public:
+  explicit Parser(absl::string_view json) : json_(json) {}
+
+  absl::StatusOr<std::vector<JsonObject>> ObjectArray() {
+    std::vector<JsonObject> result;
+    if (!Consume('[')) return Error("expected '['");
+    if (Consume(']')) return Finish(std::move(result));
+    do {
+      absl::StatusOr<JsonObject> object = Object();
+      if (!object.ok()) return object.status();
+      result.push_back(*std::move(object));
+    } while (Consume(','));
+    if (!Consume(']')) return Error("expected ']'");
+    return Finish(std::move(result));
+  }
+
+ private:
+  absl::StatusOr<JsonObject> Object() {
+    JsonObject result;
+    if (!Consume('{')) return Error("expected '{'");
+    if (Consume('}')) return result;
+    do {
+      SkipWhitespace();
+      absl::StatusOr<std::string> key = String();
+      if (!key.ok()) return key.status();
+      if (!Consume(':')) return Error("expected ':'");
+      absl::StatusOr<std::string> value = Scalar();
+      if (!value.ok()) return value.status();
+      result[*std::move(key)] = *std::move(value);
+    } while (Consume(','));
+    if (!Consume('}')) return Error("expected '}'");
+    return result;
+  }
+
+  absl::StatusOr<std::string> Scalar() {
+    SkipWhitespace();
+    if (pos_ < json_.size() && json_[pos_] == '"') return String();
+    const size_t start = pos_;
+    while (pos_ < json_.size() &&
+           (absl::ascii_isalnum(json_[pos_]) || json_[pos_] == '-' ||
+            json_[pos_] == '+' || json_[pos_] == '.')) {
+      ++pos_;
+    }
+    if (pos_ == start) return Error("expected a scalar value");
+    return std::string(json_.substr(start, pos_ - start));
+  }
+
+  absl::StatusOr<std::string> String() {
+    if (pos_ >= json_.size() || json_[pos_] != '"') {
+      return Error("expected a string");
+    }
+    ++pos_;
+    std::string result;
+    while (pos_ < json_.size() && json_[pos_] != '"') {
+      char c = json_[pos_++];
+      if (c == '\\') {
+        if (pos_ >= json_.size()) break;
+        c = json_[pos_++];
+        switch (c) {
+          case 'n':
+            c = '\n';
+            break;
+          case 't':
+            c = '\t';
+            break;
+          case 'r':
+            c = '\r';
+            break;
+          case 'b':
+            c = '\b';
+            break;
+          case 'f':
+            c = '\f';
+            break;
+          case 'u':
+            // Control names are ASCII, other code points aren't needed.
+            return Error("\\u escapes are not supported");
+          default:
+            break;
+        }
+      }
+      result.push_back(c);
+    }
+    if (pos_ >= json_.size()) return Error("unterminated string");
+    ++pos_;
+    return result;
+  }
+
+  bool Consume(char c) {
+    SkipWhitespace();
+    if (pos_ < json_.size() && json_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  void SkipWhitespace() {
+    while (pos_ < json_.size() && absl::ascii_isspace(json_[pos_])) ++pos_;
+  }
+
+  absl::StatusOr<std::vector<JsonObject>> Finish(
+      std::vector<JsonObject> result) {
+    SkipWhitespace();
+    if (pos_ != json_.size()) return Error("trailing data");
+    return result;
+  }
+
+  absl::Status Error(absl::string_view message) const {
+    return absl::InvalidArgumentError(
+        absl::StrCat("JSON at offset ", pos_, ": ", message));
+  }
+
+  absl::string_view json_;
+  size_t pos_ = 0;
+};
+
+}  // namespace
+
+absl::StatusOr<std::vector<JsonObject>> ParseJsonObjectArray(
+    absl::string_view json) {
+  return Parser(json).ObjectArray();
+}
+
+std::string JsonString(absl::string_view value) {
+  std::string result = "\"";
+  for (const char c : value) {
+    switch (c) {
+      case '"':
+        result += "\\\"";
+        break;
+      case '\\':
+        result += "\\\\";
+        break;
+      case '\n':
+        result += "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppendFormat(&result, "\\u%04x", c);
+        } else {
+          result.push_back(c);
+        }
+    }
+  }
+  result += "\"";
+  return result;
+}
+
+}  // namespace visca2uvc
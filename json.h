@@ -0,0 +1,27 @@
+#ifndef VISCA2UVC_JSON_H_
+#define VISCA2UVC_JSON_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace visca2uvc {
+
+// Members of a JSON object with scalar values. Strings are unescaped, numbers
+// and literals keep their JSON spelling.
+using JsonObject = absl::flat_hash_map<std::string, std::string>;
+
+// Parses a JSON array of objects with scalar members, e.g. a batch of control
+// changes. Nested arrays and objects are rejected.
+absl::StatusOr<std::vector<JsonObject>> ParseJsonObjectArray(
+    absl::string_view json);
+
+// Quotes and escapes `value` as a JSON string.
+std::string JsonString(absl::string_view value);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_JSON_H_
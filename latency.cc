@@ -0,0 +1,218 @@
+#include "latency.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "event_loop.h"
+#include "fd.h"
+#include "frame_image.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr int kScale = 8;
+// Mean difference per pixel on top of the noise that counts as motion.
+constexpr double kMinChange = 1.5;
+
+uint64_t MonotonicNs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return uint64_t{1000000000} * now.tv_sec + now.tv_nsec;
+}
+
+absl::StatusOr<std::vector<uint8_t>> Luma(const FrameRing& ring,
+                                          const FrameRing::Frame& frame) {
+  Image image;
+  if (absl::Status status = Downscale(ring, frame, kScale, image);
+      !status.ok()) {
+    return status;
+  }
+  std::vector<uint8_t> luma(image.width * image.height);
+  for (size_t i = 0; i < luma.size(); ++i) luma[i] = image.pixels[3 * i];
+  return luma;
+}
+
+// A plain loop over contiguous bytes, which compilers turn into SAD
+// instructions.
+double MeanAbsDiff(const std::vector<uint8_t>& a,
+                   const std::vector<uint8_t>& b) {
+  if (a.size() != b.size() || a.empty()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  uint64_t sum = 0;
+  for (size_t i = 0; i < a.size(); ++i) sum += std::abs(a[i] - b[i]);
+  return static_cast<double>(sum) / a.size();
+}
+
+class ZoomLatencyProbe {
+ public:
+  ZoomLatencyProbe(UvcDeviceHandle& handle, FrameRing& ring,
+                   const LatencyOptions& options, uint8_t speed)
+      : handle_(handle), ring_(ring), options_(options), speed_(speed) {}
+
+  absl::StatusOr<LatencyReport> Run();
+
+ private:
+  enum class Phase { kSettling, kReference, kNoise, kMoving };
+
+  void OnFrames();
+  absl::Status OnFrame(const FrameRing::Frame& frame);
+  void Settle();
+  void EndTrial(std::optional<absl::Duration> latency);
+  void Finish(absl::Status status);
+
+  UvcDeviceHandle& handle_;
+  FrameRing& ring_;
+  const LatencyOptions options_;
+  const uint8_t speed_;
+  EventLoop loop_;
+  Fd event_;
+  Phase phase_ = Phase::kSettling;
+  int trial_ = 0;
+  uint64_t next_frame_ = 0;
+  std::vector<uint8_t> reference_;
+  double threshold_ = 0;
+  uint64_t dispatched_ns_ = 0;
+  EventLoop::TimerId timeout_ = 0;
+  bool done_ = false;
+  absl::Status status_;
+  LatencyReport report_;
+};
+
+absl::StatusOr<LatencyReport> ZoomLatencyProbe::Run() {
+  event_.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  RETURN_IF_ERRNO(event_.get());
+  if (absl::Status status = ring_.AddConsumer(event_.get()); !status.ok()) {
+    return status;
+  }
+  next_frame_ = ring_.head();
+  loop_.WatchFd(event_.get(), POLLIN, [this](short) { OnFrames(); });
+  Settle();
+  absl::Status status = loop_.Run();
+  loop_.UnwatchFd(event_.get());
+  ring_.RemoveConsumer(event_.get());
+  if (phase_ == Phase::kMoving) {
+    handle_.SetZoomRel({0, 0, speed_}).IgnoreError();
+  }
+  if (!status.ok()) return status;
+  if (!status_.ok()) return status_;
+  std::sort(report_.samples.begin(), report_.samples.end());
+  return report_;
+}
+
+void ZoomLatencyProbe::OnFrames() {
+  uint64_t count;
+  if (read(event_.get(), &count, sizeof(count)) < 0) return;
+  for (const uint64_t head = ring_.head(); next_frame_ < head && !done_;
+       ++next_frame_) {
+    // Frames overwritten before we got to them are skipped.
+    const std::optional<FrameRing::Frame> frame = ring_.Get(next_frame_);
+    if (!frame.has_value()) continue;
+    if (absl::Status status = OnFrame(*frame); !status.ok()) Finish(status);
+  }
+}
+
+absl::Status ZoomLatencyProbe::OnFrame(const FrameRing::Frame& frame) {
+  if (phase_ == Phase::kSettling ||
+      (phase_ == Phase::kMoving && frame.capture_ns <= dispatched_ns_)) {
+    return absl::OkStatus();
+  }
+  absl::StatusOr<std::vector<uint8_t>> luma = Luma(ring_, frame);
+  if (!ring_.Valid(frame)) return absl::OkStatus();
+  if (!luma.ok()) return luma.status();
+
+  switch (phase_) {
+    case Phase::kSettling:
+      break;
+    case Phase::kReference:
+      reference_ = *std::move(luma);
+      phase_ = Phase::kNoise;
+      break;
+    case Phase::kNoise: {
+      threshold_ = 2 * MeanAbsDiff(reference_, *luma) + kMinChange;
+      const int8_t direction = trial_ % 2 == 0 ? 1 : -1;
+      dispatched_ns_ = MonotonicNs();
+      if (absl::Status status = handle_.SetZoomRel({direction, 0, speed_});
+          !status.ok()) {
+        return status;
+      }
+      phase_ = Phase::kMoving;
+      timeout_ = loop_.AddTimer(options_.timeout, [this] {
+        timeout_ = 0;
+        EndTrial(std::nullopt);
+      });
+      break;
+    }
+    case Phase::kMoving:
+      if (MeanAbsDiff(reference_, *luma) > threshold_) {
+        EndTrial(absl::Nanoseconds(frame.capture_ns - dispatched_ns_));
+      }
+      break;
+  }
+  return absl::OkStatus();
+}
+
+void ZoomLatencyProbe::Settle() {
+  phase_ = Phase::kSettling;
+  loop_.AddTimer(options_.settle, [this] { phase_ = Phase::kReference; });
+}
+
+void ZoomLatencyProbe::EndTrial(std::optional<absl::Duration> latency) {
+  if (timeout_ != 0) loop_.CancelTimer(timeout_);
+  timeout_ = 0;
+  if (absl::Status status = handle_.SetZoomRel({0, 0, speed_});
+      !status.ok()) {
+    Finish(status);
+    return;
+  }
+  phase_ = Phase::kSettling;
+  if (latency.has_value()) {
+    report_.samples.push_back(*latency);
+  } else {
+    ++report_.misses;
+  }
+  if (++trial_ == options_.trials) {
+    Finish(absl::OkStatus());
+  } else {
+    Settle();
+  }
+}
+
+void ZoomLatencyProbe::Finish(absl::Status status) {
+  status_ = std::move(status);
+  done_ = true;
+  loop_.Stop();
+}
+
+}  // namespace
+
+absl::Duration LatencyReport::Percentile(double fraction) const {
+  const int index = std::ceil(fraction * samples.size()) - 1;
+  return samples[std::clamp<int>(index, 0, samples.size() - 1)];
+}
+
+absl::StatusOr<LatencyReport> MeasureZoomLatency(
+    UvcDeviceHandle& handle, FrameRing& ring, const LatencyOptions& options) {
+  if (options.trials < 1) {
+    return absl::InvalidArgumentError("Latency needs at least one trial");
+  }
+  // Full speed, so that motion is visible as early as possible.
+  absl::StatusOr<ZoomRel> max = handle.GetZoomRel(UVC_GET_MAX);
+  if (!max.ok()) return max.status();
+  ZoomLatencyProbe probe(handle, ring, options,
+                         std::max<uint8_t>(max->speed, 1));
+  return probe.Run();
+}
+
+}  // namespace visca2uvc
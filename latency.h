@@ -0,0 +1,47 @@
+#ifndef VISCA2UVC_LATENCY_H_
+#define VISCA2UVC_LATENCY_H_
+
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "frame_ring.h"
+#include "uvc.h"
+
+namespace visca2uvc {
+
+struct LatencyOptions {
+  int trials = 10;
+  // Pause after each trial so that the image is still again.
+  absl::Duration settle = absl::Seconds(1);
+  // A trial without visible motion after this long counts as a miss.
+  absl::Duration timeout = absl::Seconds(2);
+};
+
+struct LatencyReport {
+  // Sorted.
+  std::vector<absl::Duration> samples;
+  int misses = 0;
+
+  // `fraction` of the samples are at most the result, e.g. 0.5 for the
+  // median. Requires samples.
+  absl::Duration Percentile(double fraction) const;
+};
+
+// Measures the time from a zoom command to the first frame showing motion.
+//
+// Each trial takes a reference frame of the still camera, estimates the
+// sensor noise from the next one and starts zooming, alternating in and out.
+// Frames are shrunk to 1/8 of their size and compared to the reference by
+// mean absolute difference of the luma; the first frame clearly above the
+// noise ends the trial. Latency is its capture time minus the time the
+// control transfer was issued, so it includes the transfer, the camera's
+// reaction and the delivery of the frame.
+//
+// Runs its own event loop until done and streams from `ring` meanwhile.
+absl::StatusOr<LatencyReport> MeasureZoomLatency(
+    UvcDeviceHandle& handle, FrameRing& ring, const LatencyOptions& options);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_LATENCY_H_
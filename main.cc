@@ -1,116 +1,139 @@
-#include <libuvc/libuvc.h>
-
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "device_index.h"
+#include "frame_ring.h"
+#include "latency.h"
+#include "server.h"
+#include "uvc.h"
 
-namespace {
-
-#define RETURN_IF_UVC_ERROR(expr)                                             \
-  if (const uvc_error err = (expr); err < 0) {                                \
-    return absl::InternalError(absl::StrCat(#expr, ": ", uvc_strerror(err))); \
-  }
-
-struct ZoomRel {
-  int8_t zoom_rel;
-  uint8_t digital_zoom;
-  uint8_t speed;
-
-  friend std::ostream& operator<<(std::ostream& os, const ZoomRel& value) {
-    os << "zoom_rel: " << value.zoom_rel
-       << ", digital_zoom: " << value.digital_zoom
-       << ", speed: " << value.speed;
-    return os;
-  }
-};
-
-class UvcDelete {
- public:
-  void operator()(uvc_device_handle_t* ptr) noexcept { uvc_close(ptr); }
-  void operator()(uvc_device_t* ptr) noexcept { uvc_unref_device(ptr); }
-  void operator()(uvc_context_t* ptr) noexcept { uvc_exit(ptr); }
-};
-
-template <typename T>
-using UvcUniquePtr = std::unique_ptr<T, UvcDelete>;
-
-class UvcDeviceHandle {
- public:
-  using Ptr = UvcUniquePtr<uvc_device_handle_t>;
-  explicit UvcDeviceHandle(Ptr handle) : handle_(std::move(handle)) {}
-
-  absl::StatusOr<uint16_t> GetZoomAbs(uvc_req_code req_code) const {
-    uint16_t result;
-    RETURN_IF_UVC_ERROR(uvc_get_zoom_abs(handle_.get(), &result, req_code));
-    return result;
-  }
-
-  absl::Status SetZoomAbs(uint16_t focal_length) {
-    RETURN_IF_UVC_ERROR(uvc_set_zoom_abs(handle_.get(), focal_length));
-    return absl::OkStatus();
-  }
-
-  absl::StatusOr<ZoomRel> GetZoomRel(uvc_req_code req_code) const {
-    ZoomRel result;
-    RETURN_IF_UVC_ERROR(uvc_get_zoom_rel(handle_.get(), &result.zoom_rel,
-                                         &result.digital_zoom, &result.speed,
-                                         req_code));
-    return result;
-  }
-
-  absl::Status SetZoomRel(const ZoomRel& zoom) {
-    RETURN_IF_UVC_ERROR(uvc_set_zoom_rel(handle_.get(), zoom.zoom_rel,
-                                         zoom.digital_zoom, zoom.speed));
-    return absl::OkStatus();
-  }
-
-  void PrintDiag(FILE* file) const { uvc_print_diag(handle_.get(), file); }
-
- private:
-  Ptr handle_;
-};
-
-class UvcDevice {
- public:
-  using Ptr = UvcUniquePtr<uvc_device_t>;
-  explicit UvcDevice(Ptr dev) : dev_(std::move(dev)) {}
-
-  absl::StatusOr<UvcDeviceHandle> Open() {
-    uvc_device_handle_t* handle;
-    RETURN_IF_UVC_ERROR(uvc_open(dev_.get(), &handle));
-    return UvcDeviceHandle(UvcDeviceHandle::Ptr(handle));
-  }
-
- private:
-  Ptr dev_;
-};
+ABSL_FLAG(absl::Duration, poll_interval, absl::Milliseconds(200),
+          "serve: How often the cameras' state is refreshed.");
+ABSL_FLAG(absl::Duration, motion_tick, absl::Milliseconds(20),
+          "serve: Minimum time between control transfers to a camera.");
+ABSL_FLAG(absl::Duration, usb_bus_spacing, absl::Milliseconds(2),
+          "serve: Minimum time between control transfers of different "
+          "cameras on one USB bus.");
+ABSL_FLAG(absl::Duration, control_lock, absl::ZeroDuration(),
+          "serve: Motion commands lock a camera for their client until it "
+          "was idle this long, disabled when 0.");
+ABSL_FLAG(int, watchdog_timeouts, 3,
+          "serve: Consecutive timed out transfers after which a UVC camera "
+          "is reset and re-opened, never when 0.");
+ABSL_FLAG(int, probe_threads, 8,
+          "serve: Threads reading the cameras' capabilities while serving.");
+ABSL_FLAG(std::vector<std::string>, client_classes, {},
+          "serve: Comma-separated <listener or address>=operator|automation|"
+          "monitoring, e.g. tcp:8080=automation,10.0.0.5=operator. Listeners "
+          "are tcp:<port>, udp:<port>, a serial device and shm.");
+ABSL_FLAG(float, tracking_kp, 1.0f,
+          "serve: Proportional gain of auto-tracking.");
+ABSL_FLAG(float, tracking_ki, 0.0f, "serve: Integral gain of auto-tracking.");
+ABSL_FLAG(float, tracking_kd, 0.0f,
+          "serve: Derivative gain of auto-tracking.");
+ABSL_FLAG(float, tracking_max_acceleration, 4.0f,
+          "serve: Maximum change of an auto-tracking speed, in full speed "
+          "per second.");
+ABSL_FLAG(uint16_t, websocket_port, 0,
+          "serve: Port of the WebSocket API, disabled when 0.");
+ABSL_FLAG(uint16_t, http_port, 0,
+          "serve: Port of the HTTP APIs, disabled when 0.");
+ABSL_FLAG(uint16_t, aw_port, 0,
+          "serve: Port of the Panasonic AW CGI for camera 1, the next cameras "
+          "get the following ports, disabled when 0.");
+ABSL_FLAG(uint16_t, osc_port, 0,
+          "serve: UDP port of the OSC listener, disabled when 0.");
+ABSL_FLAG(uint16_t, pelco_port, 0,
+          "serve: TCP port of the PELCO-D/P listener, disabled when 0.");
+ABSL_FLAG(std::string, pelco_serial, "",
+          "serve: Serial line or pty to read PELCO-D/P from, disabled when "
+          "empty.");
+ABSL_FLAG(int, pelco_baud, 2400, "serve: Baud rate of --pelco_serial.");
+ABSL_FLAG(std::string, visca_serial, "",
+          "serve: Serial line or pty to read VISCA from, disabled when empty.");
+ABSL_FLAG(int, visca_baud, 9600, "serve: Baud rate of --visca_serial.");
+ABSL_FLAG(std::string, shm_socket, "",
+          "serve: Unix socket of the shared memory command channel, disabled "
+          "when empty.");
+ABSL_FLAG(std::string, device_profile, "",
+          "serve, measure_latency: Device profile describing vendor "
+          "extension unit controls, see profile.h. measure_latency appends "
+          "its result.");
+ABSL_FLAG(std::vector<std::string>, uvc_devices, {},
+          "Comma-separated UVC cameras, each serial:<serial number> or "
+          "port:<bus>-<port>.<port>, see list_devices. serve numbers them "
+          "in this order, the other commands use the first. All cameras in "
+          "enumeration order by default.");
+ABSL_FLAG(std::vector<std::string>, v4l2_devices, {},
+          "serve: Comma-separated V4L2 devices to control through the kernel "
+          "driver instead of claiming cameras with libuvc, e.g. /dev/video0.");
+ABSL_FLAG(std::vector<std::string>, visca_upstream, {},
+          "serve: Comma-separated VISCA cameras to serve after the UVC "
+          "cameras, each udp|tcp:<ip>:<port>[/<address>].");
+ABSL_FLAG(absl::Duration, motion_deadline, absl::Milliseconds(150),
+          "serve: Pan, tilt, zoom and focus drives queued for an upstream "
+          "VISCA camera longer than this are dropped instead of sent late.");
+ABSL_FLAG(int, command_queue_size, 8,
+          "serve: Requests queued for an upstream VISCA camera, beyond which "
+          "refreshes and inquiries are shed and controllers pushed back.");
+ABSL_FLAG(std::string, frame_socket, "",
+          "serve: Unix socket handing out the cameras' video in shared "
+          "memory, disabled when empty.");
+ABSL_FLAG(std::string, frame_format, "mjpeg",
+          "serve, measure_latency: Video format of --frame_socket, mjpeg or "
+          "yuyv.");
+ABSL_FLAG(int, frame_width, 1920,
+          "serve, measure_latency: Frame width of --frame_socket.");
+ABSL_FLAG(int, frame_height, 1080,
+          "serve, measure_latency: Frame height of --frame_socket.");
+ABSL_FLAG(int, frame_fps, 30,
+          "serve, measure_latency: Frame rate of --frame_socket.");
+ABSL_FLAG(int, frame_slots, 8,
+          "serve: Frames kept per camera for --frame_socket consumers.");
+ABSL_FLAG(int, preview_every, 0,
+          "serve: Serves a thumbnail of every this many --frame_socket frames "
+          "at /previews/<id>.jpg of --http_port, disabled when 0.");
+ABSL_FLAG(int, preview_scale, 8,
+          "serve: Thumbnails are 1/scale of the frame size, 1, 2, 4 or 8.");
+ABSL_FLAG(int, preview_quality, 75, "serve: JPEG quality of thumbnails.");
+ABSL_FLAG(std::string, multicast_group, "",
+          "serve: Multicast group for state changes, disabled when empty.");
+ABSL_FLAG(uint16_t, multicast_port, 52380,
+          "serve: Port of the binary state stream.");
+ABSL_FLAG(uint16_t, multicast_json_port, 0,
+          "serve: Port of the JSON state stream, disabled when 0.");
+ABSL_FLAG(int, multicast_ttl, 1, "serve: TTL of the state stream.");
+ABSL_FLAG(absl::Duration, snapshot_interval, absl::Seconds(1),
+          "serve: How often full state is sent to the multicast group.");
 
-class UvcContext {
- public:
-  using Ptr = UvcUniquePtr<uvc_context_t>;
-  explicit UvcContext(Ptr ctx) : ctx_(std::move(ctx)) {}
-
-  static absl::StatusOr<UvcContext> Create() {
-    uvc_context_t* ctx;
-    RETURN_IF_UVC_ERROR(uvc_init(&ctx, /*usb_ctx=*/nullptr));
-    return UvcContext(Ptr(ctx));
-  }
-
-  absl::StatusOr<UvcDevice> FindDevice(int vid, int pid, const char* sn) {
-    uvc_device_t* dev;
-    RETURN_IF_UVC_ERROR(uvc_find_device(ctx_.get(), &dev, vid, pid, sn));
-    return UvcDevice(UvcDevice::Ptr(dev));
-  }
+namespace {
 
- private:
-  Ptr ctx_;
-};
+using ::visca2uvc::FrameRing;
+using ::visca2uvc::FrameRingOptions;
+using ::visca2uvc::LatencyOptions;
+using ::visca2uvc::LatencyReport;
+using ::visca2uvc::MeasureZoomLatency;
+using ::visca2uvc::PreviewOptions;
+using ::visca2uvc::Serve;
+using ::visca2uvc::ServerOptions;
+using ::visca2uvc::StatePublisherOptions;
+using ::visca2uvc::UvcContext;
+using ::visca2uvc::UvcDevice;
+using ::visca2uvc::UvcDeviceHandle;
+using ::visca2uvc::UvcDeviceIndex;
+using ::visca2uvc::ZoomRel;
 
 template <typename T>
 absl::StatusOr<T> SimpleAtoi(absl::string_view str) {
@@ -122,6 +145,62 @@ absl::StatusOr<T> SimpleAtoi(absl::string_view str) {
   return T(result);
 }
 
+absl::StatusOr<FrameRingOptions> FrameRingOptionsFromFlags() {
+  FrameRingOptions frames;
+  const std::string format = absl::GetFlag(FLAGS_frame_format);
+  if (format == "mjpeg") {
+    frames.format = UVC_FRAME_FORMAT_MJPEG;
+  } else if (format == "yuyv") {
+    frames.format = UVC_FRAME_FORMAT_YUYV;
+  } else {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown --frame_format: ", format));
+  }
+  frames.width = absl::GetFlag(FLAGS_frame_width);
+  frames.height = absl::GetFlag(FLAGS_frame_height);
+  frames.fps = absl::GetFlag(FLAGS_frame_fps);
+  frames.slots = absl::GetFlag(FLAGS_frame_slots);
+  return frames;
+}
+
+// Measures zoom latency with the --frame_* stream and appends the median to
+// --device_profile if set.
+absl::Status MeasureLatency(UvcDeviceHandle& handle, int trials) {
+  absl::StatusOr<FrameRingOptions> frames = FrameRingOptionsFromFlags();
+  if (!frames.ok()) return frames.status();
+  absl::StatusOr<std::unique_ptr<FrameRing>> ring =
+      FrameRing::Create(*frames, {1, &handle});
+  if (!ring.ok()) return ring.status();
+  LatencyOptions options;
+  options.trials = trials;
+  absl::StatusOr<LatencyReport> report =
+      MeasureZoomLatency(handle, **ring, options);
+  if (!report.ok()) return report.status();
+  std::cout << "samples: " << report->samples.size()
+            << ", misses: " << report->misses << "\n";
+  if (report->samples.empty()) {
+    return absl::NotFoundError("No zoom motion seen, is the zoom at its end?");
+  }
+  const auto ms = [](absl::Duration d) {
+    return absl::StrFormat("%.1f", absl::ToDoubleMilliseconds(d));
+  };
+  const std::string summary = absl::StrCat(
+      "min ", ms(report->samples.front()), " ms, median ",
+      ms(report->Percentile(0.5)), " ms, p90 ", ms(report->Percentile(0.9)),
+      " ms, max ", ms(report->samples.back()), " ms");
+  std::cout << summary << "\n";
+
+  const std::string profile = absl::GetFlag(FLAGS_device_profile);
+  if (profile.empty()) return absl::OkStatus();
+  std::ofstream file(profile, std::ios::app);
+  file << "zoom_latency " << ms(report->Percentile(0.5)) << "  # " << summary
+       << ", " << report->samples.size() << " samples\n";
+  if (!file) {
+    return absl::InternalError(absl::StrCat("Can't write ", profile));
+  }
+  return absl::OkStatus();
+}
+
 absl::Status Visca2Uvc(const absl::Span<char* const> args) {
   if (args.size() <= 1) {
     std::cout << R"(Usage: visca2uvc [cmd] ...
@@ -131,13 +210,88 @@ absl::Status Visca2Uvc(const absl::Span<char* const> args) {
 
   get_zoom_rel
   set_zoom_rel zoom_rel digital_zoom speed
+
+  measure_latency [trials]
+
+  list_devices
+
+  serve
 )";
     return absl::OkStatus();
   }
 
+  if (absl::string_view(args[1]) == "serve") {
+    ServerOptions options;
+    options.poll_interval = absl::GetFlag(FLAGS_poll_interval);
+    options.motion_tick = absl::GetFlag(FLAGS_motion_tick);
+    options.usb_bus_spacing = absl::GetFlag(FLAGS_usb_bus_spacing);
+    options.probe_threads = absl::GetFlag(FLAGS_probe_threads);
+    options.watchdog_timeouts = absl::GetFlag(FLAGS_watchdog_timeouts);
+    options.client_classes = absl::GetFlag(FLAGS_client_classes);
+    options.control_lock = absl::GetFlag(FLAGS_control_lock);
+    options.websocket_port = absl::GetFlag(FLAGS_websocket_port);
+    options.http_port = absl::GetFlag(FLAGS_http_port);
+    options.aw_port = absl::GetFlag(FLAGS_aw_port);
+    options.osc_port = absl::GetFlag(FLAGS_osc_port);
+    options.tracking.kp = absl::GetFlag(FLAGS_tracking_kp);
+    options.tracking.ki = absl::GetFlag(FLAGS_tracking_ki);
+    options.tracking.kd = absl::GetFlag(FLAGS_tracking_kd);
+    options.tracking.max_acceleration =
+        absl::GetFlag(FLAGS_tracking_max_acceleration);
+    options.pelco_port = absl::GetFlag(FLAGS_pelco_port);
+    options.pelco_serial = absl::GetFlag(FLAGS_pelco_serial);
+    options.pelco_baud = absl::GetFlag(FLAGS_pelco_baud);
+    options.visca_serial = absl::GetFlag(FLAGS_visca_serial);
+    options.visca_baud = absl::GetFlag(FLAGS_visca_baud);
+    options.shm_socket = absl::GetFlag(FLAGS_shm_socket);
+    options.device_profile = absl::GetFlag(FLAGS_device_profile);
+    options.uvc_devices = absl::GetFlag(FLAGS_uvc_devices);
+    options.v4l2_devices = absl::GetFlag(FLAGS_v4l2_devices);
+    options.visca_upstreams = absl::GetFlag(FLAGS_visca_upstream);
+    options.command_deadlines.motion = absl::GetFlag(FLAGS_motion_deadline);
+    options.command_queue_size = absl::GetFlag(FLAGS_command_queue_size);
+    if (const std::string group = absl::GetFlag(FLAGS_multicast_group);
+        !group.empty()) {
+      StatePublisherOptions& publisher = options.state_publisher.emplace();
+      publisher.group = group;
+      publisher.port = absl::GetFlag(FLAGS_multicast_port);
+      publisher.json_port = absl::GetFlag(FLAGS_multicast_json_port);
+      publisher.ttl = absl::GetFlag(FLAGS_multicast_ttl);
+      publisher.snapshot_interval = absl::GetFlag(FLAGS_snapshot_interval);
+    }
+    if (const std::string socket = absl::GetFlag(FLAGS_frame_socket);
+        !socket.empty()) {
+      absl::StatusOr<FrameRingOptions> frames = FrameRingOptionsFromFlags();
+      if (!frames.ok()) return frames.status();
+      options.frames = *std::move(frames);
+      options.frames->socket_path = socket;
+    }
+    if (const int every = absl::GetFlag(FLAGS_preview_every); every > 0) {
+      PreviewOptions& preview = options.preview.emplace();
+      preview.every = every;
+      preview.scale = absl::GetFlag(FLAGS_preview_scale);
+      preview.quality = absl::GetFlag(FLAGS_preview_quality);
+    }
+    return Serve(options);
+  }
+
   auto uvc = UvcContext::Create().value();
-  // Get the first available UVC device.
-  UvcDevice dev = uvc.FindDevice(/*vid=*/0, /*pid=*/0, /*sn=*/nullptr).value();
+  if (absl::string_view(args[1]) == "list_devices") {
+    auto index = UvcDeviceIndex::Create(uvc, /*loop=*/nullptr).value();
+    for (const std::string& selector : index->selectors()) {
+      std::cout << selector << "\n";
+    }
+    return absl::OkStatus();
+  }
+  const std::vector<std::string> selectors = absl::GetFlag(FLAGS_uvc_devices);
+  // Get the selected or else the first available UVC device.
+  UvcDevice dev =
+      selectors.empty()
+          ? uvc.FindDevice(/*vid=*/0, /*pid=*/0, /*sn=*/nullptr).value()
+          : UvcDeviceIndex::Create(uvc, /*loop=*/nullptr)
+                .value()
+                ->Find(selectors.front())
+                .value();
   UvcDeviceHandle handle = dev.Open().value();
   handle.PrintDiag(stdout);
 
@@ -168,6 +322,9 @@ absl::Status Visca2Uvc(const absl::Span<char* const> args) {
     arg.speed = SimpleAtoi<uint8_t>(args[3]).value();
     std::cout << "set: " << handle.SetZoomRel(arg) << "\n";
     std::cout << "cur: " << handle.GetZoomRel(UVC_GET_CUR).value() << "\n";
+  } else if (cmd == "measure_latency") {
+    const int trials = args.size() > 2 ? SimpleAtoi<int>(args[2]).value() : 10;
+    return MeasureLatency(handle, trials);
   } else {
     std::cerr << "Unknown command: " << cmd << "\n";
   }
@@ -0,0 +1,532 @@
+#include "motion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <tuple>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "json.h"
+
+namespace visca2uvc {
+namespace {
+
+// Direction and magnitude of a normalized speed on a `max_speed` scale.
+std::pair<int8_t, uint8_t> ScaleSpeed(float speed, uint8_t max_speed) {
+  if (std::isnan(speed) || speed == 0 || max_speed == 0) return {0, 0};
+  const float magnitude = std::min(std::abs(speed), 1.0f) * max_speed;
+  return {speed < 0 ? int8_t{-1} : int8_t{1},
+          static_cast<uint8_t>(std::max(1.0f, std::round(magnitude)))};
+}
+
+// A client whose batch waits this many ticks is pushed back on.
+constexpr int kMaxBacklog = 10;
+
+// Full speed crosses the whole digital zoom range in this time.
+constexpr absl::Duration kDigitalZoomTraverse = absl::Seconds(3);
+
+// Within this fraction of the optical zoom range below its maximum, tele
+// drive ticks read the position rather than waiting for the next poll, so
+// that digital zoom takes over without a stall.
+constexpr double kHandoverWindow = 0.25;
+
+// `b` is unknown if it's empty, which is never the same.
+bool Same(const PanTiltRel& a, const std::optional<PanTiltRel>& b) {
+  return b.has_value() && a.pan_rel == b->pan_rel &&
+         a.pan_speed == b->pan_speed && a.tilt_rel == b->tilt_rel &&
+         a.tilt_speed == b->tilt_speed;
+}
+
+bool Same(const ZoomRel& a, const std::optional<ZoomRel>& b) {
+  return b.has_value() && a.zoom_rel == b->zoom_rel &&
+         a.digital_zoom == b->digital_zoom && a.speed == b->speed;
+}
+
+bool Same(const FocusRel& a, const std::optional<FocusRel>& b) {
+  return b.has_value() && a.focus_rel == b->focus_rel && a.speed == b->speed;
+}
+
+}  // namespace
+
+int MotionController::Pending::Transfers() const {
+  return pantilt_rel.has_value() + pantilt_abs.has_value() +
+         zoom_rel.has_value() + zoom_abs.has_value() +
+         digital_zoom.has_value() + focus_rel.has_value() +
+         focus_abs.has_value() + focus_auto.has_value() +
+         static_cast<int>(extensions.size());
+}
+
+MotionController::~MotionController() {
+  loop_.CancelTimer(timer_);
+  loop_.CancelTimer(zoom_timer_);
+}
+
+void MotionController::MovePanTilt(float pan, float tilt) {
+  if (!Acquire()) return;
+  pantilt_driver_ = ClientScope::current().key();
+  const Capabilities& caps = camera_.capabilities();
+  PanTiltRel rel;
+  std::tie(rel.pan_rel, rel.pan_speed) = ScaleSpeed(pan, caps.pan_speed);
+  std::tie(rel.tilt_rel, rel.tilt_speed) = ScaleSpeed(tilt, caps.tilt_speed);
+  Pending& pending = Collect();
+  pending.pantilt_rel = rel;
+  pending.pantilt_abs.reset();
+  Schedule();
+}
+
+void MotionController::MoveZoom(float speed) {
+  if (!Acquire()) return;
+  zoom_driver_ = ClientScope::current().key();
+  const Capabilities& caps = camera_.capabilities();
+  if (!caps.digital_zoom.has_value() || !caps.zoom_abs.has_value()) {
+    DriveOpticalZoom(speed);
+    return;
+  }
+  zoom_speed_ = std::isnan(speed) ? 0 : std::clamp(speed, -1.0f, 1.0f);
+  zoom_client_ = ClientScope::current();
+  ZoomTick();
+  if (zoom_speed_ == 0) {
+    StopZoomDrive();
+  } else if (zoom_timer_ == 0) {
+    zoom_timer_ = loop_.AddPeriodic(tick_, [this] {
+      ClientScope scope(zoom_client_);
+      if (Acquire()) {
+        ZoomTick();
+      } else {
+        StopZoomDrive();
+      }
+    });
+  }
+}
+
+void MotionController::ZoomTick() {
+  const Capabilities& caps = camera_.capabilities();
+  const Range& optical = *caps.zoom_abs;
+  const Range& digital = *caps.digital_zoom;
+  const int32_t current = DigitalZoom();
+  const auto optical_zoom = [&] {
+    return camera_.state()[Control::kZoomAbs].value_or(optical.min);
+  };
+  if (zoom_speed_ > 0 && optical_zoom() < optical.max &&
+      optical_zoom() >= optical.max - kHandoverWindow * (int64_t{optical.max} -
+                                                         optical.min)) {
+    camera_.RefreshZoom();
+  }
+  const bool at_optical_max = optical_zoom() >= optical.max;
+  if (zoom_speed_ == 0 || (zoom_speed_ > 0 && !at_optical_max) ||
+      (zoom_speed_ < 0 && current <= digital.min)) {
+    DriveOpticalZoom(zoom_speed_);
+    return;
+  }
+  DriveOpticalZoom(0);
+  const int32_t step = std::max<int32_t>(
+      1, std::lround(std::abs(zoom_speed_) * (digital.max - digital.min) *
+                     (tick_ / kDigitalZoomTraverse)));
+  const int32_t next =
+      digital.Clamp(current + (zoom_speed_ > 0 ? step : -step));
+  if (next != current) SetDigitalZoom(next);
+}
+
+void MotionController::StopZoomDrive() {
+  zoom_speed_ = 0;
+  loop_.CancelTimer(zoom_timer_);
+  zoom_timer_ = 0;
+}
+
+int32_t MotionController::DigitalZoom() const {
+  if (auto it = queues_.find(ClientScope::current().key());
+      it != queues_.end() && it->second.pending.digital_zoom.has_value()) {
+    return *it->second.pending.digital_zoom;
+  }
+  return camera_.state()[Control::kDigitalZoom].value_or(
+      camera_.capabilities().digital_zoom->min);
+}
+
+void MotionController::DriveOpticalZoom(float speed) {
+  ZoomRel rel = {};
+  std::tie(rel.zoom_rel, rel.speed) =
+      ScaleSpeed(speed, camera_.capabilities().zoom_speed);
+  // Repeating what the device is doing, e.g. on every zoom tick, would cost
+  // the client its share of the ticks for no transfer.
+  if (Same(rel, zoom_rel_) &&
+      std::none_of(queues_.begin(), queues_.end(), [](const auto& entry) {
+        const Pending& pending = entry.second.pending;
+        return pending.zoom_rel.has_value() || pending.zoom_abs.has_value();
+      })) {
+    return;
+  }
+  Pending& pending = Collect();
+  pending.zoom_rel = rel;
+  pending.zoom_abs.reset();
+  Schedule();
+}
+
+void MotionController::MoveFocus(float speed) {
+  if (!Acquire()) return;
+  focus_driver_ = ClientScope::current().key();
+  FocusRel rel;
+  std::tie(rel.focus_rel, rel.speed) =
+      ScaleSpeed(speed, camera_.capabilities().focus_speed);
+  Pending& pending = Collect();
+  pending.focus_rel = rel;
+  pending.focus_abs.reset();
+  Schedule();
+}
+
+void MotionController::SetPanTiltAbs(int32_t pan, int32_t tilt) {
+  if (!Acquire()) return;
+  const Capabilities& caps = camera_.capabilities();
+  if (!caps.pan.has_value() || !caps.tilt.has_value()) return;
+  Pending& pending = Collect();
+  pending.pantilt_abs = PanTiltAbs{caps.pan->Clamp(pan),
+                                   caps.tilt->Clamp(tilt)};
+  pending.pantilt_rel.reset();
+  Schedule();
+}
+
+void MotionController::SetZoomAbs(int32_t value) {
+  if (!Acquire()) return;
+  const std::optional<Range>& range = camera_.capabilities().zoom_abs;
+  if (!range.has_value()) return;
+  StopZoomDrive();
+  Pending& pending = Collect();
+  pending.zoom_abs = range->Clamp(value);
+  pending.zoom_rel.reset();
+  Schedule();
+}
+
+void MotionController::SetDigitalZoom(int32_t value) {
+  if (!Acquire()) return;
+  const std::optional<Range>& range = camera_.capabilities().digital_zoom;
+  if (!range.has_value()) return;
+  Collect().digital_zoom = range->Clamp(value);
+  Schedule();
+}
+
+void MotionController::SetZoomAxis(int32_t position) {
+  if (!Acquire()) return;
+  const Capabilities& caps = camera_.capabilities();
+  if (!caps.zoom_axis.has_value()) return;
+  position = caps.zoom_axis->Clamp(position);
+  const int32_t handover = caps.zoom_abs->max;
+  const int32_t optical = std::min(position, handover);
+  StopZoomDrive();
+  Pending& pending = Collect();
+  pending.zoom_rel.reset();
+  if (camera_.state()[Control::kZoomAbs] != optical ||
+      !Same(ZoomRel{}, zoom_rel_) || pending.zoom_abs.has_value()) {
+    SetZoomAbs(optical);
+  }
+  if (caps.digital_zoom.has_value()) {
+    const int32_t digital =
+        caps.digital_zoom->min + std::max(0, position - handover);
+    if (DigitalZoom() != digital) SetDigitalZoom(digital);
+  }
+}
+
+void MotionController::SetFocusAbs(int32_t value) {
+  if (!Acquire()) return;
+  const std::optional<Range>& range = camera_.capabilities().focus_abs;
+  if (!range.has_value()) return;
+  Pending& pending = Collect();
+  pending.focus_abs = range->Clamp(value);
+  pending.focus_rel.reset();
+  Schedule();
+}
+
+void MotionController::SetFocusAuto(bool enabled) {
+  if (!Acquire()) return;
+  Collect().focus_auto = enabled;
+  Schedule();
+}
+
+void MotionController::SetExtension(int index, std::string data) {
+  if (!Acquire()) return;
+  Collect().extensions[index] = std::move(data);
+  Schedule();
+}
+
+void MotionController::Recall(const CameraState& state) {
+  if (!Acquire()) return;
+  if (state[Control::kPan].has_value() && state[Control::kTilt].has_value()) {
+    SetPanTiltAbs(*state[Control::kPan], *state[Control::kTilt]);
+  }
+  if (state[Control::kZoomAbs].has_value()) {
+    SetZoomAbs(*state[Control::kZoomAbs]);
+  }
+  if (state[Control::kDigitalZoom].has_value()) {
+    SetDigitalZoom(*state[Control::kDigitalZoom]);
+  }
+  if (state[Control::kFocusAuto].value_or(0)) {
+    SetFocusAuto(true);
+  } else if (state[Control::kFocusAbs].has_value()) {
+    if (state[Control::kFocusAuto].has_value()) SetFocusAuto(false);
+    SetFocusAbs(*state[Control::kFocusAbs]);
+  }
+}
+
+void MotionController::Stop() {
+  // Nothing moves before the probe, which owns the device meanwhile.
+  if (!camera_.ready()) return;
+  StopZoomDrive();
+  pantilt_driver_.clear();
+  zoom_driver_.clear();
+  focus_driver_.clear();
+  for (auto& [key, queue] : queues_) {
+    queue.pending.pantilt_rel.reset();
+    queue.pending.zoom_rel.reset();
+    queue.pending.focus_rel.reset();
+    queue.pending.pantilt_abs.reset();
+    queue.pending.zoom_abs.reset();
+    queue.pending.digital_zoom.reset();
+    queue.pending.focus_abs.reset();
+  }
+  // Doesn't wait for any client's turn, the others' remaining requests do.
+  Pending stop;
+  stop.pantilt_rel = PanTiltRel{};
+  stop.zoom_rel = ZoomRel{};
+  stop.focus_rel = FocusRel{};
+  Write(stop);
+}
+
+void MotionController::StopClient() {
+  if (!camera_.ready()) return;
+  const std::string key = ClientScope::current().key();
+  if (auto it = queues_.find(key); it != queues_.end()) {
+    it->second.pending.pantilt_rel.reset();
+    it->second.pending.zoom_rel.reset();
+    it->second.pending.digital_zoom.reset();
+    it->second.pending.focus_rel.reset();
+  }
+  Pending stop;
+  if (pantilt_driver_ == key) {
+    pantilt_driver_.clear();
+    stop.pantilt_rel = PanTiltRel{};
+  }
+  if (zoom_driver_ == key) {
+    zoom_driver_.clear();
+    StopZoomDrive();
+    stop.zoom_rel = ZoomRel{};
+  }
+  if (focus_driver_ == key) {
+    focus_driver_.clear();
+    stop.focus_rel = FocusRel{};
+  }
+  if (stop.Transfers() > 0) Write(stop);
+}
+
+bool MotionController::LockedOut() const {
+  return locking() && !owner_.empty() &&
+         owner_ != ClientScope::current().key() &&
+         absl::Now() - owner_active_ < lock_timeout_;
+}
+
+void MotionController::TakeOver() {
+  owner_ = ClientScope::current().key();
+  owner_active_ = absl::Now();
+  Stop();
+}
+
+std::string MotionController::LockToJson() const {
+  const absl::Duration idle = absl::Now() - owner_active_;
+  const bool held = !owner_.empty() && idle < lock_timeout_;
+  return absl::StrCat(
+      "{\"owner\":", held ? JsonString(owner_) : "null",
+      ",\"idle_ms\":", held ? absl::ToInt64Milliseconds(idle) : 0,
+      ",\"rejected\":", locked_out_, "}");
+}
+
+bool MotionController::Acquire() {
+  if (!camera_.ready()) return false;
+  if (!locking()) return true;
+  if (LockedOut()) {
+    ++locked_out_;
+    return false;
+  }
+  owner_ = ClientScope::current().key();
+  owner_active_ = absl::Now();
+  return true;
+}
+
+bool MotionController::Congested() const {
+  if (camera_.backend().congested()) return true;
+  auto it = queues_.find(ClientScope::current().key());
+  return it != queues_.end() && it->second.active &&
+         absl::Now() - it->second.since > kMaxBacklog * tick_;
+}
+
+MotionController::Pending& MotionController::Collect() {
+  if (Congested()) ClientScope::MarkCongested();
+  const ClientId& client = ClientScope::current();
+  std::string key = client.key();
+  auto [it, inserted] = queues_.try_emplace(key);
+  Queue& queue = it->second;
+  if (inserted && client_classes_ != nullptr) {
+    queue.client_class = client_classes_->Of(client);
+  }
+  if (!queue.active) {
+    queue.active = true;
+    queue.since = absl::Now();
+    // Requests of the client whose turn it is continue its turn.
+    if (key == turn_) {
+      active_.push_front(std::move(key));
+    } else {
+      active_.push_back(std::move(key));
+    }
+  }
+  return queue.pending;
+}
+
+void MotionController::Release() {
+  if (--hold_ == 0 && held_requests_) {
+    held_requests_ = false;
+    Schedule();
+  }
+}
+
+void MotionController::Schedule() {
+  if (hold_ > 0) {
+    held_requests_ = true;
+    return;
+  }
+  if (timer_ != 0) return;
+  const absl::Time now = absl::Now();
+  absl::Time start = std::max(now, last_flush_ + tick_);
+  if (usb_scheduler_ != nullptr) start = usb_scheduler_->Reserve(bus_, start);
+  if (start <= now) {
+    Flush();
+    return;
+  }
+  timer_ = loop_.AddTimer(start - now, [this] {
+    timer_ = 0;
+    Flush();
+  });
+}
+
+void MotionController::Flush() {
+  while (!active_.empty()) {
+    const std::string key = active_.front();
+    active_.pop_front();
+    Queue& queue = queues_[key];
+    const int cost = queue.pending.Transfers();
+    if (cost == 0) {
+      // Nothing left, e.g. after a stop.
+      queue.active = false;
+      if (key != turn_) queues_.erase(key);
+      continue;
+    }
+    if (key != turn_) {
+      // An idle client's leftover deficit ends with its turn, and so does its
+      // queue, so that those of clients that went away don't pile up.
+      if (auto it = queues_.find(turn_);
+          it != queues_.end() && !it->second.active) {
+        queues_.erase(it);
+      }
+      turn_ = key;
+      queue.deficit += ClientWeight(queue.client_class);
+    }
+    if (queue.deficit < cost) {
+      // Saves up for the batch while the others take their turns.
+      turn_.clear();
+      active_.push_back(key);
+      continue;
+    }
+    queue.deficit -= cost;
+    queue.active = false;
+    Write(std::exchange(queue.pending, Pending{}));
+    break;
+  }
+  if (!active_.empty()) Schedule();
+}
+
+void MotionController::Write(const Pending& pending) {
+  last_flush_ = absl::Now();
+  Backend& backend = camera_.backend();
+  // Drives the backend's queue dropped never reached the camera, and a reset
+  // stops the camera, so newer drives must not be skipped as redundant.
+  const CommandQueueStats* stats = backend.queue_stats();
+  const uint64_t dropped =
+      stats != nullptr ? stats->dropped[static_cast<int>(CommandClass::kMotion)]
+                       : 0;
+  if (dropped != dropped_drives_ || backend.recoveries() != recoveries_) {
+    dropped_drives_ = dropped;
+    recoveries_ = backend.recoveries();
+    pantilt_rel_.reset();
+    zoom_rel_.reset();
+    focus_rel_.reset();
+  }
+  backend.BeginBatch();
+
+  if (pending.pantilt_rel.has_value() &&
+      !Same(*pending.pantilt_rel, pantilt_rel_)) {
+    const absl::Status status = backend.SetPanTiltRel(*pending.pantilt_rel);
+    Log(status);
+    if (status.ok()) pantilt_rel_ = *pending.pantilt_rel;
+  }
+  if (pending.pantilt_abs.has_value()) {
+    const absl::Status status = backend.SetPanTiltAbs(*pending.pantilt_abs);
+    Log(status);
+    if (status.ok()) {
+      pantilt_rel_ = PanTiltRel{};
+      camera_.Update(Control::kPan, pending.pantilt_abs->pan);
+      camera_.Update(Control::kTilt, pending.pantilt_abs->tilt);
+    }
+  }
+  if (pending.zoom_rel.has_value() && !Same(*pending.zoom_rel, zoom_rel_)) {
+    const absl::Status status = backend.SetZoomRel(*pending.zoom_rel);
+    Log(status);
+    if (status.ok()) zoom_rel_ = *pending.zoom_rel;
+  }
+  if (pending.zoom_abs.has_value()) {
+    const absl::Status status = backend.SetZoomAbs(*pending.zoom_abs);
+    Log(status);
+    if (status.ok()) {
+      zoom_rel_ = ZoomRel{};
+      camera_.Update(Control::kZoomAbs, *pending.zoom_abs);
+    }
+  }
+  if (pending.digital_zoom.has_value()) {
+    const absl::Status status = backend.SetDigitalZoom(*pending.digital_zoom);
+    Log(status);
+    if (status.ok()) {
+      camera_.Update(Control::kDigitalZoom, *pending.digital_zoom);
+    }
+  }
+  if (pending.focus_rel.has_value() &&
+      !Same(*pending.focus_rel, focus_rel_)) {
+    const absl::Status status = backend.SetFocusRel(*pending.focus_rel);
+    Log(status);
+    if (status.ok()) focus_rel_ = *pending.focus_rel;
+  }
+  if (pending.focus_abs.has_value()) {
+    const absl::Status status = backend.SetFocusAbs(*pending.focus_abs);
+    Log(status);
+    if (status.ok()) {
+      focus_rel_ = FocusRel{};
+      camera_.Update(Control::kFocusAbs, *pending.focus_abs);
+    }
+  }
+  if (pending.focus_auto.has_value()) {
+    const absl::Status status = backend.SetFocusAuto(*pending.focus_auto);
+    Log(status);
+    if (status.ok()) camera_.Update(Control::kFocusAuto, *pending.focus_auto);
+  }
+  for (const auto& [index, data] : pending.extensions) {
+    Log(backend.SetExtension(index, data));
+  }
+  // A failed batch leaves stale values in the shadow state until the next
+  // refresh.
+  Log(backend.EndBatch());
+  if (usb_scheduler_ != nullptr) {
+    usb_scheduler_->Record(bus_, absl::Now() - last_flush_);
+  }
+}
+
+void MotionController::Log(const absl::Status& status) {
+  if (!status.ok()) {
+    std::cerr << "Camera " << camera_.id() << ": " << status << "\n";
+  }
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,205 @@
+#ifndef VISCA2UVC_MOTION_H_
+#define VISCA2UVC_MOTION_H_
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+
+#include "absl/time/time.h"
+#include "camera.h"
+#include "client.h"
+#include "event_loop.h"
+#include "usb_topology.h"
+#include "uvc.h"
+
+namespace visca2uvc {
+
+// Turns control requests from all the protocol frontends into USB transfers
+// for one camera.
+//
+// Requests are coalesced per axis, the latest one wins, and flushed at most
+// once per `tick`, so a joystick at any rate costs a bounded number of
+// transfers. Requests that don't change what was last sent cost none. Stop
+// bypasses the tick.
+//
+// Clients, see ClientScope, have their own pending requests, and each flush
+// writes one client's batch. Whose is decided by deficit round-robin
+// weighted by ClientWeight: a client's turn lasts while the transfers of its
+// batches fit into its weight, so an operator's joystick gets most of the
+// ticks while a script floods the camera, and no client is starved.
+//
+// Flushes of cameras sharing a USB bus are spread out by the UsbScheduler,
+// if set.
+//
+// Speeds are normalized to [-1, 1] and scaled to the camera's maximum speed.
+//
+// With digital zoom, zoom is one axis: driving tele past the optical maximum
+// continues digitally and driving wide unwinds digital zoom first, stepping
+// the multiplier once per tick.
+class MotionController {
+ public:
+  MotionController(EventLoop& loop, Camera& camera, absl::Duration tick)
+      : loop_(loop), camera_(camera), tick_(tick) {}
+  ~MotionController();
+
+  Camera& camera() { return camera_; }
+
+  // Unset, all clients are operators. `classes` outlives the controller.
+  void set_client_classes(const ClientClasses* classes) {
+    client_classes_ = classes;
+  }
+
+  // With a `timeout`, a client's motion requests lock the camera for it
+  // until it was idle for `timeout`, and other clients' motion requests are
+  // ignored meanwhile. Stop is open to all. No lock when zero.
+  void set_lock_timeout(absl::Duration timeout) { lock_timeout_ = timeout; }
+
+  // Paces flushes with the other cameras on USB bus `bus`.
+  void set_usb_scheduler(UsbScheduler* scheduler, int bus) {
+    usb_scheduler_ = scheduler;
+    bus_ = bus;
+  }
+
+  void MovePanTilt(float pan, float tilt);
+  void MoveZoom(float speed);
+  void MoveFocus(float speed);
+  void SetPanTiltAbs(int32_t pan, int32_t tilt);
+  void SetZoomAbs(int32_t value);
+  void SetDigitalZoom(int32_t value);
+  // Moves to `position` on Capabilities::zoom_axis, writing only the parts
+  // that change.
+  void SetZoomAxis(int32_t position);
+  void SetFocusAbs(int32_t value);
+  void SetFocusAuto(bool enabled);
+  // Writes extension control `index` of the device profile.
+  void SetExtension(int index, std::string data);
+
+  // Moves to the absolute positions known in `state`.
+  void Recall(const CameraState& state);
+
+  // Stops pan, tilt, zoom and focus motion right away, including the motion
+  // other clients requested.
+  void Stop();
+  // Stops the drives whose latest request came from the client in scope,
+  // for clients that go away. Other clients' motion goes on.
+  void StopClient();
+
+  // Whether requests of the client in scope back up: the device's queue is
+  // full, or the client's batch has waited for more than kMaxBacklog ticks.
+  // Requests are still collected, the latest winning, but frontends should
+  // push back on the client, see ClientScope::congested. Stops always go
+  // through.
+  bool Congested() const;
+
+  bool locking() const { return lock_timeout_ > absl::ZeroDuration(); }
+  // Whether motion requests of the client in scope are ignored because
+  // another client holds the lock.
+  bool LockedOut() const;
+  // Takes or renews the lock for the client in scope, false if it's locked
+  // out, which counts as a refused request, or the camera isn't ready yet.
+  // Motion requests do this on their own, frontends that tell the client
+  // call it first.
+  bool Acquire();
+  // Gives the lock to the client in scope and stops the camera.
+  void TakeOver();
+  // {"owner":"<client>"|null,"idle_ms":n,"rejected":n}
+  std::string LockToJson() const;
+
+  // While held, requests are only collected, so that a batch of them is
+  // flushed together on release.
+  void Hold() { ++hold_; }
+  void Release();
+
+ private:
+  struct Pending {
+    std::optional<PanTiltRel> pantilt_rel;
+    std::optional<PanTiltAbs> pantilt_abs;
+    std::optional<ZoomRel> zoom_rel;
+    std::optional<int32_t> zoom_abs;
+    std::optional<int32_t> digital_zoom;
+    std::optional<FocusRel> focus_rel;
+    std::optional<int32_t> focus_abs;
+    std::optional<bool> focus_auto;
+    // Extension control index to value, the latest write wins.
+    std::map<int, std::string> extensions;
+
+    // Upper bound of the transfers writing this makes.
+    int Transfers() const;
+  };
+
+  // One client's requests and its share in the round-robin.
+  struct Queue {
+    ClientClass client_class = ClientClass::kOperator;
+    Pending pending;
+    // Transfers the client may still make.
+    int deficit = 0;
+    // Whether it's in `active_`, and since when.
+    bool active = false;
+    absl::Time since;
+  };
+
+  // The pending requests of the client in scope.
+  Pending& Collect();
+  // Flushes right away if a tick has passed since the last flush, otherwise
+  // arms the tick timer.
+  void Schedule();
+  // Writes the batch of the client whose turn it is.
+  void Flush();
+  void Write(const Pending& pending);
+  void DriveOpticalZoom(float speed);
+  // Hands the zoom drive over between optical and digital zoom.
+  void ZoomTick();
+  void StopZoomDrive();
+  // The digital zoom value about to be written or last known.
+  int32_t DigitalZoom() const;
+  void Log(const absl::Status& status);
+
+  EventLoop& loop_;
+  Camera& camera_;
+  const absl::Duration tick_;
+  UsbScheduler* usb_scheduler_ = nullptr;
+  int bus_ = 0;
+  const ClientClasses* client_classes_ = nullptr;
+  // By ClientId::key, a std::map so that Collect's references stay valid.
+  // Flush drops the queues of idle clients.
+  std::map<std::string, Queue> queues_;
+  // Keys of the clients with pending requests, in round-robin order.
+  std::deque<std::string> active_;
+  // The client whose turn it is, empty between turns.
+  std::string turn_;
+  EventLoop::TimerId timer_ = 0;
+  // Zoom drive speed while digital zoom is available, ticking `zoom_timer_`.
+  float zoom_speed_ = 0;
+  // Who drives the zoom, the ticks are its requests.
+  ClientId zoom_client_;
+  EventLoop::TimerId zoom_timer_ = 0;
+  // ClientId::key of who requested each drive last, empty after a stop.
+  std::string pantilt_driver_;
+  std::string zoom_driver_;
+  std::string focus_driver_;
+  absl::Time last_flush_ = absl::InfinitePast();
+  int hold_ = 0;
+  bool held_requests_ = false;
+  absl::Duration lock_timeout_ = absl::ZeroDuration();
+  // ClientId::key of the lock's owner, empty if none, and the time of its
+  // last motion request.
+  std::string owner_;
+  absl::Time owner_active_;
+  // Motion requests refused because of the lock, counted by Acquire.
+  uint64_t locked_out_ = 0;
+  // What the device is doing, to skip redundant transfers. Empty when
+  // unknown.
+  std::optional<PanTiltRel> pantilt_rel_ = PanTiltRel{};
+  std::optional<ZoomRel> zoom_rel_ = ZoomRel{};
+  std::optional<FocusRel> focus_rel_ = FocusRel{};
+  // The backend queue's count of dropped drives and the backend's count of
+  // recoveries at the last flush.
+  uint64_t dropped_drives_ = 0;
+  uint64_t recoveries_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_MOTION_H_
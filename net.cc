@@ -0,0 +1,109 @@
+#include "net.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+
+namespace visca2uvc {
+
+absl::StatusOr<sockaddr_in> ParseIpv4(absl::string_view host, uint16_t port) {
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, std::string(host).c_str(), &addr.sin_addr) != 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Not an IPv4 address: ", host));
+  }
+  return addr;
+}
+
+std::string FormatIpv4(const sockaddr_in& address) {
+  char host[INET_ADDRSTRLEN] = {};
+  inet_ntop(AF_INET, &address.sin_addr, host, sizeof(host));
+  return host;
+}
+
+absl::StatusOr<Fd> ListenTcp(uint16_t port) {
+  Fd fd(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  RETURN_IF_ERRNO(fd.get());
+  const int one = 1;
+  RETURN_IF_ERRNO(
+      setsockopt(fd.get(), SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  RETURN_IF_ERRNO(
+      bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)));
+  RETURN_IF_ERRNO(listen(fd.get(), SOMAXCONN));
+  return fd;
+}
+
+absl::StatusOr<Fd> ListenUnix(const std::string& path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Socket path too long: ", path));
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  Fd fd(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  RETURN_IF_ERRNO(fd.get());
+  unlink(path.c_str());
+  RETURN_IF_ERRNO(
+      bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)));
+  RETURN_IF_ERRNO(listen(fd.get(), SOMAXCONN));
+  return fd;
+}
+
+absl::Status SendFds(int socket, absl::Span<const int> fds) {
+  constexpr int kMaxFds = 4;
+  if (fds.size() > kMaxFds) return absl::InvalidArgumentError("Too many fds");
+  char byte = 0;
+  iovec iov = {&byte, 1};
+  union {
+    char buf[CMSG_SPACE(kMaxFds * sizeof(int))];
+    cmsghdr align;
+  } control = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(fds.size() * sizeof(int));
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(fds.size() * sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), fds.size() * sizeof(int));
+  RETURN_IF_ERRNO(sendmsg(socket, &msg, MSG_NOSIGNAL));
+  return absl::OkStatus();
+}
+
+absl::StatusOr<Fd> BindUdp(uint16_t port) {
+  Fd fd(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  RETURN_IF_ERRNO(fd.get());
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  RETURN_IF_ERRNO(
+      bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)));
+  return fd;
+}
+
+absl::StatusOr<Fd> MulticastSender(int ttl) {
+  Fd fd(socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  RETURN_IF_ERRNO(fd.get());
+  const unsigned char ttl_byte = ttl;
+  RETURN_IF_ERRNO(setsockopt(fd.get(), IPPROTO_IP, IP_MULTICAST_TTL,
+                             &ttl_byte, sizeof(ttl_byte)));
+  return fd;
+}
+
+}  // namespace visca2uvc
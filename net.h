@@ -0,0 +1,38 @@
+#ifndef VISCA2UVC_NET_H_
+#define VISCA2UVC_NET_H_
+
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+absl::StatusOr<sockaddr_in> ParseIpv4(absl::string_view host, uint16_t port);
+// The dotted host part of `address`.
+std::string FormatIpv4(const sockaddr_in& address);
+
+// Non-blocking TCP socket listening on all interfaces.
+absl::StatusOr<Fd> ListenTcp(uint16_t port);
+
+// Non-blocking Unix stream socket listening on `path`, replacing a stale
+// socket file.
+absl::StatusOr<Fd> ListenUnix(const std::string& path);
+
+// Sends `fds` over a Unix socket with a one byte message.
+absl::Status SendFds(int socket, absl::Span<const int> fds);
+
+// Non-blocking UDP socket bound to `port` on all interfaces.
+absl::StatusOr<Fd> BindUdp(uint16_t port);
+
+// Non-blocking UDP socket for sending to multicast groups.
+absl::StatusOr<Fd> MulticastSender(int ttl);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_NET_H_
@@ -0,0 +1,317 @@
+#include "osc_server.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "client.h"
+#include "net.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr size_t kMaxPacket = 65536;
+// Seconds between the NTP epoch (1900) and the Unix epoch.
+constexpr int64_t kNtpToUnix = 2208988800;
+// Bundles waiting for their time tag, further ones are dropped so that
+// clients can't pile up timers with far future time tags.
+constexpr size_t kMaxPendingBundles = 64;
+
+// Reads big-endian OSC data, failing softly at the end.
+class Reader {
+ public:
+  explicit Reader(absl::string_view data) : data_(data) {}
+
+  bool empty() const { return data_.empty(); }
+
+  bool U32(uint32_t& value) {
+    if (data_.size() < 4) return false;
+    const auto* p = reinterpret_cast<const uint8_t*>(data_.data());
+    value = uint32_t{p[0]} << 24 | uint32_t{p[1]} << 16 | uint32_t{p[2]} << 8 |
+            p[3];
+    data_.remove_prefix(4);
+    return true;
+  }
+  bool U64(uint64_t& value) {
+    uint32_t high, low;
+    if (!U32(high) || !U32(low)) return false;
+    value = uint64_t{high} << 32 | low;
+    return true;
+  }
+  // Null terminated, padded to a multiple of 4 bytes.
+  bool String(std::string& value) {
+    const size_t end = data_.find('\0');
+    if (end == absl::string_view::npos) return false;
+    value = std::string(data_.substr(0, end));
+    const size_t padded = (end + 4) & ~size_t{3};
+    if (padded > data_.size()) return false;
+    data_.remove_prefix(padded);
+    return true;
+  }
+  bool Bytes(size_t size, absl::string_view& value) {
+    if (size > data_.size()) return false;
+    value = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+ private:
+  absl::string_view data_;
+};
+
+bool ParseMessage(absl::string_view data, OscMessage& message) {
+  Reader reader(data);
+  std::string tags;
+  if (!reader.String(message.address)) return false;
+  // Old senders omit the type tags.
+  if (reader.empty()) return true;
+  if (!reader.String(tags) || tags.empty() || tags[0] != ',') return false;
+  for (const char tag : absl::string_view(tags).substr(1)) {
+    OscArgument argument;
+    argument.type = tag;
+    uint32_t u32;
+    uint64_t u64;
+    switch (tag) {
+      case 'i':
+        if (!reader.U32(u32)) return false;
+        argument.number = static_cast<int32_t>(u32);
+        break;
+      case 'h':
+        if (!reader.U64(u64)) return false;
+        argument.type = 'i';
+        argument.number = static_cast<int64_t>(u64);
+        break;
+      case 'f': {
+        if (!reader.U32(u32)) return false;
+        float value;
+        std::memcpy(&value, &u32, sizeof(value));
+        argument.number = value;
+        break;
+      }
+      case 'd': {
+        if (!reader.U64(u64)) return false;
+        double value;
+        std::memcpy(&value, &u64, sizeof(value));
+        argument.type = 'f';
+        argument.number = value;
+        break;
+      }
+      case 's':
+        if (!reader.String(argument.string)) return false;
+        break;
+      case 'T':
+      case 'F':
+        argument.number = tag == 'T';
+        break;
+      default:
+        // Unknown sizes, the rest can't be parsed.
+        return false;
+    }
+    message.arguments.push_back(std::move(argument));
+  }
+  return true;
+}
+
+absl::Time FromTimeTag(uint64_t tag) {
+  // 1 means "immediately".
+  if (tag <= 1) return absl::InfinitePast();
+  const int64_t seconds = static_cast<int64_t>(tag >> 32) - kNtpToUnix;
+  const double fraction = static_cast<double>(tag & 0xFFFFFFFF) / 4294967296.0;
+  return absl::FromUnixSeconds(seconds) + absl::Seconds(fraction);
+}
+
+bool IsNumber(const OscArgument& argument) {
+  return argument.type == 'i' || argument.type == 'f' ||
+         argument.type == 'T' || argument.type == 'F';
+}
+
+// 'h' and 'd' arguments may not fit, positions are clamped to their range
+// later anyway.
+int32_t ToInt32(double value) {
+  return static_cast<int32_t>(
+      std::clamp<double>(value, std::numeric_limits<int32_t>::min(),
+                         std::numeric_limits<int32_t>::max()));
+}
+
+// Speeds and tracking offsets, which are clamped to -1..1 later anyway.
+float ToUnit(double value) { return std::clamp(value, -1.0, 1.0); }
+
+// Maps a normalized value onto `range`: -1..1 when `symmetric`, else 0..1.
+int32_t Denormalize(double value, const Range& range, bool symmetric) {
+  if (symmetric) value = (value + 1) / 2;
+  value = std::min(1.0, std::max(0.0, value));
+  return range.min + static_cast<int32_t>(
+                         std::lround(value * (int64_t{range.max} - range.min)));
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<OscServer>> OscServer::Create(EventLoop& loop,
+                                                             uint16_t port,
+                                                             Bridge& bridge) {
+  absl::StatusOr<Fd> fd = BindUdp(port);
+  if (!fd.ok()) return fd.status();
+  std::unique_ptr<OscServer> server(
+      new OscServer(loop, port, *std::move(fd), bridge));
+  loop.WatchFd(server->fd_.get(), POLLIN,
+               [s = server.get()](short) { s->Receive(); });
+  return server;
+}
+
+OscServer::~OscServer() {
+  loop_.UnwatchFd(fd_.get());
+  for (const auto& [number, timer] : pending_bundles_) {
+    loop_.CancelTimer(timer);
+  }
+}
+
+void OscServer::Receive() {
+  char buffer[kMaxPacket];
+  while (true) {
+    sockaddr_in peer = {};
+    socklen_t peer_size = sizeof(peer);
+    const ssize_t n = recvfrom(fd_.get(), buffer, sizeof(buffer), 0,
+                               reinterpret_cast<sockaddr*>(&peer), &peer_size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN) {
+        std::cerr << "OSC: " << absl::ErrnoToStatus(errno, "recvfrom")
+                  << "\n";
+      }
+      return;
+    }
+    ClientScope scope({absl::StrCat("udp:", port_), FormatIpv4(peer),
+                       absl::StrCat(ntohs(peer.sin_port))});
+    HandlePacket(absl::string_view(buffer, n));
+  }
+}
+
+void OscServer::HandlePacket(absl::string_view packet) {
+  if (!absl::StartsWith(packet, absl::string_view("#bundle\0", 8))) {
+    OscMessage message;
+    if (ParseMessage(packet, message)) Apply({std::move(message)});
+    return;
+  }
+
+  Reader reader(packet.substr(8));
+  uint64_t tag;
+  if (!reader.U64(tag)) return;
+  std::vector<OscMessage> messages;
+  while (!reader.empty()) {
+    uint32_t size;
+    absl::string_view element;
+    if (!reader.U32(size) || !reader.Bytes(size, element)) return;
+    if (absl::StartsWith(element, "#bundle")) {
+      // Nested bundles carry their own time tag.
+      HandlePacket(element);
+      continue;
+    }
+    OscMessage message;
+    if (!ParseMessage(element, message)) return;
+    messages.push_back(std::move(message));
+  }
+
+  const absl::Duration delay = FromTimeTag(tag) - absl::Now();
+  if (delay <= absl::ZeroDuration()) {
+    Apply(messages);
+  } else if (pending_bundles_.size() >= kMaxPendingBundles) {
+    std::cerr << "OSC: Dropping a bundle of " << ClientScope::current().key()
+              << ", " << kMaxPendingBundles << " are pending\n";
+  } else {
+    const uint64_t number = next_bundle_++;
+    pending_bundles_[number] = loop_.AddTimer(
+        delay, [this, number, messages = std::move(messages),
+                client = ClientScope::current()] {
+          pending_bundles_.erase(number);
+          ClientScope scope(client);
+          Apply(messages);
+        });
+  }
+}
+
+void OscServer::Apply(const std::vector<OscMessage>& messages) {
+  BridgeBatch batch(bridge_);
+  for (const OscMessage& message : messages) Dispatch(message);
+}
+
+void OscServer::Dispatch(const OscMessage& message) {
+  std::vector<absl::string_view> path =
+      absl::StrSplit(message.address, '/', absl::SkipEmpty());
+  int id;
+  if (path.size() < 3 || path[0] != "cam" || !absl::SimpleAtoi(path[1], &id)) {
+    return;
+  }
+  MotionController* motion = bridge_.motion(id);
+  if (motion == nullptr) return;
+  const Capabilities& caps = motion->camera().capabilities();
+  const std::vector<OscArgument>& args = message.arguments;
+  for (const OscArgument& arg : args) {
+    if (!IsNumber(arg) || std::isnan(arg.number)) return;
+  }
+  const absl::string_view control = path[2];
+  const absl::string_view mode = path.size() > 3 ? path[3] : "";
+
+  if (control == "zoom" && mode.empty() && args.size() == 1) {
+    if (args[0].type == 'i') {
+      motion->SetZoomAbs(ToInt32(args[0].number));
+    } else if (caps.zoom_abs.has_value()) {
+      motion->SetZoomAbs(Denormalize(args[0].number, *caps.zoom_abs, false));
+    }
+  } else if (control == "zoom" && mode == "speed" && args.size() == 1) {
+    motion->MoveZoom(ToUnit(args[0].number));
+  } else if (control == "pantilt" && mode.empty() && args.size() == 2) {
+    if (args[0].type == 'i' && args[1].type == 'i') {
+      motion->SetPanTiltAbs(ToInt32(args[0].number),
+                            ToInt32(args[1].number));
+    } else if (caps.pan.has_value() && caps.tilt.has_value()) {
+      motion->SetPanTiltAbs(Denormalize(args[0].number, *caps.pan, true),
+                            Denormalize(args[1].number, *caps.tilt, true));
+    }
+  } else if (control == "pantilt" && mode == "speed" && args.size() == 2) {
+    motion->MovePanTilt(ToUnit(args[0].number), ToUnit(args[1].number));
+  } else if (control == "focus" && mode.empty() && args.size() == 1) {
+    if (args[0].type == 'i') {
+      motion->SetFocusAbs(ToInt32(args[0].number));
+    } else if (caps.focus_abs.has_value()) {
+      motion->SetFocusAbs(Denormalize(args[0].number, *caps.focus_abs, false));
+    }
+  } else if (control == "focus" && mode == "speed" && args.size() == 1) {
+    motion->MoveFocus(ToUnit(args[0].number));
+  } else if (control == "focus" && mode == "auto" && args.size() == 1) {
+    motion->SetFocusAuto(args[0].number != 0);
+  } else if (control == "track" && mode.empty() &&
+             (args.size() == 2 || args.size() == 3)) {
+    bridge_.tracker(id)->SetTarget(
+        ToUnit(args[0].number), ToUnit(args[1].number),
+        args.size() == 3 ? std::optional<float>(ToUnit(args[2].number))
+                         : std::nullopt);
+  } else if (control == "track" && mode == "stop" && args.empty()) {
+    bridge_.tracker(id)->Stop();
+  } else if (control == "stop" && args.empty()) {
+    bridge_.tracker(id)->Stop();
+    motion->Stop();
+  } else if (control == "preset" && args.size() == 1) {
+    const int number = ToInt32(args[0].number);
+    if (mode == "save") {
+      motion->camera().SavePreset(number);
+    } else if (mode == "recall") {
+      if (const CameraState* preset = motion->camera().preset(number)) {
+        motion->Recall(*preset);
+      }
+    }
+  }
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,77 @@
+#ifndef VISCA2UVC_OSC_SERVER_H_
+#define VISCA2UVC_OSC_SERVER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "bridge.h"
+#include "event_loop.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+struct OscArgument {
+  // OSC type tag, 'i', 'f', 's', 'T' or 'F'. 'h' and 'd' become 'i' and 'f'.
+  char type = 0;
+  double number = 0;
+  std::string string;
+};
+
+struct OscMessage {
+  std::string address;
+  std::vector<OscArgument> arguments;
+};
+
+// Open Sound Control over UDP for show control desks.
+//
+//   /cam/<id>/zoom            i raw position | f 0..1 of the range
+//   /cam/<id>/zoom/speed      f -1..1
+//   /cam/<id>/pantilt         i i raw position | f f -1..1 of the range
+//   /cam/<id>/pantilt/speed   f f -1..1
+//   /cam/<id>/focus           i raw position | f 0..1 of the range
+//   /cam/<id>/focus/speed     f -1..1
+//   /cam/<id>/focus/auto      i | T | F
+//   /cam/<id>/track           f f [f] x, y offset -1..1 [, size error]
+//   /cam/<id>/track/stop
+//   /cam/<id>/stop            also ends tracking
+//   /cam/<id>/preset/save     i
+//   /cam/<id>/preset/recall   i
+//
+// All messages of a bundle are applied together at the bundle's time tag, so
+// one bundle becomes one flush of USB transfers per camera. A limited number
+// of bundles may wait for their time tag, later ones are dropped.
+class OscServer {
+ public:
+  static absl::StatusOr<std::unique_ptr<OscServer>> Create(EventLoop& loop,
+                                                           uint16_t port,
+                                                           Bridge& bridge);
+  ~OscServer();
+
+ private:
+  OscServer(EventLoop& loop, uint16_t port, Fd fd, Bridge& bridge)
+      : loop_(loop), port_(port), fd_(std::move(fd)), bridge_(bridge) {}
+
+  void Receive();
+  // Parses a message or bundle and applies or schedules it.
+  void HandlePacket(absl::string_view packet);
+  void Apply(const std::vector<OscMessage>& messages);
+  void Dispatch(const OscMessage& message);
+
+  EventLoop& loop_;
+  const uint16_t port_;
+  Fd fd_;
+  Bridge& bridge_;
+  // Timers of the bundles waiting for their time tag, by bundle number.
+  absl::flat_hash_map<uint64_t, EventLoop::TimerId> pending_bundles_;
+  uint64_t next_bundle_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_OSC_SERVER_H_
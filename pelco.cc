@@ -0,0 +1,278 @@
+#include "pelco.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace visca2uvc {
+namespace {
+
+constexpr uint8_t kSyncD = 0xFF;
+constexpr uint8_t kSyncP = 0xA0;
+constexpr uint8_t kEndP = 0xAF;
+constexpr size_t kFrameD = 7;
+constexpr size_t kFrameP = 8;
+
+// Command 2 bits, in PELCO-D layout.
+constexpr uint8_t kExtended = 0x01;
+constexpr uint8_t kRight = 0x02;
+constexpr uint8_t kLeft = 0x04;
+constexpr uint8_t kUp = 0x08;
+constexpr uint8_t kDown = 0x10;
+constexpr uint8_t kZoomTele = 0x20;
+constexpr uint8_t kZoomWide = 0x40;
+constexpr uint8_t kFocusFar = 0x80;
+// Command 1 bits.
+constexpr uint8_t kFocusNear = 0x01;
+
+// Extended commands, in command 2 with data 1 and 2 as arguments.
+enum Extended : uint8_t {
+  kSetPreset = 0x03,
+  kClearPreset = 0x05,
+  kGotoPreset = 0x07,
+  kZoomSpeed = 0x25,
+  kFocusSpeed = 0x27,
+  kAutoFocus = 0x2B,
+  kSetPan = 0x4B,
+  kSetTilt = 0x4D,
+  kSetZoom = 0x4F,
+  kQueryPan = 0x51,
+  kQueryTilt = 0x53,
+  kQueryZoom = 0x55,
+  kPanResponse = 0x59,
+  kTiltResponse = 0x5B,
+  kZoomResponse = 0x5D,
+};
+
+// Positions are hundredths of a degree, UVC uses arc seconds.
+constexpr int kArcSecondsPerHundredth = 36;
+constexpr int kFullTurn = 36000;
+
+// Speed bytes are 0..3F, slowest to fastest, or FF for turbo.
+float Speed(uint8_t value) {
+  if (value == 0xFF) return 1;
+  return (std::min<int>(value, 0x3F) + 1) / 64.0f;
+}
+
+// 0..35999 onto -18000..17999.
+int Signed(int hundredths) {
+  hundredths %= kFullTurn;
+  return hundredths >= kFullTurn / 2 ? hundredths - kFullTurn : hundredths;
+}
+
+uint16_t Unsigned(int32_t arc_seconds) {
+  const int hundredths =
+      std::lround(arc_seconds / double{kArcSecondsPerHundredth}) % kFullTurn;
+  return hundredths < 0 ? hundredths + kFullTurn : hundredths;
+}
+
+}  // namespace
+
+PelcoSession::~PelcoSession() {
+  ClientScope scope(client_);
+  for (const int id : moving_) {
+    if (MotionController* motion = bridge_.motion(id)) motion->StopClient();
+  }
+}
+
+size_t PelcoSession::OnData(absl::string_view data) {
+  client_ = ClientScope::current();
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  size_t consumed = 0;
+  // Frames for one camera are applied together.
+  BridgeBatch batch(bridge_);
+  while (consumed < data.size()) {
+    const uint8_t* p = bytes + consumed;
+    const size_t left = data.size() - consumed;
+    if (p[0] == kSyncD) {
+      if (left < kFrameD) break;
+      const uint8_t sum = p[1] + p[2] + p[3] + p[4] + p[5];
+      if (sum == p[6]) {
+        Apply(p[1], /*pelco_d=*/true, p[2], p[3], p[4], p[5]);
+        consumed += kFrameD;
+        continue;
+      }
+    } else if (p[0] == kSyncP) {
+      if (left < kFrameP) break;
+      uint8_t check = 0;
+      for (size_t i = 0; i < kFrameP - 1; ++i) check ^= p[i];
+      if (p[6] == kEndP && check == p[7]) {
+        // Same as PELCO-D, except focus far is in data 1 next to near.
+        uint8_t command1 = p[2] & 0x02 ? kFocusNear : 0;
+        uint8_t command2 = p[3] & 0x7F;
+        if (!(command2 & kExtended) && (p[2] & 0x01)) command2 |= kFocusFar;
+        Apply(p[1] + 1, /*pelco_d=*/false, command1, command2, p[4], p[5]);
+        consumed += kFrameP;
+        continue;
+      }
+    }
+    // Not a valid frame start, resynchronize.
+    ++consumed;
+  }
+  return consumed;
+}
+
+void PelcoSession::Apply(int id, bool pelco_d, uint8_t command1,
+                         uint8_t command2, uint8_t data1, uint8_t data2) {
+  MotionController* motion = bridge_.motion(id);
+  if (motion == nullptr) return;
+  Camera& camera = motion->camera();
+  // PELCO has no replies, requests for a camera still being probed are lost.
+  if (!camera.ready()) return;
+  const Capabilities& caps = camera.capabilities();
+  const CameraState& state = camera.state();
+  Speeds& speeds = speeds_[id];
+
+  if (!(command2 & kExtended)) {
+    if (command1 == 0 && command2 == 0) {
+      // Idle joysticks repeat stops, which must not cut off other clients.
+      if (moving_.erase(id) > 0) motion->StopClient();
+      return;
+    }
+    const float pan = command2 & kRight  ? Speed(data1)
+                      : command2 & kLeft ? -Speed(data1)
+                                         : 0;
+    const float tilt = command2 & kUp     ? Speed(data2)
+                       : command2 & kDown ? -Speed(data2)
+                                          : 0;
+    const float zoom = command2 & kZoomTele   ? speeds.zoom
+                       : command2 & kZoomWide ? -speeds.zoom
+                                              : 0;
+    // UVC's positive focus direction is near.
+    const float focus = command1 & kFocusNear  ? speeds.focus
+                        : command2 & kFocusFar ? -speeds.focus
+                                               : 0;
+    motion->MovePanTilt(pan, tilt);
+    motion->MoveZoom(zoom);
+    motion->MoveFocus(focus);
+    moving_.insert(id);
+    return;
+  }
+
+  const uint16_t value = data1 << 8 | data2;
+  switch (command2) {
+    case kSetPreset:
+      camera.SavePreset(data2);
+      break;
+    case kClearPreset:
+      camera.ClearPreset(data2);
+      break;
+    case kGotoPreset:
+      if (const CameraState* preset = camera.preset(data2)) {
+        motion->Recall(*preset);
+      }
+      break;
+    case kZoomSpeed:
+      speeds.zoom = (std::min<int>(data2, 3) + 1) / 4.0f;
+      break;
+    case kFocusSpeed:
+      speeds.focus = (std::min<int>(data2, 3) + 1) / 4.0f;
+      break;
+    case kAutoFocus:
+      // 0 is auto, 1 is manual.
+      motion->SetFocusAuto(data2 == 0);
+      break;
+    case kSetPan:
+      if (state[Control::kTilt].has_value()) {
+        motion->SetPanTiltAbs(Signed(value) * kArcSecondsPerHundredth,
+                              *state[Control::kTilt]);
+      }
+      break;
+    case kSetTilt:
+      // Tilt angles grow downwards.
+      if (state[Control::kPan].has_value()) {
+        motion->SetPanTiltAbs(*state[Control::kPan],
+                              -Signed(value) * kArcSecondsPerHundredth);
+      }
+      break;
+    case kSetZoom:
+      // A fraction of the zoom range in 1/65535.
+      if (caps.zoom_abs.has_value()) {
+        motion->SetZoomAbs(
+            caps.zoom_abs->min +
+            static_cast<int32_t>((int64_t{caps.zoom_abs->max} -
+                                  caps.zoom_abs->min) *
+                                 value / 0xFFFF));
+      }
+      break;
+    case kQueryPan:
+      if (pelco_d && state[Control::kPan].has_value()) {
+        Respond(id, kPanResponse, Unsigned(*state[Control::kPan]));
+      }
+      break;
+    case kQueryTilt:
+      if (pelco_d && state[Control::kTilt].has_value()) {
+        Respond(id, kTiltResponse, Unsigned(-*state[Control::kTilt]));
+      }
+      break;
+    case kQueryZoom:
+      if (pelco_d && caps.zoom_abs.has_value() &&
+          state[Control::kZoomAbs].has_value() &&
+          caps.zoom_abs->max > caps.zoom_abs->min) {
+        const Range& range = *caps.zoom_abs;
+        Respond(id, kZoomResponse,
+                (int64_t{range.Clamp(*state[Control::kZoomAbs])} - range.min) *
+                    0xFFFF / (int64_t{range.max} - range.min));
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void PelcoSession::Respond(int address, uint8_t command, uint16_t value) {
+  std::string frame = {static_cast<char>(kSyncD), static_cast<char>(address),
+                       0, static_cast<char>(command),
+                       static_cast<char>(value >> 8), static_cast<char>(value)};
+  uint8_t sum = 0;
+  for (size_t i = 1; i < frame.size(); ++i) sum += frame[i];
+  frame.push_back(sum);
+  reply_(frame);
+}
+
+absl::StatusOr<std::unique_ptr<PelcoServer>> PelcoServer::Create(
+    EventLoop& loop, uint16_t port, Bridge& bridge) {
+  class Session : public TcpConnection::Handler {
+   public:
+    Session(Bridge& bridge, TcpConnection& connection)
+        : session_(bridge, [&connection](absl::string_view data) {
+            connection.Send(data);
+          }) {}
+
+    size_t OnData(absl::string_view data) override {
+      return session_.OnData(data);
+    }
+
+   private:
+    PelcoSession session_;
+  };
+
+  std::unique_ptr<PelcoServer> server(new PelcoServer());
+  absl::StatusOr<std::unique_ptr<TcpServer>> tcp_server = TcpServer::Create(
+      loop, port, [&bridge](TcpConnection& connection) {
+        return std::make_unique<Session>(bridge, connection);
+      });
+  if (!tcp_server.ok()) return tcp_server.status();
+  server->tcp_server_ = *std::move(tcp_server);
+  return server;
+}
+
+PelcoSerial::PelcoSerial(std::unique_ptr<SerialPort> port, Bridge& bridge)
+    : port_(std::move(port)),
+      session_(bridge, [p = port_.get()](absl::string_view data) {
+        p->Send(data);
+      }) {
+  port_->SetDataCallback(
+      [this](absl::string_view data) { return session_.OnData(data); });
+}
+
+absl::StatusOr<std::unique_ptr<PelcoSerial>> PelcoSerial::Create(
+    EventLoop& loop, const std::string& path, int baud, Bridge& bridge) {
+  absl::StatusOr<std::unique_ptr<SerialPort>> port =
+      SerialPort::Create(loop, path, baud);
+  if (!port.ok()) return port.status();
+  return std::unique_ptr<PelcoSerial>(
+      new PelcoSerial(*std::move(port), bridge));
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,92 @@
+#ifndef VISCA2UVC_PELCO_H_
+#define VISCA2UVC_PELCO_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "bridge.h"
+#include "client.h"
+#include "event_loop.h"
+#include "serial.h"
+#include "tcp_server.h"
+
+namespace visca2uvc {
+
+// Decodes PELCO-D and PELCO-P frames from one byte stream, told apart by
+// their sync byte, and applies them to the cameras. PELCO-D address N and
+// PELCO-P address N - 1 control camera N. Frames with a bad checksum are
+// skipped byte by byte until the stream is in sync again.
+//
+// Supported: pan/tilt with speed bytes 0..3F (FF is turbo), zoom and focus
+// near/far, set/clear/go to preset, zoom and focus speed, auto focus, pan,
+// tilt and zoom position set and query. A frame without any motion bits is a
+// stop, which bypasses the motion tick. The drives a stream started are
+// stopped when it closes, unless another client took them over.
+class PelcoSession {
+ public:
+  using Reply = std::function<void(absl::string_view)>;
+
+  PelcoSession(Bridge& bridge, Reply reply)
+      : bridge_(bridge), reply_(std::move(reply)) {}
+  ~PelcoSession();
+
+  // Returns how many bytes of `data` were consumed.
+  size_t OnData(absl::string_view data);
+
+ private:
+  // Per camera settings of this stream.
+  struct Speeds {
+    float zoom = 1;
+    float focus = 1;
+  };
+
+  void Apply(int id, bool pelco_d, uint8_t command1, uint8_t command2,
+             uint8_t data1, uint8_t data2);
+  // Answers a position query in PELCO-D framing.
+  void Respond(int address, uint8_t command, uint16_t value);
+
+  Bridge& bridge_;
+  const Reply reply_;
+  absl::flat_hash_map<int, Speeds> speeds_;
+  // Cameras this stream set in motion.
+  absl::flat_hash_set<int> moving_;
+  // Who sends the stream, for stopping its drives when it closes.
+  ClientId client_;
+};
+
+// Serves PELCO-D/P over TCP, e.g. from serial-to-IP converters.
+class PelcoServer {
+ public:
+  static absl::StatusOr<std::unique_ptr<PelcoServer>> Create(EventLoop& loop,
+                                                             uint16_t port,
+                                                             Bridge& bridge);
+
+ private:
+  PelcoServer() = default;
+
+  std::unique_ptr<TcpServer> tcp_server_;
+};
+
+// Reads PELCO-D/P from a serial line or pty.
+class PelcoSerial {
+ public:
+  static absl::StatusOr<std::unique_ptr<PelcoSerial>> Create(
+      EventLoop& loop, const std::string& path, int baud, Bridge& bridge);
+
+ private:
+  PelcoSerial(std::unique_ptr<SerialPort> port, Bridge& bridge);
+
+  std::unique_ptr<SerialPort> port_;
+  PelcoSession session_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_PELCO_H_
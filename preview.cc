@@ -0,0 +1,158 @@
+#include "preview.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <utility>
+
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/strip.h"
+#include "frame_image.h"
+
+namespace visca2uvc {
+namespace {
+
+// Panels that stopped asking for a preview stop costing a stream.
+constexpr absl::Duration kIdleTimeout = absl::Seconds(10);
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<PreviewServer>> PreviewServer::Create(
+    EventLoop& loop, const PreviewOptions& options, FrameServer& frames,
+    HttpServer& http_server) {
+  if (options.every < 1) {
+    return absl::InvalidArgumentError("Previews need every >= 1");
+  }
+  if (options.scale != 1 && options.scale != 2 && options.scale != 4 &&
+      options.scale != 8) {
+    return absl::InvalidArgumentError("Preview scale must be 1, 2, 4 or 8");
+  }
+  std::unique_ptr<PreviewServer> server(
+      new PreviewServer(loop, options, frames));
+  http_server.AddHandler("/previews/",
+                         [s = server.get()](const HttpRequest& request) {
+                           return s->Handle(request);
+                         });
+  return server;
+}
+
+PreviewServer::~PreviewServer() {
+  for (const auto& [camera, preview] : previews_) Detach(*preview);
+}
+
+HttpResponse PreviewServer::Handle(const HttpRequest& request) {
+  if (request.method != "GET") return HttpError(405, "Method not allowed");
+  absl::string_view name = request.path;
+  int camera;
+  if (!absl::ConsumePrefix(&name, "/previews/") ||
+      !absl::ConsumeSuffix(&name, ".jpg") ||
+      !absl::SimpleAtoi(name, &camera)) {
+    return HttpError(404, "Not found");
+  }
+  std::unique_ptr<Preview>& preview = previews_[camera];
+  if (preview == nullptr) {
+    FrameRing* ring = frames_.ring(camera);
+    if (ring == nullptr) {
+      previews_.erase(camera);
+      return HttpError(404, "No video of this camera");
+    }
+    preview = std::make_unique<Preview>();
+    preview->camera = camera;
+    preview->ring = ring;
+  }
+  preview->last_request = absl::Now();
+  if (!preview->event.valid()) {
+    if (absl::Status status = Attach(*preview); !status.ok()) {
+      std::cerr << "Preview of camera " << camera << ": " << status << "\n";
+      return HttpError(503, "Video unavailable");
+    }
+  }
+  if (preview->jpeg.empty()) {
+    HttpResponse response = HttpError(503, "Preview not ready");
+    response.headers.emplace_back("Retry-After", "1");
+    return response;
+  }
+
+  const std::string etag = absl::StrCat("\"", preview->number, "\"");
+  HttpResponse response;
+  response.headers.emplace_back("ETag", etag);
+  response.headers.emplace_back("Cache-Control", "no-cache");
+  auto it = request.headers.find("if-none-match");
+  if (it != request.headers.end() && it->second == etag) {
+    response.status = 304;
+    return response;
+  }
+  response.content_type = "image/jpeg";
+  response.body = preview->jpeg;
+  return response;
+}
+
+absl::Status PreviewServer::Attach(Preview& preview) {
+  preview.event.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  RETURN_IF_ERRNO(preview.event.get());
+  if (absl::Status status = preview.ring->AddConsumer(preview.event.get());
+      !status.ok()) {
+    preview.event.Reset();
+    return status;
+  }
+  // The first frame makes a thumbnail right away.
+  preview.frames = options_.every - 1;
+  loop_.WatchFd(preview.event.get(), POLLIN,
+                [this, p = &preview](short) { OnFrames(*p); });
+  return absl::OkStatus();
+}
+
+void PreviewServer::Detach(Preview& preview) {
+  if (!preview.event.valid()) return;
+  loop_.UnwatchFd(preview.event.get());
+  preview.ring->RemoveConsumer(preview.event.get());
+  preview.event.Reset();
+  // Stale by the time a panel comes back, which waits for a fresh one.
+  preview.jpeg.clear();
+}
+
+void PreviewServer::OnFrames(Preview& preview) {
+  uint64_t count;
+  if (read(preview.event.get(), &count, sizeof(count)) < 0) return;
+  if (absl::Now() - preview.last_request > kIdleTimeout) {
+    Detach(preview);
+    return;
+  }
+  preview.frames += count;
+  if (preview.frames < options_.every) return;
+  preview.frames = 0;
+  Update(preview);
+}
+
+void PreviewServer::Update(Preview& preview) {
+  const FrameRing& ring = *preview.ring;
+  const std::optional<FrameRing::Frame> frame = ring.Latest();
+  if (!frame.has_value() ||
+      (!preview.jpeg.empty() && frame->number == preview.number)) {
+    return;
+  }
+  Image image;
+  absl::Status status = Downscale(ring, *frame, options_.scale, image);
+  // The frame was read in place, a torn one is simply skipped.
+  if (!ring.Valid(*frame)) return;
+  absl::StatusOr<std::string> jpeg =
+      status.ok() ? EncodeJpeg(image, options_.quality)
+                  : absl::StatusOr<std::string>(status);
+  if (!jpeg.ok()) {
+    if (!preview.failing) {
+      std::cerr << "Preview of camera " << preview.camera << ": "
+                << jpeg.status() << "\n";
+    }
+    preview.failing = true;
+    return;
+  }
+  preview.failing = false;
+  preview.jpeg = *std::move(jpeg);
+  preview.number = frame->number;
+}
+
+}  // namespace visca2uvc
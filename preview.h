@@ -0,0 +1,75 @@
+#ifndef VISCA2UVC_PREVIEW_H_
+#define VISCA2UVC_PREVIEW_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "event_loop.h"
+#include "fd.h"
+#include "frame_ring.h"
+#include "http_server.h"
+
+namespace visca2uvc {
+
+struct PreviewOptions {
+  // A thumbnail is made of every this many frames.
+  int every = 15;
+  // The thumbnail is 1/scale of the frame size, 1, 2, 4 or 8.
+  int scale = 8;
+  int quality = 75;
+};
+
+// Small JPEG previews of the cameras' video for control surfaces:
+//
+//   GET /previews/<id>.jpg
+//
+// The latest thumbnail is made once and served to every panel. MJPEG frames
+// are decoded at a reduced DCT scale and YUYV frames are box filtered, so a
+// thumbnail costs a fraction of decoding a full frame. Responses carry an
+// ETag, so polling panels get 304 until a new thumbnail exists.
+//
+// A camera's preview reads the frame ring only while panels keep asking for
+// it, the first request answers 503 until the stream is up.
+class PreviewServer {
+ public:
+  static absl::StatusOr<std::unique_ptr<PreviewServer>> Create(
+      EventLoop& loop, const PreviewOptions& options, FrameServer& frames,
+      HttpServer& http_server);
+  ~PreviewServer();
+
+ private:
+  struct Preview {
+    int camera;
+    FrameRing* ring;
+    // Set while reading the ring.
+    Fd event;
+    int frames = 0;
+    absl::Time last_request;
+    std::string jpeg;
+    uint64_t number = 0;
+    bool failing = false;
+  };
+
+  PreviewServer(EventLoop& loop, const PreviewOptions& options,
+                FrameServer& frames)
+      : loop_(loop), options_(options), frames_(frames) {}
+
+  HttpResponse Handle(const HttpRequest& request);
+  absl::Status Attach(Preview& preview);
+  void Detach(Preview& preview);
+  void OnFrames(Preview& preview);
+  void Update(Preview& preview);
+
+  EventLoop& loop_;
+  const PreviewOptions options_;
+  FrameServer& frames_;
+  absl::flat_hash_map<int, std::unique_ptr<Preview>> previews_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_PREVIEW_H_
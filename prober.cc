@@ -0,0 +1,70 @@
+#include "prober.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+#include "absl/strings/str_format.h"
+
+namespace visca2uvc {
+
+absl::StatusOr<std::unique_ptr<Prober>> Prober::Create(
+    EventLoop& loop, std::vector<Camera*> cameras, int threads,
+    ReadyCallback on_ready) {
+  std::unique_ptr<Prober> prober(
+      new Prober(loop, std::move(cameras), std::move(on_ready)));
+  prober->event_.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  RETURN_IF_ERRNO(prober->event_.get());
+  loop.WatchFd(prober->event_.get(), POLLIN,
+               [p = prober.get()](short) { p->OnDone(); });
+  const int count =
+      std::min<int>(std::max(threads, 1), prober->cameras_.size());
+  for (int i = 0; i < count; ++i) {
+    prober->workers_.emplace_back([p = prober.get()] { p->Work(); });
+  }
+  return prober;
+}
+
+Prober::~Prober() {
+  for (std::thread& worker : workers_) worker.join();
+  if (event_.valid()) loop_.UnwatchFd(event_.get());
+}
+
+void Prober::Work() {
+  for (size_t i = next_++; i < cameras_.size(); i = next_++) {
+    Capabilities capabilities = cameras_[i]->backend().Probe();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_.push_back({cameras_[i], std::move(capabilities)});
+    }
+    const uint64_t one = 1;
+    if (write(event_.get(), &one, sizeof(one)) < 0) {
+      std::cerr << "Prober: " << absl::ErrnoToStatus(errno, "write") << "\n";
+    }
+  }
+}
+
+void Prober::OnDone() {
+  uint64_t count;
+  if (read(event_.get(), &count, sizeof(count)) < 0) return;
+  std::vector<Result> done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done.swap(done_);
+  }
+  for (Result& result : done) {
+    Camera& camera = *result.camera;
+    camera.SetCapabilities(std::move(result.capabilities));
+    camera.Refresh();
+    std::cerr << absl::StrFormat(
+        "Camera %d ready after %.1f ms\n", camera.id(),
+        absl::ToDoubleMilliseconds(absl::Now() - start_));
+    on_ready_(camera);
+  }
+}
+
+}  // namespace visca2uvc
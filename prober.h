@@ -0,0 +1,68 @@
+#ifndef VISCA2UVC_PROBER_H_
+#define VISCA2UVC_PROBER_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "camera.h"
+#include "event_loop.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+// Reads the ranges and controls of cameras whose probes block on the device,
+// on worker threads while the loop already serves the other cameras. Each
+// probe waits for a few dozen control transfers.
+//
+// The workers only call the backends' Probe, which must not touch the
+// cameras' state. The results are handed to the loop through an eventfd,
+// where the camera gets its capabilities, becomes ready and is refreshed.
+class Prober {
+ public:
+  // Called on the loop once `camera` is ready.
+  using ReadyCallback = std::function<void(Camera& camera)>;
+
+  // Starts probing `cameras` on up to `threads` threads. The cameras must
+  // outlive the prober.
+  static absl::StatusOr<std::unique_ptr<Prober>> Create(
+      EventLoop& loop, std::vector<Camera*> cameras, int threads,
+      ReadyCallback on_ready);
+  // Waits for the probes that are still running.
+  ~Prober();
+
+ private:
+  struct Result {
+    Camera* camera;
+    Capabilities capabilities;
+  };
+
+  Prober(EventLoop& loop, std::vector<Camera*> cameras,
+         ReadyCallback on_ready)
+      : loop_(loop),
+        cameras_(std::move(cameras)),
+        on_ready_(std::move(on_ready)) {}
+
+  void Work();
+  void OnDone();
+
+  EventLoop& loop_;
+  const std::vector<Camera*> cameras_;
+  const ReadyCallback on_ready_;
+  const absl::Time start_ = absl::Now();
+  Fd event_;
+  std::atomic<size_t> next_ = 0;
+  std::mutex mutex_;
+  std::vector<Result> done_;  // Guarded by mutex_.
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_PROBER_H_
@@ -0,0 +1,109 @@
+#include "profile.h"
+
+#include <fstream>
+#include <optional>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/str_split.h"
+
+namespace visca2uvc {
+namespace {
+
+std::optional<uint8_t> ParseHexByte(absl::string_view text) {
+  int value;
+  if (text.size() != 2 || !absl::SimpleHexAtoi(text, &value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+// "a29e7641-de04-47e3-8b2b-f4341aff003b" to descriptor byte order, where the
+// first three groups are little endian.
+std::optional<std::array<uint8_t, 16>> ParseGuid(absl::string_view text) {
+  const std::string hex = absl::StrReplaceAll(text, {{"-", ""}});
+  if (hex.size() != 32 || text.size() != 36) return std::nullopt;
+  std::array<uint8_t, 16> bytes;
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    std::optional<uint8_t> byte = ParseHexByte(hex.substr(2 * i, 2));
+    if (!byte.has_value()) return std::nullopt;
+    bytes[i] = *byte;
+  }
+  std::swap(bytes[0], bytes[3]);
+  std::swap(bytes[1], bytes[2]);
+  std::swap(bytes[4], bytes[5]);
+  std::swap(bytes[6], bytes[7]);
+  return bytes;
+}
+
+}  // namespace
+
+int DeviceProfile::FindExtension(absl::string_view name) const {
+  for (size_t i = 0; i < extensions.size(); ++i) {
+    if (extensions[i].name == name) return i;
+  }
+  return -1;
+}
+
+absl::StatusOr<DeviceProfile> LoadDeviceProfile(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    return absl::NotFoundError(absl::StrCat("Can't read profile: ", path));
+  }
+  DeviceProfile profile;
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    const absl::string_view content =
+        absl::StripAsciiWhitespace(absl::string_view(line).substr(
+            0, absl::string_view(line).find('#')));
+    if (content.empty()) continue;
+    const std::vector<absl::string_view> fields =
+        absl::StrSplit(content, ' ', absl::SkipEmpty());
+    if (fields[0] == "zoom_latency") {
+      double milliseconds;
+      if (fields.size() != 2 || !absl::SimpleAtod(fields[1], &milliseconds) ||
+          milliseconds < 0) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            path, ":", number, ": expected zoom_latency <milliseconds>"));
+      }
+      profile.zoom_latency = absl::Milliseconds(milliseconds);
+      continue;
+    }
+    const absl::Status invalid = absl::InvalidArgumentError(
+        absl::StrCat(path, ":", number, ": expected xu <name> <guid> ",
+                     "<selector> [visca <hex bytes>]"));
+
+    ExtensionControl control;
+    std::optional<std::array<uint8_t, 16>> guid;
+    int selector;
+    if (fields.size() < 4 || fields[0] != "xu" ||
+        !(guid = ParseGuid(fields[2])).has_value() ||
+        !absl::SimpleAtoi(fields[3], &selector) || selector < 1 ||
+        selector > 255) {
+      return invalid;
+    }
+    control.name = std::string(fields[1]);
+    control.guid = *guid;
+    control.selector = selector;
+    if (fields.size() > 4) {
+      if (fields[4] != "visca" || fields.size() == 5) return invalid;
+      for (size_t i = 5; i < fields.size(); ++i) {
+        std::optional<uint8_t> byte = ParseHexByte(fields[i]);
+        // Data bytes of a VISCA message are below 80h.
+        if (!byte.has_value() || *byte >= 0x80) return invalid;
+        control.visca.push_back(*byte);
+      }
+    }
+    if (profile.FindExtension(control.name) >= 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(path, ":", number, ": duplicate ", control.name));
+    }
+    profile.extensions.push_back(std::move(control));
+  }
+  return profile;
+}
+
+}  // namespace visca2uvc
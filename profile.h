@@ -0,0 +1,52 @@
+#ifndef VISCA2UVC_PROFILE_H_
+#define VISCA2UVC_PROFILE_H_
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace visca2uvc {
+
+// A vendor control in a UVC extension unit.
+struct ExtensionControl {
+  std::string name;
+  // The unit's guidExtensionCode in descriptor byte order.
+  std::array<uint8_t, 16> guid = {};
+  uint8_t selector = 0;
+  // VISCA command bytes after the 01 category byte that write the control,
+  // followed by its value as two nibbles per byte. The inquiry starts with
+  // 09 instead. Empty if the control isn't mapped.
+  std::string visca;
+};
+
+// What the daemon knows about the cameras beyond the UVC standard controls.
+struct DeviceProfile {
+  std::vector<ExtensionControl> extensions;
+  // Median time from a zoom command to visible motion, as measured by
+  // `visca2uvc measure_latency`.
+  std::optional<absl::Duration> zoom_latency;
+
+  // Index into `extensions`, -1 if there is no control `name`.
+  int FindExtension(absl::string_view name) const;
+};
+
+// Reads a profile with one control per line, e.g.
+//
+//   # xu <name> <guid> <selector> [visca <hex bytes>]
+//   xu ptz_speed a29e7641-de04-47e3-8b2b-f4341aff003b 2 visca 7e 01 0b
+//   # zoom_latency <milliseconds>
+//   zoom_latency 142
+//
+// GUIDs are written the way lsusb prints guidExtensionCode. The last
+// zoom_latency line wins, so measurements can be appended.
+absl::StatusOr<DeviceProfile> LoadDeviceProfile(const std::string& path);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_PROFILE_H_
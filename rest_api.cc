@@ -0,0 +1,271 @@
+#include "rest_api.h"
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "json.h"
+#include "state_message.h"
+
+namespace visca2uvc {
+namespace {
+
+using Args = absl::flat_hash_map<std::string, std::string>;
+
+constexpr absl::string_view kLockedOut = "Camera locked by another client";
+constexpr absl::string_view kNotReady = "Camera not ready";
+
+bool GetInt(const Args& args, absl::string_view key, int32_t& value) {
+  auto it = args.find(key);
+  return it != args.end() && absl::SimpleAtoi(it->second, &value);
+}
+
+bool GetFloat(const Args& args, absl::string_view key, float& value) {
+  auto it = args.find(key);
+  return it != args.end() && absl::SimpleAtof(it->second, &value);
+}
+
+bool GetBool(const Args& args, absl::string_view key, bool& value) {
+  auto it = args.find(key);
+  return it != args.end() && absl::SimpleAtob(it->second, &value);
+}
+
+// Only validates the change when `motion` is nullptr.
+absl::Status ApplyChange(MotionController* motion, absl::string_view control,
+                         const Args& args) {
+  int32_t a, b;
+  float x, y;
+  bool flag;
+  if (control == "zoom") {
+    if (GetInt(args, "abs", a)) {
+      if (motion) motion->SetZoomAbs(a);
+    } else if (GetFloat(args, "speed", x)) {
+      if (motion) motion->MoveZoom(x);
+    } else {
+      return absl::InvalidArgumentError("zoom needs abs or speed");
+    }
+  } else if (control == "pantilt") {
+    if (GetInt(args, "pan", a) && GetInt(args, "tilt", b)) {
+      if (motion) motion->SetPanTiltAbs(a, b);
+    } else if (GetFloat(args, "pan_speed", x) &&
+               GetFloat(args, "tilt_speed", y)) {
+      if (motion) motion->MovePanTilt(x, y);
+    } else {
+      return absl::InvalidArgumentError(
+          "pantilt needs pan and tilt or pan_speed and tilt_speed");
+    }
+  } else if (control == "focus") {
+    if (GetInt(args, "abs", a)) {
+      if (motion) motion->SetFocusAbs(a);
+    } else if (GetFloat(args, "speed", x)) {
+      if (motion) motion->MoveFocus(x);
+    } else if (GetBool(args, "auto", flag)) {
+      if (motion) motion->SetFocusAuto(flag);
+    } else {
+      return absl::InvalidArgumentError("focus needs abs, speed or auto");
+    }
+  } else if (control == "stop") {
+    if (motion) motion->Stop();
+  } else {
+    return absl::NotFoundError(absl::StrCat("Unknown control: ", control));
+  }
+  return absl::OkStatus();
+}
+
+std::string ValueJson(const std::optional<int32_t>& value) {
+  return value.has_value() ? absl::StrCat(*value) : "null";
+}
+
+std::string ControlJson(const Camera& camera, absl::string_view control) {
+  const CameraState& state = camera.state();
+  if (control == "zoom") {
+    return absl::StrCat("{\"value\":", ValueJson(state[Control::kZoomAbs]),
+                        "}");
+  }
+  if (control == "pantilt") {
+    return absl::StrCat("{\"pan\":", ValueJson(state[Control::kPan]),
+                        ",\"tilt\":", ValueJson(state[Control::kTilt]), "}");
+  }
+  if (control == "focus") {
+    return absl::StrCat("{\"value\":", ValueJson(state[Control::kFocusAbs]),
+                        ",\"auto\":", ValueJson(state[Control::kFocusAuto]),
+                        "}");
+  }
+  return "";
+}
+
+std::string CameraJson(const Camera& camera) {
+  std::vector<std::string> values;
+  for (const Control control : kAllControls) {
+    values.push_back(absl::StrCat("\"", ControlName(control),
+                                  "\":", ValueJson(camera.state()[control])));
+  }
+  return absl::StrCat("{\"id\":", camera.id(),
+                      ",\"ready\":", camera.ready() ? "true" : "false", ",",
+                      absl::StrJoin(values, ","), "}");
+}
+
+HttpResponse Ok(std::string body = "{}") {
+  HttpResponse response;
+  response.body = std::move(body);
+  return response;
+}
+
+HttpResponse Error(const absl::Status& status) {
+  return HttpError(absl::IsNotFound(status) ? 404 : 400, status.message());
+}
+
+HttpResponse HandleCameras(Bridge& bridge, const HttpRequest& request) {
+  std::vector<absl::string_view> path =
+      absl::StrSplit(request.path, '/', absl::SkipEmpty());
+  // path[0] is "cameras".
+  if (path.size() == 1) {
+    if (request.method != "GET") return HttpError(405, "Use GET");
+    std::vector<std::string> cameras;
+    for (const Camera* camera : bridge.cameras()) {
+      cameras.push_back(CameraJson(*camera));
+    }
+    return Ok(absl::StrCat("[", absl::StrJoin(cameras, ","), "]"));
+  }
+
+  int id;
+  if (!absl::SimpleAtoi(path[1], &id) || bridge.camera(id) == nullptr) {
+    return HttpError(404, "Unknown camera");
+  }
+  Camera& camera = *bridge.camera(id);
+  MotionController& motion = *bridge.motion(id);
+  if (path.size() == 2) {
+    if (request.method != "GET") return HttpError(405, "Use GET");
+    return Ok(CameraJson(camera));
+  }
+  // Only the shadow state can be read while the camera is probed.
+  if (!camera.ready() && request.method != "GET") {
+    HttpResponse response = HttpError(503, kNotReady);
+    response.headers.emplace_back("Retry-After", "1");
+    return response;
+  }
+
+  if (path[2] == "presets" && (path.size() == 4 || path.size() == 5)) {
+    int number;
+    if (!absl::SimpleAtoi(path[3], &number)) {
+      return HttpError(400, "Bad preset number");
+    }
+    if (request.method != "POST") return HttpError(405, "Use POST");
+    if (path.size() == 4) {
+      camera.SavePreset(number);
+      return Ok();
+    }
+    if (path[4] != "recall") return HttpError(404, "Not found");
+    const CameraState* preset = camera.preset(number);
+    if (preset == nullptr) return HttpError(404, "Unknown preset");
+    if (!motion.Acquire()) return HttpError(409, kLockedOut);
+    motion.Recall(*preset);
+    return Ok();
+  }
+
+  if (path.size() != 3) return HttpError(404, "Not found");
+  if (path[2] == "queue") {
+    if (request.method != "GET") return HttpError(405, "Use GET");
+    const CommandQueueStats* stats = camera.backend().queue_stats();
+    if (stats == nullptr) return HttpError(404, "Camera has no queue");
+    return Ok(stats->ToJson());
+  }
+  if (path[2] == "lock") {
+    if (!motion.locking()) return HttpError(404, "Camera has no lock");
+    if (request.method == "GET") return Ok(motion.LockToJson());
+    if (request.method != "PUT" && request.method != "POST") {
+      return HttpError(405, "Use GET or PUT");
+    }
+    motion.TakeOver();
+    return Ok(motion.LockToJson());
+  }
+  if (request.method == "GET") {
+    std::string json = ControlJson(camera, path[2]);
+    if (json.empty()) return HttpError(404, "Unknown control");
+    return Ok(std::move(json));
+  }
+  if (request.method != "PUT" && request.method != "POST") {
+    return HttpError(405, "Use GET or PUT");
+  }
+  if (path[2] != "stop" && !motion.Acquire()) {
+    return HttpError(409, kLockedOut);
+  }
+  if (absl::Status status = ApplyChange(&motion, path[2], request.query);
+      !status.ok()) {
+    return Error(status);
+  }
+  return Ok();
+}
+
+HttpResponse HandleBatch(Bridge& bridge, const HttpRequest& request) {
+  if (request.method != "POST") return HttpError(405, "Use POST");
+  absl::StatusOr<std::vector<JsonObject>> changes =
+      ParseJsonObjectArray(request.body);
+  if (!changes.ok()) return Error(changes.status());
+
+  // Validate everything first, a batch is applied completely or not at all.
+  std::vector<MotionController*> motions;
+  for (size_t i = 0; i < changes->size(); ++i) {
+    const JsonObject& change = (*changes)[i];
+    int id;
+    auto camera = change.find("camera");
+    if (camera == change.end() || !absl::SimpleAtoi(camera->second, &id) ||
+        bridge.motion(id) == nullptr) {
+      return HttpError(404, absl::StrCat("Unknown camera in change ", i));
+    }
+    auto control = change.find("control");
+    if (control == change.end()) {
+      return HttpError(400, absl::StrCat("No control in change ", i));
+    }
+    if (absl::Status status = ApplyChange(nullptr, control->second, change);
+        !status.ok()) {
+      return HttpError(absl::IsNotFound(status) ? 404 : 400,
+                       absl::StrCat("Change ", i, ": ", status.message()));
+    }
+    if (!bridge.camera(id)->ready()) {
+      return HttpError(503, absl::StrCat("Change ", i, ": ", kNotReady));
+    }
+    MotionController* motion = bridge.motion(id);
+    if (control->second != "stop" && motion->LockedOut()) {
+      // Counts the refused request, no change has taken a lock yet.
+      motion->Acquire();
+      return HttpError(409, absl::StrCat("Change ", i, ": ", kLockedOut));
+    }
+    motions.push_back(motion);
+  }
+
+  // Only a batch that is applied takes the locks.
+  for (size_t i = 0; i < changes->size(); ++i) {
+    if ((*changes)[i].at("control") != "stop") motions[i]->Acquire();
+  }
+  BridgeBatch batch(bridge);
+  for (size_t i = 0; i < changes->size(); ++i) {
+    const JsonObject& change = (*changes)[i];
+    ApplyChange(motions[i], change.at("control"), change).IgnoreError();
+  }
+  return Ok(absl::StrCat("{\"applied\":", changes->size(), "}"));
+}
+
+}  // namespace
+
+void AddRestApi(HttpServer& server, Bridge& bridge) {
+  server.AddHandler("/cameras", [&bridge](const HttpRequest& request) {
+    return HandleCameras(bridge, request);
+  });
+  server.AddHandler("/batch", [&bridge](const HttpRequest& request) {
+    return HandleBatch(bridge, request);
+  });
+}
+
+void AddUsbApi(HttpServer& server, const UsbScheduler& scheduler) {
+  server.AddHandler("/usb", [&scheduler](const HttpRequest& request) {
+    if (request.method != "GET") return HttpError(405, "Use GET");
+    return Ok(scheduler.ToJson());
+  });
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,51 @@
+#ifndef VISCA2UVC_REST_API_H_
+#define VISCA2UVC_REST_API_H_
+
+#include "bridge.h"
+#include "http_server.h"
+#include "usb_topology.h"
+
+namespace visca2uvc {
+
+// Serves the JSON control API for automation:
+//
+//   GET  /cameras                      State of all cameras.
+//   GET  /cameras/<id>                 State of one camera.
+//   GET  /cameras/<id>/<control>       One control, from the shadow state.
+//   GET  /cameras/<id>/queue           Per class counters of sent,
+//                                      dropped, collapsed and shed requests
+//                                      of cameras with a request queue.
+//   GET  /cameras/<id>/lock            Owner of the control lock, its idle
+//                                      time and rejected requests.
+//   PUT  /cameras/<id>/lock            Takes the lock over and stops.
+//   PUT  /cameras/<id>/<control>?...   Changes one control, 409 while
+//                                      another client holds the lock.
+//   POST /cameras/<id>/presets/<n>         Saves the current position.
+//   POST /cameras/<id>/presets/<n>/recall  Recalls a saved position.
+//   POST /batch                        Applies a JSON array of changes.
+//
+// Controls and their arguments, speeds are -1..1:
+//
+//   zoom      abs=<n> | speed=<f>
+//   pantilt   pan=<n>&tilt=<n> | pan_speed=<f>&tilt_speed=<f>
+//   focus     abs=<n> | speed=<f> | auto=<bool>
+//   stop
+//
+// Batch entries carry the same arguments plus "camera" and "control", e.g.
+// [{"camera":1,"control":"zoom","abs":300}]. All changes of a batch are
+// flushed to the cameras together.
+//
+// Cameras are listed right away and have "ready":false until they are probed,
+// requests other than GET answer 503 meanwhile.
+void AddRestApi(HttpServer& server, Bridge& bridge);
+
+// Serves the USB topology of the cameras and per-bus transfer counters:
+//
+//   GET  /usb                          Buses with their cameras' port paths,
+//                                      flushes, deferred flushes, busy time
+//                                      and utilization since startup.
+void AddUsbApi(HttpServer& server, const UsbScheduler& scheduler);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_REST_API_H_
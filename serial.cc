@@ -0,0 +1,99 @@
+#include "serial.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <iostream>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "client.h"
+
+namespace visca2uvc {
+namespace {
+
+// Serial protocols don't need more per read.
+constexpr size_t kMaxInput = 4096;
+
+absl::StatusOr<speed_t> BaudRate(int baud) {
+  switch (baud) {
+    case 1200:
+      return B1200;
+    case 2400:
+      return B2400;
+    case 4800:
+      return B4800;
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported baud rate: ", baud));
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<SerialPort>> SerialPort::Create(
+    EventLoop& loop, const std::string& path, int baud) {
+  absl::StatusOr<speed_t> speed = BaudRate(baud);
+  if (!speed.ok()) return speed.status();
+  Fd fd(open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC));
+  RETURN_IF_ERRNO(fd.get());
+
+  termios tty;
+  RETURN_IF_ERRNO(tcgetattr(fd.get(), &tty));
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+  RETURN_IF_ERRNO(cfsetispeed(&tty, *speed));
+  RETURN_IF_ERRNO(cfsetospeed(&tty, *speed));
+  RETURN_IF_ERRNO(tcsetattr(fd.get(), TCSANOW, &tty));
+  tcflush(fd.get(), TCIOFLUSH);
+
+  std::unique_ptr<SerialPort> port(new SerialPort(loop, path, std::move(fd)));
+  loop.WatchFd(port->fd_.get(), POLLIN,
+               [p = port.get()](short) { p->Read(); });
+  return port;
+}
+
+SerialPort::~SerialPort() { loop_.UnwatchFd(fd_.get()); }
+
+void SerialPort::Send(absl::string_view data) {
+  if (write(fd_.get(), data.data(), data.size()) < 0 && errno != EAGAIN) {
+    std::cerr << path_ << ": " << absl::ErrnoToStatus(errno, "write") << "\n";
+  }
+}
+
+void SerialPort::Read() {
+  char buffer[kMaxInput];
+  const ssize_t n = read(fd_.get(), buffer, sizeof(buffer));
+  if (n <= 0) {
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    // Nothing more will come, e.g. the adapter was unplugged or the other
+    // end of the pty closed.
+    std::cerr << path_ << ": "
+              << (n < 0 ? absl::ErrnoToStatus(errno, "read")
+                        : absl::UnavailableError("Hung up"))
+              << "\n";
+    loop_.UnwatchFd(fd_.get());
+    return;
+  }
+  input_.append(buffer, n);
+  ClientScope scope({path_, "", ""});
+  if (callback_) input_.erase(0, callback_(input_));
+  // Line noise without any valid frame.
+  if (input_.size() > kMaxInput) input_.clear();
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,50 @@
+#ifndef VISCA2UVC_SERIAL_H_
+#define VISCA2UVC_SERIAL_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "event_loop.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+// A serial line in raw 8N1 mode, e.g. an RS-422/485 adapter or a pty.
+class SerialPort {
+ public:
+  // Called with all input not consumed yet, returns how many bytes were
+  // consumed.
+  using DataCallback = std::function<size_t(absl::string_view data)>;
+
+  static absl::StatusOr<std::unique_ptr<SerialPort>> Create(
+      EventLoop& loop, const std::string& path, int baud);
+  ~SerialPort();
+
+  void SetDataCallback(DataCallback callback) {
+    callback_ = std::move(callback);
+  }
+
+  // Writes what the line takes right away. Replies are short, a line that
+  // can't take them has nobody listening.
+  void Send(absl::string_view data);
+
+ private:
+  SerialPort(EventLoop& loop, std::string path, Fd fd)
+      : loop_(loop), path_(std::move(path)), fd_(std::move(fd)) {}
+
+  void Read();
+
+  EventLoop& loop_;
+  const std::string path_;
+  Fd fd_;
+  DataCallback callback_;
+  std::string input_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_SERIAL_H_
@@ -0,0 +1,293 @@
+#include "server.h"
+
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+
+#include "aw_api.h"
+#include "bridge.h"
+#include "camera.h"
+#include "client.h"
+#include "device_index.h"
+#include "event_loop.h"
+#include "frame_ring.h"
+#include "http_server.h"
+#include "motion.h"
+#include "osc_server.h"
+#include "pelco.h"
+#include "preview.h"
+#include "prober.h"
+#include "profile.h"
+#include "rest_api.h"
+#include "shm_channel.h"
+#include "tracking.h"
+#include "usb.h"
+#include "usb_topology.h"
+#include "uvc.h"
+#include "uvc_backend.h"
+#include "v4l2_backend.h"
+#include "visca.h"
+#include "visca_upstream.h"
+#include "websocket_server.h"
+
+namespace visca2uvc {
+
+absl::Status Serve(const ServerOptions& options) {
+  EventLoop loop;
+  // Claiming the cameras through libuvc would detach them from uvcvideo.
+  std::unique_ptr<UsbContext> usb;
+  std::optional<UvcContext> uvc;
+  std::unique_ptr<UvcDeviceIndex> device_index;
+  std::vector<UvcDevice> devices;
+  if (options.v4l2_devices.empty()) {
+    absl::StatusOr<std::unique_ptr<UsbContext>> usb_context =
+        UsbContext::Create(loop);
+    if (!usb_context.ok()) return usb_context.status();
+    usb = *std::move(usb_context);
+    absl::StatusOr<UvcContext> context = UvcContext::Create(usb->get());
+    if (!context.ok()) return context.status();
+    uvc = *std::move(context);
+    absl::StatusOr<std::unique_ptr<UvcDeviceIndex>> index =
+        UvcDeviceIndex::Create(*uvc, &loop);
+    if (!index.ok()) return index.status();
+    device_index = *std::move(index);
+    if (options.uvc_devices.empty()) {
+      absl::StatusOr<std::vector<UvcDevice>> list = uvc->ListDevices();
+      if (!list.ok()) return list.status();
+      devices = *std::move(list);
+    }
+    for (const std::string& selector : options.uvc_devices) {
+      absl::StatusOr<UvcDevice> device = device_index->Find(selector);
+      if (!device.ok()) {
+        std::cerr << "Skipping " << selector << ": " << device.status()
+                  << "\n";
+        continue;
+      }
+      devices.push_back(*std::move(device));
+    }
+  }
+  absl::StatusOr<ClientClasses> client_classes =
+      ClientClasses::Parse(options.client_classes);
+  if (!client_classes.ok()) return client_classes.status();
+  // Outlive the bridge, whose cameras send through the links and pace their
+  // transfers with the scheduler.
+  ViscaLinkPool visca_links(loop);
+  UsbScheduler usb_scheduler(options.usb_bus_spacing);
+  Bridge bridge;
+  if (!options.device_profile.empty()) {
+    absl::StatusOr<DeviceProfile> profile =
+        LoadDeviceProfile(options.device_profile);
+    if (!profile.ok()) return profile.status();
+    bridge.set_profile(*std::move(profile));
+  }
+  // Cameras whose probes block on the device, probed while serving.
+  std::vector<Camera*> blocking_probes;
+  auto add_camera = [&](std::unique_ptr<Backend> backend, bool blocking) {
+    auto camera =
+        std::make_unique<Camera>(bridge.size() + 1, std::move(backend));
+    if (blocking) {
+      blocking_probes.push_back(camera.get());
+    } else {
+      camera->Probe();
+      camera->Refresh();
+    }
+    auto motion =
+        std::make_unique<MotionController>(loop, *camera, options.motion_tick);
+    motion->set_client_classes(&*client_classes);
+    motion->set_lock_timeout(options.control_lock);
+    auto tracker = std::make_unique<Tracker>(
+        loop, *motion, options.motion_tick, options.tracking);
+    bridge.Add(std::move(camera), std::move(motion), std::move(tracker));
+  };
+  std::vector<FrameSource> frame_sources;
+  // Watched once probed, by camera id, with the device to re-open.
+  std::vector<std::tuple<int, UvcBackend*, UvcBackend::Reopen>> watched;
+  // Opened one by one, libuvc keeps the open handles in an unlocked list.
+  for (UvcDevice& device : devices) {
+    absl::StatusOr<UvcDeviceHandle> handle = device.Open();
+    if (!handle.ok()) {
+      std::cerr << "Skipping device: " << handle.status() << "\n";
+      continue;
+    }
+    auto backend =
+        std::make_unique<UvcBackend>(*std::move(handle), bridge.profile());
+    const int id = bridge.size() + 1;
+    frame_sources.push_back({id, &backend->handle()});
+    absl::StatusOr<UsbLocation> location =
+        UsbLocation::Of(backend->handle().usb_device());
+    // A camera that re-enumerates after a reset is found again by port.
+    UvcBackend::Reopen reopen = [&device_index, &device, location] {
+      if (!location.ok()) return device.Open();
+      absl::StatusOr<UvcDevice> found =
+          device_index->Find(absl::StrCat("port:", location->path()));
+      if (!found.ok()) return absl::StatusOr<UvcDeviceHandle>(found.status());
+      return found->Open();
+    };
+    watched.emplace_back(id, backend.get(), std::move(reopen));
+    add_camera(std::move(backend), true);
+    if (location.ok()) {
+      usb_scheduler.AddCamera(id, *location);
+      bridge.motion(id)->set_usb_scheduler(&usb_scheduler, location->bus);
+      std::cerr << "Camera " << id << " at USB " << location->path() << "\n";
+    } else {
+      std::cerr << "Camera " << id << ": " << location.status() << "\n";
+    }
+  }
+  for (const std::string& path : options.v4l2_devices) {
+    absl::StatusOr<std::unique_ptr<V4l2Backend>> backend =
+        V4l2Backend::Create(path);
+    if (!backend.ok()) {
+      std::cerr << "Skipping " << path << ": " << backend.status() << "\n";
+      continue;
+    }
+    add_camera(*std::move(backend), true);
+  }
+  for (const std::string& upstream : options.visca_upstreams) {
+    absl::StatusOr<ViscaUpstreamSpec> spec = ParseViscaUpstream(upstream);
+    if (!spec.ok()) return spec.status();
+    ViscaLink& link = visca_links.Get(spec->tcp, spec->address);
+    add_camera(
+        std::make_unique<ViscaBackend>(loop, link, spec->chain_address,
+                                       options.command_deadlines,
+                                       options.command_queue_size),
+        false);
+  }
+  if (bridge.size() == 0) return absl::NotFoundError("No camera found.");
+  std::cerr << "Serving " << bridge.size() << " camera(s).\n";
+
+  loop.AddPeriodic(options.poll_interval, [&] {
+    for (Camera* camera : bridge.cameras()) {
+      if (camera->ready()) camera->Refresh();
+    }
+  });
+
+  std::unique_ptr<StatePublisher> state_publisher;
+  if (options.state_publisher.has_value()) {
+    absl::StatusOr<std::unique_ptr<StatePublisher>> publisher =
+        StatePublisher::Create(loop, *options.state_publisher,
+                               bridge.cameras());
+    if (!publisher.ok()) return publisher.status();
+    state_publisher = *std::move(publisher);
+  }
+
+  std::unique_ptr<WebSocketServer> websocket_server;
+  if (options.websocket_port != 0) {
+    absl::StatusOr<std::unique_ptr<WebSocketServer>> server =
+        WebSocketServer::Create(loop, options.websocket_port, bridge);
+    if (!server.ok()) return server.status();
+    websocket_server = *std::move(server);
+  }
+
+  std::unique_ptr<HttpServer> http_server;
+  if (options.http_port != 0) {
+    absl::StatusOr<std::unique_ptr<HttpServer>> server =
+        HttpServer::Create(loop, options.http_port);
+    if (!server.ok()) return server.status();
+    http_server = *std::move(server);
+    AddRestApi(*http_server, bridge);
+    AddUsbApi(*http_server, usb_scheduler);
+  }
+
+  // AW desks address cameras by IP and port, so each camera gets its own.
+  std::vector<std::unique_ptr<HttpServer>> aw_servers;
+  if (options.aw_port != 0) {
+    for (int id = 1; id <= bridge.size(); ++id) {
+      absl::StatusOr<std::unique_ptr<HttpServer>> server =
+          HttpServer::Create(loop, options.aw_port + id - 1);
+      if (!server.ok()) return server.status();
+      AddAwApi(**server, bridge, id);
+      aw_servers.push_back(*std::move(server));
+    }
+  }
+
+  std::unique_ptr<OscServer> osc_server;
+  if (options.osc_port != 0) {
+    absl::StatusOr<std::unique_ptr<OscServer>> server =
+        OscServer::Create(loop, options.osc_port, bridge);
+    if (!server.ok()) return server.status();
+    osc_server = *std::move(server);
+  }
+
+  std::unique_ptr<PelcoServer> pelco_server;
+  if (options.pelco_port != 0) {
+    absl::StatusOr<std::unique_ptr<PelcoServer>> server =
+        PelcoServer::Create(loop, options.pelco_port, bridge);
+    if (!server.ok()) return server.status();
+    pelco_server = *std::move(server);
+  }
+
+  std::unique_ptr<PelcoSerial> pelco_serial;
+  if (!options.pelco_serial.empty()) {
+    absl::StatusOr<std::unique_ptr<PelcoSerial>> serial = PelcoSerial::Create(
+        loop, options.pelco_serial, options.pelco_baud, bridge);
+    if (!serial.ok()) return serial.status();
+    pelco_serial = *std::move(serial);
+  }
+
+  std::unique_ptr<ViscaSerial> visca_serial;
+  if (!options.visca_serial.empty()) {
+    absl::StatusOr<std::unique_ptr<ViscaSerial>> serial = ViscaSerial::Create(
+        loop, options.visca_serial, options.visca_baud, bridge);
+    if (!serial.ok()) return serial.status();
+    visca_serial = *std::move(serial);
+  }
+
+  std::unique_ptr<ShmChannel> shm_channel;
+  if (!options.shm_socket.empty()) {
+    absl::StatusOr<std::unique_ptr<ShmChannel>> channel =
+        ShmChannel::Create(loop, options.shm_socket, bridge);
+    if (!channel.ok()) return channel.status();
+    shm_channel = *std::move(channel);
+  }
+
+  std::unique_ptr<FrameServer> frame_server;
+  if (options.frames.has_value()) {
+    absl::StatusOr<std::unique_ptr<FrameServer>> server =
+        FrameServer::Create(loop, *options.frames, frame_sources);
+    if (!server.ok()) return server.status();
+    frame_server = *std::move(server);
+    for (const auto& [id, backend, reopen] : watched) {
+      if (FrameRing* ring = frame_server->ring(id)) {
+        backend->AddRecoveryListener([ring] { ring->Resume(); });
+      }
+    }
+  }
+
+  std::unique_ptr<PreviewServer> preview_server;
+  if (options.preview.has_value()) {
+    if (frame_server == nullptr || http_server == nullptr) {
+      return absl::InvalidArgumentError(
+          "Previews need the frame socket and the HTTP port.");
+    }
+    absl::StatusOr<std::unique_ptr<PreviewServer>> server =
+        PreviewServer::Create(loop, *options.preview, *frame_server,
+                              *http_server);
+    if (!server.ok()) return server.status();
+    preview_server = *std::move(server);
+  }
+
+  // Started last and destroyed first, the frontends refuse control of the
+  // cameras until they are ready.
+  absl::StatusOr<std::unique_ptr<Prober>> prober = Prober::Create(
+      loop, std::move(blocking_probes), options.probe_threads,
+      [&](Camera& camera) {
+        for (auto& [id, backend, reopen] : watched) {
+          if (id != camera.id()) continue;
+          backend->set_watchdog(
+              options.watchdog_timeouts > 0 ? &loop : nullptr,
+              options.watchdog_timeouts, absl::StrCat("Camera ", id),
+              std::move(reopen));
+        }
+      });
+  if (!prober.ok()) return prober.status();
+
+  return loop.Run();
+}
+
+}  // namespace visca2uvc
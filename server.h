@@ -0,0 +1,84 @@
+#ifndef VISCA2UVC_SERVER_H_
+#define VISCA2UVC_SERVER_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "command_queue.h"
+#include "frame_ring.h"
+#include "preview.h"
+#include "state_publisher.h"
+#include "tracking.h"
+
+namespace visca2uvc {
+
+struct ServerOptions {
+  // How often the shadow state is refreshed from the cameras.
+  absl::Duration poll_interval = absl::Milliseconds(200);
+  // Minimum time between USB transfers of a camera's motion controller.
+  absl::Duration motion_tick = absl::Milliseconds(20);
+  // Minimum time between flushes of different cameras on one USB bus.
+  absl::Duration usb_bus_spacing = absl::Milliseconds(2);
+  // Threads probing the UVC or V4L2 cameras while serving.
+  int probe_threads = 8;
+  // Consecutive timeouts after which a UVC camera is reset and re-opened,
+  // never when 0.
+  int watchdog_timeouts = 3;
+  // "<listener or address>=<class>" entries, see ClientClasses.
+  std::vector<std::string> client_classes;
+  // Idle time after which a camera's control lock expires, no lock when
+  // zero.
+  absl::Duration control_lock = absl::ZeroDuration();
+  TrackingOptions tracking;
+  // Port of the WebSocket API, disabled when 0.
+  uint16_t websocket_port = 0;
+  // Port of the HTTP APIs, disabled when 0.
+  uint16_t http_port = 0;
+  // First port of the Panasonic AW CGI, one port per camera, disabled when 0.
+  uint16_t aw_port = 0;
+  // UDP port of the OSC listener, disabled when 0.
+  uint16_t osc_port = 0;
+  // TCP port of the PELCO-D/P listener, disabled when 0.
+  uint16_t pelco_port = 0;
+  // Serial line or pty for PELCO-D/P, disabled when empty.
+  std::string pelco_serial;
+  int pelco_baud = 2400;
+  // Serial line or pty for VISCA, disabled when empty.
+  std::string visca_serial;
+  int visca_baud = 9600;
+  // Unix socket of the shared memory command channel, disabled when empty.
+  std::string shm_socket;
+  // Device profile with vendor extension controls, none when empty.
+  std::string device_profile;
+  // UVC cameras to serve in this order, as UvcDeviceIndex selectors. All
+  // cameras in enumeration order when empty.
+  std::vector<std::string> uvc_devices;
+  // V4L2 devices served instead of the cameras libuvc finds, so that other
+  // programs can stream from them.
+  std::vector<std::string> v4l2_devices;
+  // Upstream VISCA cameras, see ParseViscaUpstream, served after the UVC
+  // cameras.
+  std::vector<std::string> visca_upstreams;
+  // How long requests may wait for an upstream VISCA camera.
+  CommandDeadlines command_deadlines;
+  // How many requests may wait for an upstream VISCA camera.
+  int command_queue_size = 8;
+  std::optional<StatePublisherOptions> state_publisher;
+  // Exports the video of the libuvc cameras to local consumers.
+  std::optional<FrameRingOptions> frames;
+  // Serves thumbnails of the exported video over HTTP, needs `frames` and
+  // `http_port`.
+  std::optional<PreviewOptions> preview;
+};
+
+// Opens all UVC cameras, or the given V4L2 devices, and the upstream VISCA
+// cameras and serves them until an error occurs.
+absl::Status Serve(const ServerOptions& options);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_SERVER_H_
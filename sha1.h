@@ -0,0 +1,16 @@
+#ifndef VISCA2UVC_SHA1_H_
+#define VISCA2UVC_SHA1_H_
+
+#include <array>
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+
+namespace visca2uvc {
+
+// SHA-1 digest, only used for the WebSocket handshake.
+std::array<uint8_t, 20> Sha1(absl::string_view data);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_SHA1_H_
@@ -0,0 +1,249 @@
+#include "shm_channel.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "client.h"
+#include "net.h"
+#include "visca2uvc_shm.h"
+
+namespace visca2uvc {
+
+static_assert(kNumControls <= V2U_NUM_CONTROLS);
+static_assert(static_cast<int>(Control::kZoomAbs) == V2U_ZOOM_ABS &&
+              static_cast<int>(Control::kPan) == V2U_PAN &&
+              static_cast<int>(Control::kTilt) == V2U_TILT &&
+              static_cast<int>(Control::kFocusAbs) == V2U_FOCUS_ABS &&
+              static_cast<int>(Control::kFocusAuto) == V2U_FOCUS_AUTO &&
+              static_cast<int>(Control::kDigitalZoom) == V2U_DIGITAL_ZOOM);
+
+struct ShmChannel::Client {
+  ~Client() {
+    if (shm != nullptr) munmap(shm, sizeof(v2u_shm));
+  }
+
+  Fd socket;
+  Fd event;
+  v2u_shm* shm = nullptr;
+  // Tells it apart from the other clients, see ClientId::session.
+  uint64_t number = 0;
+  // Cameras this client set in motion.
+  absl::flat_hash_set<int> moving;
+};
+
+ShmChannel::ShmChannel(EventLoop& loop, std::string path, Fd fd,
+                       Bridge& bridge)
+    : loop_(loop), path_(std::move(path)), fd_(std::move(fd)),
+      bridge_(bridge) {}
+
+absl::StatusOr<std::unique_ptr<ShmChannel>> ShmChannel::Create(
+    EventLoop& loop, const std::string& socket_path, Bridge& bridge) {
+  absl::StatusOr<Fd> fd = ListenUnix(socket_path);
+  if (!fd.ok()) return fd.status();
+  std::unique_ptr<ShmChannel> channel(
+      new ShmChannel(loop, socket_path, *std::move(fd), bridge));
+  loop.WatchFd(channel->fd_.get(), POLLIN,
+               [c = channel.get()](short) { c->Accept(); });
+  for (Camera* camera : bridge.cameras()) {
+    camera->AddListener([c = channel.get()](const Camera& camera,
+                                            absl::Span<const Control>) {
+      for (const auto& [ptr, client] : c->clients_) {
+        c->WriteState(*client->shm, camera);
+      }
+    });
+  }
+  return channel;
+}
+
+ShmChannel::~ShmChannel() {
+  loop_.UnwatchFd(fd_.get());
+  for (const auto& [ptr, client] : clients_) {
+    loop_.UnwatchFd(client->socket.get());
+    loop_.UnwatchFd(client->event.get());
+  }
+  unlink(path_.c_str());
+}
+
+void ShmChannel::Accept() {
+  while (true) {
+    Fd fd(accept4(fd_.get(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+    if (!fd.valid()) {
+      if (errno != EAGAIN && errno != EINTR) {
+        std::cerr << absl::ErrnoToStatus(errno, "accept4") << "\n";
+      }
+      if (errno != EINTR) return;
+      continue;
+    }
+    if (absl::Status status = AddClient(std::move(fd)); !status.ok()) {
+      std::cerr << "Shared memory client: " << status << "\n";
+    }
+  }
+}
+
+absl::Status ShmChannel::AddClient(Fd socket) {
+  auto client = std::make_unique<Client>();
+  client->socket = std::move(socket);
+  client->number = ++clients_added_;
+
+  Fd memfd(memfd_create("visca2uvc", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+  RETURN_IF_ERRNO(memfd.get());
+  RETURN_IF_ERRNO(ftruncate(memfd.get(), sizeof(v2u_shm)));
+  // The client can't make later accesses fault by resizing it.
+  RETURN_IF_ERRNO(fcntl(memfd.get(), F_ADD_SEALS,
+                        F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL));
+  void* shm = mmap(nullptr, sizeof(v2u_shm), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, memfd.get(), 0);
+  if (shm == MAP_FAILED) return absl::ErrnoToStatus(errno, "mmap");
+  client->shm = static_cast<v2u_shm*>(shm);
+  client->shm->magic = V2U_SHM_MAGIC;
+  client->shm->version = V2U_SHM_VERSION;
+  client->shm->num_cameras =
+      std::min<uint32_t>(bridge_.size(), V2U_MAX_CAMERAS);
+  for (const Camera* camera : bridge_.cameras()) {
+    WriteState(*client->shm, *camera);
+  }
+
+  client->event.Reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  RETURN_IF_ERRNO(client->event.get());
+
+  // A fresh socket has room for one byte.
+  if (absl::Status status =
+          SendFds(client->socket.get(), {memfd.get(), client->event.get()});
+      !status.ok()) {
+    return status;
+  }
+
+  Client* ptr = client.get();
+  clients_[ptr] = std::move(client);
+  // Clients never send on the socket, it only tells when they are gone.
+  loop_.WatchFd(ptr->socket.get(), POLLIN, [this, ptr](short) {
+    char buffer[64];
+    const ssize_t n = recv(ptr->socket.get(), buffer, sizeof(buffer), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      RemoveClient(ptr);
+    }
+  });
+  loop_.WatchFd(ptr->event.get(), POLLIN, [this, ptr](short) { Drain(*ptr); });
+  return absl::OkStatus();
+}
+
+ClientId ShmChannel::Id(const Client& client) {
+  return {"shm", "", absl::StrCat(client.number)};
+}
+
+void ShmChannel::RemoveClient(Client* client) {
+  loop_.UnwatchFd(client->socket.get());
+  loop_.UnwatchFd(client->event.get());
+  ClientScope scope(Id(*client));
+  for (const int id : client->moving) {
+    if (Tracker* tracker = bridge_.tracker(id)) tracker->StopClient();
+    if (MotionController* motion = bridge_.motion(id)) motion->StopClient();
+  }
+  clients_.erase(client);
+}
+
+void ShmChannel::Drain(Client& client) {
+  uint64_t count;
+  while (read(client.event.get(), &count, sizeof(count)) < 0 &&
+         errno == EINTR) {
+  }
+
+  v2u_shm& shm = *client.shm;
+  ClientScope scope(Id(client));
+  BridgeBatch batch(bridge_);
+  uint32_t tail = shm.tail;
+  uint32_t head = __atomic_load_n(&shm.head, __ATOMIC_SEQ_CST);
+  while (tail != head) {
+    if (head - tail > V2U_RING_SIZE) {
+      std::cerr << "Shared memory client: corrupt ring\n";
+      RemoveClient(&client);
+      return;
+    }
+    for (; tail != head; ++tail) {
+      // The client may still scribble over the slot, work on a copy.
+      v2u_command command;
+      std::memcpy(&command, &shm.ring[tail & (V2U_RING_SIZE - 1)],
+                  sizeof(command));
+      Dispatch(client, command);
+    }
+    __atomic_store_n(&shm.tail, tail, __ATOMIC_SEQ_CST);
+    // Commands submitted before the client saw the new tail came without a
+    // wakeup.
+    head = __atomic_load_n(&shm.head, __ATOMIC_SEQ_CST);
+  }
+}
+
+void ShmChannel::Dispatch(Client& client, const v2u_command& command) {
+  const int id = command.camera;
+  MotionController* motion = bridge_.motion(id);
+  if (motion == nullptr) return;
+  switch (command.type) {
+    case V2U_MOVE_PANTILT:
+      motion->MovePanTilt(command.speed[0], command.speed[1]);
+      client.moving.insert(id);
+      break;
+    case V2U_MOVE_ZOOM:
+      motion->MoveZoom(command.speed[0]);
+      client.moving.insert(id);
+      break;
+    case V2U_MOVE_FOCUS:
+      motion->MoveFocus(command.speed[0]);
+      client.moving.insert(id);
+      break;
+    case V2U_STOP:
+      if (Tracker* tracker = bridge_.tracker(id)) tracker->Stop();
+      motion->Stop();
+      client.moving.erase(id);
+      break;
+    case V2U_SET_PANTILT:
+      motion->SetPanTiltAbs(command.value[0], command.value[1]);
+      break;
+    case V2U_SET_ZOOM:
+      motion->SetZoomAbs(command.value[0]);
+      break;
+    case V2U_SET_FOCUS:
+      motion->SetFocusAbs(command.value[0]);
+      break;
+    case V2U_TRACK:
+      if (Tracker* tracker = bridge_.tracker(id)) {
+        tracker->SetTarget(command.speed[0], command.speed[1]);
+      }
+      client.moving.insert(id);
+      break;
+    default:
+      break;
+  }
+}
+
+void ShmChannel::WriteState(v2u_shm& shm, const Camera& camera) {
+  if (camera.id() < 1 || camera.id() > static_cast<int>(shm.num_cameras)) {
+    return;
+  }
+  v2u_camera_state& state = shm.cameras[camera.id() - 1];
+  uint32_t present = 0;
+  const uint32_t sequence = state.sequence;
+  __atomic_store_n(&state.sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (int i = 0; i < kNumControls; ++i) {
+    const std::optional<int32_t>& value =
+        camera.state()[static_cast<Control>(i)];
+    if (value.has_value()) present |= 1u << i;
+    __atomic_store_n(&state.values[i], value.value_or(0), __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&state.present, present, __ATOMIC_RELAXED);
+  __atomic_store_n(&state.sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+}  // namespace visca2uvc
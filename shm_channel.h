@@ -0,0 +1,57 @@
+#ifndef VISCA2UVC_SHM_CHANNEL_H_
+#define VISCA2UVC_SHM_CHANNEL_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "bridge.h"
+#include "client.h"
+#include "event_loop.h"
+#include "fd.h"
+
+struct v2u_command;
+struct v2u_shm;
+
+namespace visca2uvc {
+
+// Shared memory command channel for local high-rate clients, see
+// visca2uvc_shm.h for the client side.
+//
+// Each client connecting to the Unix socket gets its own memfd holding a
+// command ring and the cameras' shadow state, and an eventfd to wake the
+// daemon. All commands found in the ring on a wakeup are flushed together.
+// The drives a client started are stopped when it disconnects, unless
+// another client took them over.
+class ShmChannel {
+ public:
+  static absl::StatusOr<std::unique_ptr<ShmChannel>> Create(
+      EventLoop& loop, const std::string& socket_path, Bridge& bridge);
+  ~ShmChannel();
+
+ private:
+  struct Client;
+
+  ShmChannel(EventLoop& loop, std::string path, Fd fd, Bridge& bridge);
+
+  void Accept();
+  absl::Status AddClient(Fd socket);
+  static ClientId Id(const Client& client);
+  void RemoveClient(Client* client);
+  // Applies the commands in the ring until it stays empty.
+  void Drain(Client& client);
+  void Dispatch(Client& client, const v2u_command& command);
+  void WriteState(v2u_shm& shm, const Camera& camera);
+
+  EventLoop& loop_;
+  const std::string path_;
+  Fd fd_;
+  Bridge& bridge_;
+  absl::flat_hash_map<Client*, std::unique_ptr<Client>> clients_;
+  uint64_t clients_added_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_SHM_CHANNEL_H_
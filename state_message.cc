@@ -0,0 +1,59 @@
+#include "state_message.h"
+
+#include "absl/strings/str_cat.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr uint8_t kVersion = 1;
+
+void AppendU32(uint32_t value, std::string& out) {
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+}  // namespace
+
+std::string EncodeStateMessage(StateMessageType type, uint32_t sequence,
+                               const Camera& camera,
+                               absl::Span<const Control> controls) {
+  const CameraState& state = camera.state();
+  std::string message = {static_cast<char>(kVersion),
+                         static_cast<char>(type)};
+  AppendU32(sequence, message);
+  message.push_back(camera.id());
+  const size_t count_offset = message.size();
+  message.push_back(0);
+  for (const Control control : controls) {
+    const std::optional<int32_t>& value = state[control];
+    if (!value.has_value()) continue;
+    ++message[count_offset];
+    message.push_back(static_cast<char>(control));
+    AppendU32(*value, message);
+  }
+  return message;
+}
+
+std::string EncodeStateJson(StateMessageType type, uint32_t sequence,
+                            const Camera& camera,
+                            absl::Span<const Control> controls) {
+  const CameraState& state = camera.state();
+  std::string json = absl::StrCat(
+      "{\"seq\":", sequence, ",\"type\":\"",
+      type == StateMessageType::kDelta ? "delta" : "snapshot",
+      "\",\"camera\":", camera.id(), ",\"values\":{");
+  const char* separator = "";
+  for (const Control control : controls) {
+    const std::optional<int32_t>& value = state[control];
+    if (!value.has_value()) continue;
+    absl::StrAppend(&json, separator, "\"", ControlName(control),
+                    "\":", *value);
+    separator = ",";
+  }
+  json += "}}";
+  return json;
+}
+
+}  // namespace visca2uvc
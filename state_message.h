@@ -0,0 +1,40 @@
+#ifndef VISCA2UVC_STATE_MESSAGE_H_
+#define VISCA2UVC_STATE_MESSAGE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/types/span.h"
+#include "camera.h"
+
+namespace visca2uvc {
+
+// State change messages pushed to monitoring clients.
+//
+// Binary format, all integers big-endian:
+//
+//   u8 version (1), u8 type (1 delta, 2 snapshot), u32 sequence,
+//   u8 camera id, u8 count, count * (u8 control, i32 value)
+//
+// `sequence` increments by one per message of a stream, so gaps reveal loss.
+// `control` is a `Control` value. The JSON format carries the same
+// information:
+//
+//   {"seq":7,"type":"delta","camera":1,"values":{"zoom_abs":120}}
+enum class StateMessageType : uint8_t { kDelta = 1, kSnapshot = 2 };
+
+inline constexpr Control kAllControls[] = {
+    Control::kZoomAbs,  Control::kPan,       Control::kTilt,
+    Control::kFocusAbs, Control::kFocusAuto, Control::kDigitalZoom};
+
+// Encodes the current values of `controls`, skipping unknown ones.
+std::string EncodeStateMessage(StateMessageType type, uint32_t sequence,
+                               const Camera& camera,
+                               absl::Span<const Control> controls);
+std::string EncodeStateJson(StateMessageType type, uint32_t sequence,
+                            const Camera& camera,
+                            absl::Span<const Control> controls);
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_STATE_MESSAGE_H_
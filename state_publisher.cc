@@ -0,0 +1,79 @@
+#include "state_publisher.h"
+
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <iostream>
+
+#include "absl/strings/str_cat.h"
+#include "net.h"
+
+namespace visca2uvc {
+
+absl::StatusOr<std::unique_ptr<StatePublisher>> StatePublisher::Create(
+    EventLoop& loop, const StatePublisherOptions& options,
+    absl::Span<Camera* const> cameras) {
+  absl::StatusOr<sockaddr_in> binary_addr =
+      ParseIpv4(options.group, options.port);
+  if (!binary_addr.ok()) return binary_addr.status();
+  if (!IN_MULTICAST(ntohl(binary_addr->sin_addr.s_addr))) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Not a multicast group: ", options.group));
+  }
+  std::optional<sockaddr_in> json_addr;
+  if (options.json_port != 0) {
+    json_addr = *binary_addr;
+    json_addr->sin_port = htons(options.json_port);
+  }
+  absl::StatusOr<Fd> fd = MulticastSender(options.ttl);
+  if (!fd.ok()) return fd.status();
+
+  std::unique_ptr<StatePublisher> publisher(
+      new StatePublisher(loop, *std::move(fd), *binary_addr, json_addr));
+  for (Camera* camera : cameras) {
+    publisher->cameras_.push_back(camera);
+    camera->AddListener([p = publisher.get()](
+                            const Camera& camera,
+                            absl::Span<const Control> changed) {
+      p->Publish(StateMessageType::kDelta, camera, changed);
+    });
+  }
+  publisher->snapshot_timer_ =
+      loop.AddPeriodic(options.snapshot_interval,
+                       [p = publisher.get()] { p->PublishSnapshots(); });
+  return publisher;
+}
+
+StatePublisher::~StatePublisher() { loop_.CancelTimer(snapshot_timer_); }
+
+void StatePublisher::PublishSnapshots() {
+  for (const Camera* camera : cameras_) {
+    Publish(StateMessageType::kSnapshot, *camera, kAllControls);
+  }
+}
+
+void StatePublisher::Publish(StateMessageType type, const Camera& camera,
+                             absl::Span<const Control> controls) {
+  const uint32_t sequence = sequence_++;
+  const std::string message =
+      EncodeStateMessage(type, sequence, camera, controls);
+  Send(binary_addr_, message.data(), message.size());
+  if (json_addr_.has_value()) {
+    const std::string json = EncodeStateJson(type, sequence, camera, controls);
+    Send(*json_addr_, json.data(), json.size());
+  }
+}
+
+void StatePublisher::Send(const sockaddr_in& addr, const void* data,
+                          size_t size) {
+  // Datagrams that don't fit the socket buffer are dropped, the next
+  // snapshot repairs the listeners' state.
+  if (sendto(fd_.get(), data, size, 0, reinterpret_cast<const sockaddr*>(&addr),
+             sizeof(addr)) < 0 &&
+      errno != EAGAIN) {
+    std::cerr << "State publisher: " << absl::ErrnoToStatus(errno, "sendto")
+              << "\n";
+  }
+}
+
+}  // namespace visca2uvc
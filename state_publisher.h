@@ -0,0 +1,68 @@
+#ifndef VISCA2UVC_STATE_PUBLISHER_H_
+#define VISCA2UVC_STATE_PUBLISHER_H_
+
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "camera.h"
+#include "event_loop.h"
+#include "fd.h"
+#include "state_message.h"
+
+namespace visca2uvc {
+
+struct StatePublisherOptions {
+  std::string group;
+  uint16_t port = 0;
+  // Also publishes JSON datagrams to this port of the group when non-zero.
+  uint16_t json_port = 0;
+  int ttl = 1;
+  // Full state of every camera is sent this often so that late joiners and
+  // listeners that lost packets catch up.
+  absl::Duration snapshot_interval = absl::Seconds(1);
+};
+
+// Publishes changes of the cameras' shadow state to a UDP multicast group,
+// once per change regardless of the number of listeners. Each datagram is one
+// state message, see state_message.h.
+class StatePublisher {
+ public:
+  static absl::StatusOr<std::unique_ptr<StatePublisher>> Create(
+      EventLoop& loop, const StatePublisherOptions& options,
+      absl::Span<Camera* const> cameras);
+
+  ~StatePublisher();
+
+ private:
+  StatePublisher(EventLoop& loop, Fd fd, sockaddr_in binary_addr,
+                 std::optional<sockaddr_in> json_addr)
+      : loop_(loop),
+        fd_(std::move(fd)),
+        binary_addr_(binary_addr),
+        json_addr_(json_addr) {}
+
+  void PublishSnapshots();
+  void Publish(StateMessageType type, const Camera& camera,
+               absl::Span<const Control> controls);
+  void Send(const sockaddr_in& addr, const void* data, size_t size);
+
+  EventLoop& loop_;
+  Fd fd_;
+  const sockaddr_in binary_addr_;
+  const std::optional<sockaddr_in> json_addr_;
+  std::vector<Camera*> cameras_;
+  EventLoop::TimerId snapshot_timer_ = 0;
+  uint32_t sequence_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_STATE_PUBLISHER_H_
@@ -0,0 +1,164 @@
+#include "tcp_server.h"
+
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <iostream>
+
+#include "absl/strings/str_cat.h"
+#include "client.h"
+#include "net.h"
+
+namespace visca2uvc {
+namespace {
+
+// Clients that don't read their output are disconnected rather than
+// buffered without bounds.
+constexpr size_t kMaxOutput = 1 << 20;
+constexpr size_t kReadSize = 4096;
+// How long a client whose requests back up isn't read from.
+constexpr absl::Duration kPause = absl::Milliseconds(50);
+
+}  // namespace
+
+void TcpConnection::Send(absl::string_view data) {
+  if (closing_ || finished_) return;
+  output_.append(data.data(), data.size());
+  Write();
+  if (output_.size() > kMaxOutput) {
+    std::cerr << "Disconnecting slow client.\n";
+    Finish();
+    return;
+  }
+  UpdateEvents();
+}
+
+void TcpConnection::Close() {
+  closing_ = true;
+  if (output_.empty()) Finish();
+}
+
+void TcpConnection::OnEvents(short revents) {
+  if (revents & (POLLERR | POLLNVAL)) {
+    Finish();
+    return;
+  }
+  if (revents & POLLOUT) Write();
+  if (revents & (POLLIN | POLLHUP)) Read();
+  if (closing_ && output_.empty()) Finish();
+  if (!finished_) UpdateEvents();
+}
+
+void TcpConnection::Read() {
+  char buffer[kReadSize];
+  while (!closing_ && !finished_ && resume_timer_ == 0) {
+    const ssize_t n = read(fd_.get(), buffer, sizeof(buffer));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN) Finish();
+      return;
+    }
+    if (n == 0) {
+      Finish();
+      return;
+    }
+    input_.append(buffer, n);
+    // Pipelined requests are all handled in order.
+    ClientScope scope({absl::StrCat("tcp:", server_.port_), FormatIpv4(peer_),
+                       absl::StrCat(ntohs(peer_.sin_port))});
+    const size_t consumed = handler_->OnData(input_);
+    input_.erase(0, consumed);
+    if (scope.congested() && !finished_) Pause();
+  }
+}
+
+void TcpConnection::Pause() {
+  resume_timer_ = server_.loop_.AddTimer(kPause, [this] {
+    resume_timer_ = 0;
+    UpdateEvents();
+  });
+}
+
+void TcpConnection::Write() {
+  while (!output_.empty()) {
+    const ssize_t n =
+        send(fd_.get(), output_.data(), output_.size(), MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno != EAGAIN) Finish();
+      return;
+    }
+    output_.erase(0, n);
+  }
+}
+
+void TcpConnection::UpdateEvents() {
+  if (finished_) return;
+  server_.loop_.UpdateFd(fd_.get(),
+                         (closing_ || resume_timer_ != 0 ? 0 : POLLIN) |
+                             (output_.empty() ? 0 : POLLOUT));
+}
+
+void TcpConnection::Finish() {
+  if (finished_) return;
+  finished_ = true;
+  server_.loop_.CancelTimer(resume_timer_);
+  resume_timer_ = 0;
+  server_.loop_.UnwatchFd(fd_.get());
+  server_.loop_.AddTimer(absl::ZeroDuration(),
+                         [server = &server_, self = this] {
+                           server->Remove(self);
+                         });
+}
+
+absl::StatusOr<std::unique_ptr<TcpServer>> TcpServer::Create(
+    EventLoop& loop, uint16_t port, HandlerFactory factory) {
+  absl::StatusOr<Fd> fd = ListenTcp(port);
+  if (!fd.ok()) return fd.status();
+  std::unique_ptr<TcpServer> server(
+      new TcpServer(loop, port, *std::move(fd), std::move(factory)));
+  loop.WatchFd(server->fd_.get(), POLLIN,
+               [s = server.get()](short) { s->Accept(); });
+  return server;
+}
+
+TcpServer::~TcpServer() {
+  loop_.UnwatchFd(fd_.get());
+  for (const auto& [ptr, connection] : connections_) {
+    loop_.CancelTimer(connection->resume_timer_);
+    loop_.UnwatchFd(connection->fd_.get());
+  }
+}
+
+void TcpServer::Accept() {
+  while (true) {
+    sockaddr_in peer = {};
+    socklen_t peer_size = sizeof(peer);
+    Fd fd(accept4(fd_.get(), reinterpret_cast<sockaddr*>(&peer), &peer_size,
+                  SOCK_NONBLOCK | SOCK_CLOEXEC));
+    if (!fd.valid()) {
+      if (errno != EAGAIN && errno != EINTR) {
+        std::cerr << absl::ErrnoToStatus(errno, "accept4") << "\n";
+      }
+      if (errno != EINTR) return;
+      continue;
+    }
+    // Control messages are small and latency sensitive.
+    const int one = 1;
+    setsockopt(fd.get(), IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    const int raw_fd = fd.get();
+    auto connection =
+        std::make_unique<TcpConnection>(*this, std::move(fd), peer);
+    TcpConnection* ptr = connection.get();
+    connections_[ptr] = std::move(connection);
+    loop_.WatchFd(raw_fd, POLLIN, [ptr](short revents) {
+      ptr->OnEvents(revents);
+    });
+    ptr->handler_ = factory_(*ptr);
+  }
+}
+
+}  // namespace visca2uvc
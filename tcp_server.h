@@ -0,0 +1,103 @@
+#ifndef VISCA2UVC_TCP_SERVER_H_
+#define VISCA2UVC_TCP_SERVER_H_
+
+#include <netinet/in.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "event_loop.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+class TcpServer;
+
+// A non-blocking client connection, owned by its `TcpServer`.
+class TcpConnection {
+ public:
+  // Implemented by the protocols served over TCP.
+  class Handler {
+   public:
+    virtual ~Handler() = default;
+    // Called with all input not consumed yet, returns how many bytes were
+    // consumed.
+    virtual size_t OnData(absl::string_view data) = 0;
+  };
+
+  TcpConnection(TcpServer& server, Fd fd, const sockaddr_in& peer)
+      : server_(server), fd_(std::move(fd)), peer_(peer) {}
+
+  // Writes right away when possible, queues the rest.
+  void Send(absl::string_view data);
+  // Closes the connection once the queued output has been written.
+  void Close();
+
+  const sockaddr_in& peer() const { return peer_; }
+
+ private:
+  friend class TcpServer;
+
+  void OnEvents(short revents);
+  void Read();
+  void Write();
+  void UpdateEvents();
+  // Stops reading for a while, so that the client's requests wait in the
+  // socket buffers and TCP flow control slows it down.
+  void Pause();
+  // Destroys the connection once control returns to the event loop.
+  void Finish();
+
+  TcpServer& server_;
+  Fd fd_;
+  const sockaddr_in peer_;
+  std::unique_ptr<Handler> handler_;
+  std::string input_;
+  std::string output_;
+  bool closing_ = false;
+  bool finished_ = false;
+  EventLoop::TimerId resume_timer_ = 0;
+};
+
+// Accepts TCP connections and serves each with its own handler.
+class TcpServer {
+ public:
+  using HandlerFactory =
+      std::function<std::unique_ptr<TcpConnection::Handler>(TcpConnection&)>;
+
+  static absl::StatusOr<std::unique_ptr<TcpServer>> Create(
+      EventLoop& loop, uint16_t port, HandlerFactory factory);
+
+  ~TcpServer();
+
+  EventLoop& loop() { return loop_; }
+  uint16_t port() const { return port_; }
+
+ private:
+  friend class TcpConnection;
+
+  TcpServer(EventLoop& loop, uint16_t port, Fd fd, HandlerFactory factory)
+      : loop_(loop),
+        port_(port),
+        fd_(std::move(fd)),
+        factory_(std::move(factory)) {}
+
+  void Accept();
+  void Remove(TcpConnection* connection) { connections_.erase(connection); }
+
+  EventLoop& loop_;
+  const uint16_t port_;
+  Fd fd_;
+  HandlerFactory factory_;
+  absl::flat_hash_map<TcpConnection*, std::unique_ptr<TcpConnection>>
+      connections_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_TCP_SERVER_H_
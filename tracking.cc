@@ -0,0 +1,90 @@
+#include "tracking.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace visca2uvc {
+
+Tracker::~Tracker() { loop_.CancelTimer(timer_); }
+
+void Tracker::SetTarget(float x, float y, std::optional<float> zoom) {
+  if (!std::isfinite(x) || !std::isfinite(y) ||
+      (zoom.has_value() && !std::isfinite(*zoom))) {
+    return;
+  }
+  const absl::Time now = absl::Now();
+  client_ = ClientScope::current();
+  if (!active()) {
+    pan_ = tilt_ = Axis{};
+    zoom_.reset();
+    last_target_ = now;
+    timer_ = loop_.AddPeriodic(tick_, [this] { Tick(); });
+  }
+  const float dt = absl::ToDoubleSeconds(now - last_target_);
+  last_target_ = now;
+  Measure(pan_, x, dt);
+  // Positive tilt is up, image coordinates grow downwards.
+  Measure(tilt_, -y, dt);
+  if (zoom.has_value()) {
+    if (!zoom_.has_value()) zoom_.emplace();
+    Measure(*zoom_, *zoom, dt);
+  } else if (zoom_.has_value()) {
+    zoom_.reset();
+    motion_.MoveZoom(0);
+  }
+}
+
+void Tracker::Stop() {
+  if (!active()) return;
+  loop_.CancelTimer(timer_);
+  timer_ = 0;
+  motion_.MovePanTilt(0, 0);
+  if (zoom_.has_value()) motion_.MoveZoom(0);
+}
+
+void Tracker::StopClient() {
+  if (client_.key() == ClientScope::current().key()) Stop();
+}
+
+void Tracker::Measure(Axis& axis, float error, float dt) {
+  error = std::clamp(error, -1.0f, 1.0f);
+  if (std::abs(error) < options_.deadband) error = 0;
+  // The derivative only makes sense between measurements, which arrive at
+  // frame rate rather than on the tick.
+  axis.derivative = dt > 0 ? (error - axis.error) / dt : 0;
+  axis.error = error;
+}
+
+float Tracker::Step(Axis& axis) {
+  const float dt = absl::ToDoubleSeconds(tick_);
+  if (axis.error == 0) {
+    axis.integral = 0;
+  } else if (options_.ki > 0) {
+    // Anti-windup: the integral alone never asks for more than full speed.
+    axis.integral = std::clamp(axis.integral + axis.error * dt,
+                               -1.0f / options_.ki, 1.0f / options_.ki);
+  }
+  const float target = std::clamp(options_.kp * axis.error +
+                                       options_.ki * axis.integral +
+                                       options_.kd * axis.derivative,
+                                   -1.0f, 1.0f);
+  const float max_step = options_.max_acceleration * dt;
+  axis.output += std::clamp(target - axis.output, -max_step, max_step);
+  return axis.output;
+}
+
+void Tracker::Tick() {
+  ClientScope scope(client_);
+  if (absl::Now() - last_target_ > options_.timeout) {
+    Stop();
+    return;
+  }
+  // Runs in step with the motion tick, so every output is a transfer at
+  // most.
+  motion_.Hold();
+  motion_.MovePanTilt(Step(pan_), Step(tilt_));
+  if (zoom_.has_value()) motion_.MoveZoom(Step(*zoom_));
+  motion_.Release();
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,76 @@
+#ifndef VISCA2UVC_TRACKING_H_
+#define VISCA2UVC_TRACKING_H_
+
+#include <optional>
+
+#include "absl/time/time.h"
+#include "client.h"
+#include "event_loop.h"
+#include "motion.h"
+
+namespace visca2uvc {
+
+struct TrackingOptions {
+  // PID gains, from offsets in -1..1 to normalized speeds.
+  float kp = 1.0f;
+  float ki = 0.0f;
+  float kd = 0.0f;
+  // Offsets below this are treated as centred, to stop hunting.
+  float deadband = 0.02f;
+  // Maximum change of a normalized speed per second.
+  float max_acceleration = 4.0f;
+  // Tracking ends when no target arrives for this long.
+  absl::Duration timeout = absl::Milliseconds(300);
+};
+
+// Closes an auto-tracking loop inside the daemon: takes the target's offset
+// from the frame centre at frame rate and runs a PID controller per axis on
+// the motion tick, commanding pan/tilt and optionally zoom speeds with rate
+// limiting.
+class Tracker {
+ public:
+  Tracker(EventLoop& loop, MotionController& motion, absl::Duration tick,
+          const TrackingOptions& options)
+      : loop_(loop), motion_(motion), tick_(tick), options_(options) {}
+  ~Tracker();
+
+  // `x` and `y` are the target's offset from the centre as a fraction of
+  // the half frame, positive right and down. `zoom` is the relative error
+  // of the target's size, positive when it should be larger.
+  void SetTarget(float x, float y, std::optional<float> zoom = std::nullopt);
+  // Ends tracking and stops the motion it caused.
+  void Stop();
+  // Stop, if the client in scope set the target.
+  void StopClient();
+
+  bool active() const { return timer_ != 0; }
+
+ private:
+  struct Axis {
+    float error = 0;
+    float integral = 0;
+    float derivative = 0;
+    float output = 0;
+  };
+
+  // Feeds a new measurement taken `dt` after the previous one.
+  void Measure(Axis& axis, float error, float dt);
+  float Step(Axis& axis);
+  void Tick();
+
+  EventLoop& loop_;
+  MotionController& motion_;
+  const absl::Duration tick_;
+  const TrackingOptions options_;
+  EventLoop::TimerId timer_ = 0;
+  absl::Time last_target_ = absl::InfinitePast();
+  // Who sets the targets, the ticks are its requests.
+  ClientId client_;
+  Axis pan_;
+  Axis tilt_;
+  std::optional<Axis> zoom_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_TRACKING_H_
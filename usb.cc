@@ -0,0 +1,76 @@
+#include "usb.h"
+
+#include <sys/time.h>
+
+#include <iostream>
+
+#include "absl/time/time.h"
+
+namespace visca2uvc {
+
+absl::StatusOr<std::unique_ptr<UsbContext>> UsbContext::Create(
+    EventLoop& loop) {
+  libusb_context* ctx;
+  RETURN_IF_USB_ERROR(libusb_init(&ctx));
+  std::unique_ptr<UsbContext> context(new UsbContext(loop, ctx));
+
+  const libusb_pollfd** pollfds = libusb_get_pollfds(ctx);
+  if (pollfds != nullptr) {
+    for (const libusb_pollfd** pfd = pollfds; *pfd != nullptr; ++pfd) {
+      context->Watch((*pfd)->fd, (*pfd)->events);
+    }
+    libusb_free_pollfds(pollfds);
+  }
+  libusb_set_pollfd_notifiers(
+      ctx,
+      [](int fd, short events, void* user_data) {
+        static_cast<UsbContext*>(user_data)->Watch(fd, events);
+      },
+      [](int fd, void* user_data) {
+        static_cast<UsbContext*>(user_data)->loop_.UnwatchFd(fd);
+      },
+      context.get());
+  context->timer_based_ = !libusb_pollfds_handle_timeouts(ctx);
+  return context;
+}
+
+UsbContext::~UsbContext() {
+  loop_.CancelTimer(timeout_);
+  libusb_set_pollfd_notifiers(ctx_, nullptr, nullptr, nullptr);
+  const libusb_pollfd** pollfds = libusb_get_pollfds(ctx_);
+  if (pollfds != nullptr) {
+    for (const libusb_pollfd** pfd = pollfds; *pfd != nullptr; ++pfd) {
+      loop_.UnwatchFd((*pfd)->fd);
+    }
+    libusb_free_pollfds(pollfds);
+  }
+  libusb_exit(ctx_);
+}
+
+void UsbContext::Watch(int fd, short events) {
+  loop_.WatchFd(fd, events, [this](short) { HandleEvents(); });
+}
+
+void UsbContext::HandleEvents() {
+  timeval zero = {};
+  if (const int err = libusb_handle_events_timeout_completed(ctx_, &zero,
+                                                              nullptr);
+      err < 0) {
+    std::cerr << "libusb: " << libusb_error_name(err) << "\n";
+  }
+  ScheduleTimeout();
+}
+
+void UsbContext::ScheduleTimeout() {
+  if (!timer_based_) return;
+  loop_.CancelTimer(timeout_);
+  timeout_ = 0;
+  timeval next;
+  if (libusb_get_next_timeout(ctx_, &next) != 1) return;
+  timeout_ = loop_.AddTimer(absl::DurationFromTimeval(next), [this] {
+    timeout_ = 0;
+    HandleEvents();
+  });
+}
+
+}  // namespace visca2uvc
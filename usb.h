@@ -0,0 +1,49 @@
+#ifndef VISCA2UVC_USB_H_
+#define VISCA2UVC_USB_H_
+
+#include <libusb.h>
+
+#include <memory>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "event_loop.h"
+
+#define RETURN_IF_USB_ERROR(expr)                                      \
+  if (const int err = (expr); err < 0) {                               \
+    return absl::InternalError(                                        \
+        absl::StrCat(#expr, ": ", libusb_error_name(err)));            \
+  }
+
+namespace visca2uvc {
+
+// A libusb context owned by the daemon, whose file descriptors and timeouts
+// are handled by the event loop. libuvc and everything else touching USB
+// share it, so transfer completions are handled on the loop's thread
+// without a separate event thread.
+class UsbContext {
+ public:
+  static absl::StatusOr<std::unique_ptr<UsbContext>> Create(EventLoop& loop);
+  ~UsbContext();
+
+  libusb_context* get() const { return ctx_; }
+
+ private:
+  UsbContext(EventLoop& loop, libusb_context* ctx) : loop_(loop), ctx_(ctx) {}
+
+  void Watch(int fd, short events);
+  // Handles whatever libusb has pending without blocking.
+  void HandleEvents();
+  // Arms a timer for libusb's next timeout where the platform has no
+  // timerfd to signal it through a pollfd.
+  void ScheduleTimeout();
+
+  EventLoop& loop_;
+  libusb_context* const ctx_;
+  bool timer_based_ = false;
+  EventLoop::TimerId timeout_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_USB_H_
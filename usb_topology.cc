@@ -0,0 +1,67 @@
+#include "usb_topology.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "json.h"
+#include "usb.h"
+
+namespace visca2uvc {
+
+absl::StatusOr<UsbLocation> UsbLocation::Of(libusb_device* device) {
+  // USB 3 allows at most 7 tiers of ports.
+  uint8_t ports[7];
+  const int count = libusb_get_port_numbers(device, ports, sizeof(ports));
+  RETURN_IF_USB_ERROR(count);
+  UsbLocation location;
+  location.bus = libusb_get_bus_number(device);
+  location.ports.assign(ports, ports + count);
+  return location;
+}
+
+std::string UsbLocation::path() const {
+  return absl::StrCat(bus, "-", absl::StrJoin(ports, "."));
+}
+
+void UsbScheduler::AddCamera(int camera, const UsbLocation& location) {
+  buses_[location.bus].cameras[camera] = location.path();
+}
+
+absl::Time UsbScheduler::Reserve(int bus, absl::Time when) {
+  Bus& state = buses_[bus];
+  const absl::Time slot = std::max(when, state.next_slot);
+  if (slot > when) {
+    ++state.deferred;
+    state.max_wait = std::max(state.max_wait, slot - when);
+  }
+  state.next_slot = slot + spacing_;
+  return slot;
+}
+
+void UsbScheduler::Record(int bus, absl::Duration busy) {
+  Bus& state = buses_[bus];
+  ++state.flushes;
+  state.busy += busy;
+}
+
+std::string UsbScheduler::ToJson() const {
+  const absl::Duration uptime = absl::Now() - start_;
+  std::vector<std::string> buses;
+  for (const auto& [number, bus] : buses_) {
+    std::vector<std::string> cameras;
+    for (const auto& [id, path] : bus.cameras) {
+      cameras.push_back(
+          absl::StrCat("{\"id\":", id, ",\"path\":", JsonString(path), "}"));
+    }
+    buses.push_back(absl::StrCat(
+        "{\"bus\":", number, ",\"cameras\":[", absl::StrJoin(cameras, ","),
+        "],\"flushes\":", bus.flushes, ",\"deferred\":", bus.deferred,
+        ",\"max_wait_ms\":", absl::ToDoubleMilliseconds(bus.max_wait),
+        ",\"busy_ms\":", absl::ToDoubleMilliseconds(bus.busy),
+        ",\"utilization\":", absl::FDivDuration(bus.busy, uptime), "}"));
+  }
+  return absl::StrCat("[", absl::StrJoin(buses, ","), "]");
+}
+
+}  // namespace visca2uvc
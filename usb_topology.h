@@ -0,0 +1,70 @@
+#ifndef VISCA2UVC_USB_TOPOLOGY_H_
+#define VISCA2UVC_USB_TOPOLOGY_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+
+struct libusb_device;
+
+namespace visca2uvc {
+
+// Where a device sits in the USB tree.
+struct UsbLocation {
+  int bus = 0;
+  // Port numbers from the root hub down.
+  std::vector<uint8_t> ports;
+
+  static absl::StatusOr<UsbLocation> Of(libusb_device* device);
+
+  // "<bus>-<port>.<port>...", the device's name in /sys/bus/usb/devices.
+  std::string path() const;
+};
+
+// Paces the control transfers of cameras that share a USB bus.
+//
+// Every camera's motion controller reserves a slot on its bus before it
+// flushes, and slots on one bus are at least `spacing` apart. A group move
+// of all cameras on a hub is thereby spread out instead of queuing behind
+// one burst, while cameras on other buses go ahead. Stops don't wait.
+//
+// Also keeps per-bus counters of how long flushes blocked the loop.
+class UsbScheduler {
+ public:
+  explicit UsbScheduler(absl::Duration spacing) : spacing_(spacing) {}
+
+  void AddCamera(int camera, const UsbLocation& location);
+
+  // The earliest time from `when` at which a flush on `bus` may start. The
+  // slot is taken.
+  absl::Time Reserve(int bus, absl::Time when);
+  // Accounts a flush on `bus` that took `busy`.
+  void Record(int bus, absl::Duration busy);
+
+  // The buses with their cameras and counters, as a JSON array.
+  std::string ToJson() const;
+
+ private:
+  struct Bus {
+    // Camera id to port path.
+    std::map<int, std::string> cameras;
+    absl::Time next_slot = absl::InfinitePast();
+    uint64_t flushes = 0;
+    // Flushes that had to wait for the bus.
+    uint64_t deferred = 0;
+    absl::Duration max_wait;
+    absl::Duration busy;
+  };
+
+  const absl::Duration spacing_;
+  const absl::Time start_ = absl::Now();
+  std::map<int, Bus> buses_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_USB_TOPOLOGY_H_
@@ -0,0 +1,334 @@
+#ifndef VISCA2UVC_UVC_H_
+#define VISCA2UVC_UVC_H_
+
+#include <libuvc/libuvc.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "usb.h"
+
+#define RETURN_IF_UVC_ERROR(expr)                   \
+  if (const uvc_error err = (expr); err < 0) {      \
+    return ::visca2uvc::UvcErrorStatus(err, #expr); \
+  }
+
+namespace visca2uvc {
+
+// Timeouts are DEADLINE_EXCEEDED and lost devices UNAVAILABLE, so that a
+// camera that stopped answering can be told from an unsupported control.
+inline absl::Status UvcErrorStatus(uvc_error err, absl::string_view expr) {
+  const std::string message = absl::StrCat(expr, ": ", uvc_strerror(err));
+  switch (err) {
+    case UVC_ERROR_TIMEOUT:
+      return absl::DeadlineExceededError(message);
+    case UVC_ERROR_NO_DEVICE:
+      return absl::UnavailableError(message);
+    default:
+      return absl::InternalError(message);
+  }
+}
+
+struct ZoomRel {
+  int8_t zoom_rel;
+  uint8_t digital_zoom;
+  uint8_t speed;
+
+  friend std::ostream& operator<<(std::ostream& os, const ZoomRel& value) {
+    os << "zoom_rel: " << value.zoom_rel
+       << ", digital_zoom: " << value.digital_zoom
+       << ", speed: " << value.speed;
+    return os;
+  }
+};
+
+struct PanTiltAbs {
+  int32_t pan;
+  int32_t tilt;
+
+  friend std::ostream& operator<<(std::ostream& os, const PanTiltAbs& value) {
+    os << "pan: " << value.pan << ", tilt: " << value.tilt;
+    return os;
+  }
+};
+
+struct PanTiltRel {
+  int8_t pan_rel;
+  uint8_t pan_speed;
+  int8_t tilt_rel;
+  uint8_t tilt_speed;
+};
+
+struct FocusRel {
+  int8_t focus_rel;
+  uint8_t speed;
+};
+
+class UvcDelete {
+ public:
+  void operator()(uvc_device_handle_t* ptr) noexcept { uvc_close(ptr); }
+  void operator()(uvc_device_t* ptr) noexcept { uvc_unref_device(ptr); }
+  void operator()(uvc_context_t* ptr) noexcept { uvc_exit(ptr); }
+};
+
+template <typename T>
+using UvcUniquePtr = std::unique_ptr<T, UvcDelete>;
+
+class UvcDeviceHandle {
+ public:
+  using Ptr = UvcUniquePtr<uvc_device_handle_t>;
+  explicit UvcDeviceHandle(Ptr handle) : handle_(std::move(handle)) {}
+
+  absl::StatusOr<uint16_t> GetZoomAbs(uvc_req_code req_code) const {
+    uint16_t result;
+    RETURN_IF_UVC_ERROR(uvc_get_zoom_abs(handle_.get(), &result, req_code));
+    return result;
+  }
+
+  absl::Status SetZoomAbs(uint16_t focal_length) {
+    RETURN_IF_UVC_ERROR(uvc_set_zoom_abs(handle_.get(), focal_length));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<ZoomRel> GetZoomRel(uvc_req_code req_code) const {
+    ZoomRel result;
+    RETURN_IF_UVC_ERROR(uvc_get_zoom_rel(handle_.get(), &result.zoom_rel,
+                                         &result.digital_zoom, &result.speed,
+                                         req_code));
+    return result;
+  }
+
+  absl::Status SetZoomRel(const ZoomRel& zoom) {
+    RETURN_IF_UVC_ERROR(uvc_set_zoom_rel(handle_.get(), zoom.zoom_rel,
+                                         zoom.digital_zoom, zoom.speed));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<PanTiltAbs> GetPanTiltAbs(uvc_req_code req_code) const {
+    PanTiltAbs result;
+    RETURN_IF_UVC_ERROR(uvc_get_pantilt_abs(handle_.get(), &result.pan,
+                                            &result.tilt, req_code));
+    return result;
+  }
+
+  absl::Status SetPanTiltAbs(const PanTiltAbs& pantilt) {
+    RETURN_IF_UVC_ERROR(
+        uvc_set_pantilt_abs(handle_.get(), pantilt.pan, pantilt.tilt));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<PanTiltRel> GetPanTiltRel(uvc_req_code req_code) const {
+    PanTiltRel result;
+    RETURN_IF_UVC_ERROR(uvc_get_pantilt_rel(
+        handle_.get(), &result.pan_rel, &result.pan_speed, &result.tilt_rel,
+        &result.tilt_speed, req_code));
+    return result;
+  }
+
+  absl::Status SetPanTiltRel(const PanTiltRel& pantilt) {
+    RETURN_IF_UVC_ERROR(uvc_set_pantilt_rel(
+        handle_.get(), pantilt.pan_rel, pantilt.pan_speed, pantilt.tilt_rel,
+        pantilt.tilt_speed));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<uint16_t> GetFocusAbs(uvc_req_code req_code) const {
+    uint16_t result;
+    RETURN_IF_UVC_ERROR(uvc_get_focus_abs(handle_.get(), &result, req_code));
+    return result;
+  }
+
+  absl::Status SetFocusAbs(uint16_t focus) {
+    RETURN_IF_UVC_ERROR(uvc_set_focus_abs(handle_.get(), focus));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<FocusRel> GetFocusRel(uvc_req_code req_code) const {
+    FocusRel result;
+    RETURN_IF_UVC_ERROR(uvc_get_focus_rel(handle_.get(), &result.focus_rel,
+                                          &result.speed, req_code));
+    return result;
+  }
+
+  absl::Status SetFocusRel(const FocusRel& focus) {
+    RETURN_IF_UVC_ERROR(
+        uvc_set_focus_rel(handle_.get(), focus.focus_rel, focus.speed));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<bool> GetFocusAuto(uvc_req_code req_code) const {
+    uint8_t result;
+    RETURN_IF_UVC_ERROR(uvc_get_focus_auto(handle_.get(), &result, req_code));
+    return result != 0;
+  }
+
+  absl::Status SetFocusAuto(bool enabled) {
+    RETURN_IF_UVC_ERROR(uvc_set_focus_auto(handle_.get(), enabled ? 1 : 0));
+    return absl::OkStatus();
+  }
+
+  absl::StatusOr<uint16_t> GetDigitalMultiplier(uvc_req_code req_code) const {
+    uint16_t result;
+    RETURN_IF_UVC_ERROR(
+        uvc_get_digital_multiplier(handle_.get(), &result, req_code));
+    return result;
+  }
+
+  absl::Status SetDigitalMultiplier(uint16_t multiplier) {
+    RETURN_IF_UVC_ERROR(uvc_set_digital_multiplier(handle_.get(), multiplier));
+    return absl::OkStatus();
+  }
+
+  // Unit ID of the extension unit with `guid`, in descriptor byte order.
+  absl::StatusOr<uint8_t> FindExtensionUnit(
+      const std::array<uint8_t, 16>& guid) const {
+    for (const uvc_extension_unit_t* unit =
+             uvc_get_extension_units(handle_.get());
+         unit != nullptr; unit = unit->next) {
+      if (std::equal(guid.begin(), guid.end(), unit->guidExtensionCode)) {
+        return unit->bUnitID;
+      }
+    }
+    return absl::NotFoundError("No extension unit with this GUID");
+  }
+
+  // Size in bytes of control `selector` of extension unit `unit`.
+  absl::StatusOr<int> GetCtrlLen(uint8_t unit, uint8_t selector) const {
+    const int len = uvc_get_ctrl_len(handle_.get(), unit, selector);
+    RETURN_IF_UVC_ERROR(static_cast<uvc_error>(std::min(len, 0)));
+    return len;
+  }
+
+  absl::StatusOr<std::string> GetCtrl(uint8_t unit, uint8_t selector, int len,
+                                      uvc_req_code req_code) const {
+    std::string result(len, '\0');
+    const int read = uvc_get_ctrl(handle_.get(), unit, selector,
+                                  result.data(), len, req_code);
+    RETURN_IF_UVC_ERROR(static_cast<uvc_error>(std::min(read, 0)));
+    result.resize(read);
+    return result;
+  }
+
+  absl::Status SetCtrl(uint8_t unit, uint8_t selector,
+                       absl::string_view data) {
+    std::string buffer(data);
+    RETURN_IF_UVC_ERROR(static_cast<uvc_error>(std::min(
+        uvc_set_ctrl(handle_.get(), unit, selector, buffer.data(),
+                     buffer.size()),
+        0)));
+    return absl::OkStatus();
+  }
+
+  // Negotiates a stream of `format` frames at the given size and rate.
+  absl::StatusOr<uvc_stream_ctrl_t> GetStreamCtrl(uvc_frame_format format,
+                                                  int width, int height,
+                                                  int fps) {
+    uvc_stream_ctrl_t ctrl;
+    RETURN_IF_UVC_ERROR(uvc_get_stream_ctrl_format_size(
+        handle_.get(), &ctrl, format, width, height, fps));
+    return ctrl;
+  }
+
+  // Calls `callback` for every frame on a thread of libuvc until
+  // StopStreaming. The frame is only valid during the call.
+  absl::Status StartStreaming(uvc_stream_ctrl_t& ctrl,
+                              uvc_frame_callback_t* callback, void* user_ptr) {
+    if (!is_open()) return absl::UnavailableError("Device is closed");
+    RETURN_IF_UVC_ERROR(
+        uvc_start_streaming(handle_.get(), &ctrl, callback, user_ptr, 0));
+    return absl::OkStatus();
+  }
+
+  // Returns once the callback is no longer running.
+  void StopStreaming() {
+    if (is_open()) uvc_stop_streaming(handle_.get());
+  }
+
+  // Resets the device, which may drop off the bus and come back under a new
+  // device address, making this handle useless.
+  absl::Status ResetDevice() {
+    RETURN_IF_USB_ERROR(
+        libusb_reset_device(uvc_get_libusb_handle(handle_.get())));
+    return absl::OkStatus();
+  }
+
+  libusb_device* usb_device() const {
+    return libusb_get_device(uvc_get_libusb_handle(handle_.get()));
+  }
+
+  void PrintDiag(FILE* file) const { uvc_print_diag(handle_.get(), file); }
+
+  // Closes the device, e.g. to open it again. Only streaming may be used
+  // until this handle is replaced.
+  void Close() { handle_.reset(); }
+  bool is_open() const { return handle_ != nullptr; }
+
+ private:
+  Ptr handle_;
+};
+
+class UvcDevice {
+ public:
+  using Ptr = UvcUniquePtr<uvc_device_t>;
+  explicit UvcDevice(Ptr dev) : dev_(std::move(dev)) {}
+
+  absl::StatusOr<UvcDeviceHandle> Open() {
+    uvc_device_handle_t* handle;
+    RETURN_IF_UVC_ERROR(uvc_open(dev_.get(), &handle));
+    return UvcDeviceHandle(UvcDeviceHandle::Ptr(handle));
+  }
+
+ private:
+  Ptr dev_;
+};
+
+class UvcContext {
+ public:
+  using Ptr = UvcUniquePtr<uvc_context_t>;
+  explicit UvcContext(Ptr ctx) : ctx_(std::move(ctx)) {}
+
+  // Without `usb_ctx` libuvc creates its own libusb context, with an event
+  // thread while streaming. A given `usb_ctx` must outlive the context.
+  static absl::StatusOr<UvcContext> Create(libusb_context* usb_ctx = nullptr) {
+    uvc_context_t* ctx;
+    RETURN_IF_UVC_ERROR(uvc_init(&ctx, usb_ctx));
+    return UvcContext(Ptr(ctx));
+  }
+
+  uvc_context_t* get() const { return ctx_.get(); }
+
+  absl::StatusOr<UvcDevice> FindDevice(int vid, int pid, const char* sn) {
+    uvc_device_t* dev;
+    RETURN_IF_UVC_ERROR(uvc_find_device(ctx_.get(), &dev, vid, pid, sn));
+    return UvcDevice(UvcDevice::Ptr(dev));
+  }
+
+  // Returns all UVC devices in enumeration order.
+  absl::StatusOr<std::vector<UvcDevice>> ListDevices() {
+    uvc_device_t** list;
+    RETURN_IF_UVC_ERROR(uvc_get_device_list(ctx_.get(), &list));
+    std::vector<UvcDevice> result;
+    for (uvc_device_t** dev = list; *dev != nullptr; ++dev) {
+      uvc_ref_device(*dev);
+      result.emplace_back(UvcDevice::Ptr(*dev));
+    }
+    uvc_free_device_list(list, /*unref_devices=*/1);
+    return result;
+  }
+
+ private:
+  Ptr ctx_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_UVC_H_
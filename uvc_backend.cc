@@ -0,0 +1,256 @@
+#include "uvc_backend.h"
+
+#include <iostream>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/str_cat.h"
+
+namespace visca2uvc {
+namespace {
+
+// Between attempts to re-open a camera after a reset, giving it time to
+// come back on the bus.
+constexpr absl::Duration kRecoveryRetry = absl::Seconds(1);
+
+// A failed read of a control that doesn't mean it's unsupported.
+bool Transient(const absl::Status& status) {
+  return absl::IsDeadlineExceeded(status) || absl::IsUnavailable(status);
+}
+
+}  // namespace
+
+UvcBackend::~UvcBackend() {
+  if (loop_ != nullptr) loop_->CancelTimer(recovery_timer_);
+}
+
+void UvcBackend::set_watchdog(EventLoop* loop, int timeouts, std::string name,
+                              Reopen reopen) {
+  loop_ = loop;
+  max_timeouts_ = timeouts;
+  name_ = std::move(name);
+  reopen_ = std::move(reopen);
+}
+
+absl::Status UvcBackend::Transfer(
+    absl::FunctionRef<absl::Status()> transfer) {
+  if (wedged()) {
+    return absl::UnavailableError(absl::StrCat(name_, " is being reset"));
+  }
+  absl::Status status = transfer();
+  Watch(status);
+  return status;
+}
+
+bool UvcBackend::Watch(const absl::Status& status) {
+  if (!absl::IsDeadlineExceeded(status)) {
+    timeouts_ = 0;
+    return status.ok();
+  }
+  if (++timeouts_ == max_timeouts_ && loop_ != nullptr && !wedged()) {
+    std::cerr << name_ << ": " << timeouts_
+              << " transfers timed out, resetting\n";
+    wedged_since_ = absl::Now();
+    recovery_timer_ =
+        loop_->AddTimer(absl::ZeroDuration(), [this] { Recover(); });
+  }
+  return false;
+}
+
+void UvcBackend::Recover() {
+  recovery_timer_ = 0;
+  if (handle_.is_open()) {
+    absl::Status status = handle_.ResetDevice();
+    if (status.ok()) {
+      // The reset ended the stream's transfers, the recovery listeners start
+      // it again.
+      handle_.StopStreaming();
+      FinishRecovery();
+      return;
+    }
+    // A device that re-enumerates fails the reset with NOT_FOUND and is
+    // found again by the re-open, which needs its interfaces released.
+    std::cerr << name_ << ": " << status << ", re-opening\n";
+    handle_.StopStreaming();
+    handle_.Close();
+  }
+  absl::StatusOr<UvcDeviceHandle> handle = reopen_();
+  if (!handle.ok()) {
+    std::cerr << name_ << ": " << handle.status() << ", retrying\n";
+    recovery_timer_ = loop_->AddTimer(kRecoveryRetry, [this] { Recover(); });
+    return;
+  }
+  handle_ = *std::move(handle);
+  FinishRecovery();
+}
+
+void UvcBackend::FinishRecovery() {
+  timeouts_ = 0;
+  const absl::Duration downtime = absl::Now() - *wedged_since_;
+  wedged_since_.reset();
+  Recovered();
+  std::cerr << name_ << " recovered after "
+            << absl::ToInt64Milliseconds(downtime) << " ms\n";
+}
+
+Capabilities UvcBackend::Probe() {
+  Capabilities capabilities;
+  auto zoom_min = handle_.GetZoomAbs(UVC_GET_MIN);
+  auto zoom_max = handle_.GetZoomAbs(UVC_GET_MAX);
+  if (zoom_min.ok() && zoom_max.ok()) {
+    capabilities.zoom_abs = Range{*zoom_min, *zoom_max};
+  }
+  auto pantilt_min = handle_.GetPanTiltAbs(UVC_GET_MIN);
+  auto pantilt_max = handle_.GetPanTiltAbs(UVC_GET_MAX);
+  if (pantilt_min.ok() && pantilt_max.ok()) {
+    capabilities.pan = Range{pantilt_min->pan, pantilt_max->pan};
+    capabilities.tilt = Range{pantilt_min->tilt, pantilt_max->tilt};
+  }
+  auto focus_min = handle_.GetFocusAbs(UVC_GET_MIN);
+  auto focus_max = handle_.GetFocusAbs(UVC_GET_MAX);
+  if (focus_min.ok() && focus_max.ok()) {
+    capabilities.focus_abs = Range{*focus_min, *focus_max};
+  }
+  auto digital_min = handle_.GetDigitalMultiplier(UVC_GET_MIN);
+  auto digital_max = handle_.GetDigitalMultiplier(UVC_GET_MAX);
+  if (digital_min.ok() && digital_max.ok()) {
+    capabilities.digital_zoom = Range{*digital_min, *digital_max};
+  }
+  if (auto zoom_rel = handle_.GetZoomRel(UVC_GET_MAX); zoom_rel.ok()) {
+    capabilities.zoom_speed = zoom_rel->speed;
+  }
+  if (auto pantilt_rel = handle_.GetPanTiltRel(UVC_GET_MAX); pantilt_rel.ok()) {
+    capabilities.pan_speed = pantilt_rel->pan_speed;
+    capabilities.tilt_speed = pantilt_rel->tilt_speed;
+  }
+  if (auto focus_rel = handle_.GetFocusRel(UVC_GET_MAX); focus_rel.ok()) {
+    capabilities.focus_speed = focus_rel->speed;
+  }
+
+  extensions_.clear();
+  for (const ExtensionControl& control : profile_.extensions) {
+    std::optional<Extension>& extension = extensions_.emplace_back();
+    absl::StatusOr<uint8_t> unit = handle_.FindExtensionUnit(control.guid);
+    if (!unit.ok()) continue;
+    absl::StatusOr<int> size = handle_.GetCtrlLen(*unit, control.selector);
+    if (!size.ok() || *size <= 0) continue;
+    extension = Extension{*unit, control.selector, *size};
+  }
+  for (const std::optional<Extension>& extension : extensions_) {
+    capabilities.extension_sizes.push_back(extension ? extension->size : 0);
+  }
+  return capabilities;
+}
+
+absl::StatusOr<std::string> UvcBackend::GetExtension(int index) {
+  absl::StatusOr<Extension> extension = FindExtension(index);
+  if (!extension.ok()) return extension.status();
+  absl::StatusOr<std::string> result;
+  if (absl::Status status = Transfer([&] {
+        result = handle_.GetCtrl(extension->unit, extension->selector,
+                                 extension->size, UVC_GET_CUR);
+        return result.status();
+      });
+      !status.ok()) {
+    return status;
+  }
+  ReportExtension(index, *result);
+  return result;
+}
+
+absl::Status UvcBackend::SetExtension(int index, absl::string_view data) {
+  absl::StatusOr<Extension> extension = FindExtension(index);
+  if (!extension.ok()) return extension.status();
+  if (static_cast<int>(data.size()) != extension->size) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(profile_.extensions[index].name, " takes ",
+                     extension->size, " bytes"));
+  }
+  absl::Status status = Transfer([&] {
+    return handle_.SetCtrl(extension->unit, extension->selector, data);
+  });
+  if (status.ok()) ReportExtension(index, data);
+  return status;
+}
+
+absl::StatusOr<UvcBackend::Extension> UvcBackend::FindExtension(
+    int index) const {
+  if (index < 0 || index >= static_cast<int>(extensions_.size()) ||
+      !extensions_[index].has_value()) {
+    return absl::NotFoundError("Extension control not supported");
+  }
+  return *extensions_[index];
+}
+
+void UvcBackend::Refresh() {
+  absl::InlinedVector<Value, kNumControls> values;
+
+  // Each read stops once the camera is wedged, a read that failed for being
+  // wedged or timing out doesn't make the control unsupported.
+  if (supported(Control::kZoomAbs) && !wedged()) {
+    auto zoom = handle_.GetZoomAbs(UVC_GET_CUR);
+    if (Watch(zoom.status())) {
+      values.push_back({Control::kZoomAbs, *zoom});
+    } else if (!Transient(zoom.status())) {
+      set_unsupported(Control::kZoomAbs);
+    }
+  }
+  if (supported(Control::kPan) && !wedged()) {
+    auto pantilt = handle_.GetPanTiltAbs(UVC_GET_CUR);
+    if (Watch(pantilt.status())) {
+      values.push_back({Control::kPan, pantilt->pan});
+      values.push_back({Control::kTilt, pantilt->tilt});
+    } else if (!Transient(pantilt.status())) {
+      set_unsupported(Control::kPan);
+      set_unsupported(Control::kTilt);
+    }
+  }
+  if (supported(Control::kFocusAbs) && !wedged()) {
+    auto focus = handle_.GetFocusAbs(UVC_GET_CUR);
+    if (Watch(focus.status())) {
+      values.push_back({Control::kFocusAbs, *focus});
+    } else if (!Transient(focus.status())) {
+      set_unsupported(Control::kFocusAbs);
+    }
+  }
+  if (supported(Control::kFocusAuto) && !wedged()) {
+    auto focus_auto = handle_.GetFocusAuto(UVC_GET_CUR);
+    if (Watch(focus_auto.status())) {
+      values.push_back({Control::kFocusAuto, *focus_auto});
+    } else if (!Transient(focus_auto.status())) {
+      set_unsupported(Control::kFocusAuto);
+    }
+  }
+  if (supported(Control::kDigitalZoom) && !wedged()) {
+    auto digital = handle_.GetDigitalMultiplier(UVC_GET_CUR);
+    if (Watch(digital.status())) {
+      values.push_back({Control::kDigitalZoom, *digital});
+    } else if (!Transient(digital.status())) {
+      set_unsupported(Control::kDigitalZoom);
+    }
+  }
+
+  Report(values);
+
+  for (int i = 0; i < static_cast<int>(extensions_.size()); ++i) {
+    std::optional<Extension>& extension = extensions_[i];
+    if (!extension.has_value() || wedged()) continue;
+    auto data = handle_.GetCtrl(extension->unit, extension->selector,
+                                extension->size, UVC_GET_CUR);
+    if (Watch(data.status())) {
+      ReportExtension(i, *data);
+    } else if (!Transient(data.status())) {
+      extension.reset();
+    }
+  }
+}
+
+void UvcBackend::RefreshZoom() {
+  if (!supported(Control::kZoomAbs) || wedged()) return;
+  auto zoom = handle_.GetZoomAbs(UVC_GET_CUR);
+  if (Watch(zoom.status())) {
+    const Value values[] = {{Control::kZoomAbs, *zoom}};
+    Report(values);
+  }
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,134 @@
+#ifndef VISCA2UVC_UVC_BACKEND_H_
+#define VISCA2UVC_UVC_BACKEND_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "camera.h"
+#include "event_loop.h"
+#include "profile.h"
+#include "uvc.h"
+
+namespace visca2uvc {
+
+// Controls a UVC camera through libuvc. Transfers are synchronous, values
+// reach the observer before Refresh returns.
+//
+// Extension controls of `profile` are looked up once in Probe, so later
+// reads and writes go straight to the unit. Refresh polls them after the
+// standard controls.
+//
+// A camera can stop answering without leaving the bus, and then every
+// transfer waits for the full timeout. With the watchdog set, enough
+// consecutive timeouts mark the camera wedged: transfers fail right away
+// and the loop resets the device. If the reset fails, the camera is closed
+// and re-opened, retrying until that works. Recovery listeners then restore
+// what the reset lost.
+class UvcBackend : public Backend {
+ public:
+  // Opens the camera again after a reset.
+  using Reopen = std::function<absl::StatusOr<UvcDeviceHandle>()>;
+
+  UvcBackend(UvcDeviceHandle handle, const DeviceProfile& profile)
+      : handle_(std::move(handle)), profile_(profile) {}
+  ~UvcBackend() override;
+
+  // Keeps its address across re-opens.
+  UvcDeviceHandle& handle() { return handle_; }
+
+  // Watches for `timeouts` consecutive timeouts, recovering on `loop`.
+  // `name` labels the log messages. Must be set after the probe threads are
+  // done, the loop isn't thread-safe.
+  void set_watchdog(EventLoop* loop, int timeouts, std::string name,
+                    Reopen reopen);
+
+  Capabilities Probe() override;
+  // A control whose read fails is treated as unsupported and not polled
+  // again, unless the read timed out or the device was gone or wedged, which
+  // leaves it to the next Refresh.
+  void Refresh() override;
+  void RefreshZoom() override;
+
+  absl::Status SetZoomAbs(int32_t value) override {
+    return Transfer([&] { return handle_.SetZoomAbs(value); });
+  }
+  absl::Status SetZoomRel(const ZoomRel& zoom) override {
+    return Transfer([&] { return handle_.SetZoomRel(zoom); });
+  }
+  absl::Status SetPanTiltAbs(const PanTiltAbs& pantilt) override {
+    return Transfer([&] { return handle_.SetPanTiltAbs(pantilt); });
+  }
+  absl::Status SetPanTiltRel(const PanTiltRel& pantilt) override {
+    return Transfer([&] { return handle_.SetPanTiltRel(pantilt); });
+  }
+  absl::Status SetFocusAbs(int32_t value) override {
+    return Transfer([&] { return handle_.SetFocusAbs(value); });
+  }
+  absl::Status SetFocusRel(const FocusRel& focus) override {
+    return Transfer([&] { return handle_.SetFocusRel(focus); });
+  }
+  absl::Status SetFocusAuto(bool enabled) override {
+    return Transfer([&] { return handle_.SetFocusAuto(enabled); });
+  }
+  absl::Status SetDigitalZoom(int32_t value) override {
+    return Transfer([&] { return handle_.SetDigitalMultiplier(value); });
+  }
+
+  absl::StatusOr<std::string> GetExtension(int index) override;
+  absl::Status SetExtension(int index, absl::string_view data) override;
+
+  bool congested() const override { return wedged(); }
+
+ private:
+  bool wedged() const { return wedged_since_.has_value(); }
+  // Runs `transfer` unless the camera is wedged.
+  absl::Status Transfer(absl::FunctionRef<absl::Status()> transfer);
+  // Counts consecutive timeouts, returns whether `status` is ok.
+  bool Watch(const absl::Status& status);
+  // Resets the camera, and re-opens it if the reset fails or the camera
+  // re-enumerates.
+  void Recover();
+  void FinishRecovery();
+
+  bool supported(Control control) const {
+    return supported_[static_cast<int>(control)];
+  }
+  void set_unsupported(Control control) {
+    supported_[static_cast<int>(control)] = false;
+  }
+
+  struct Extension {
+    uint8_t unit;
+    uint8_t selector;
+    int size;
+  };
+
+  // The extension at `index`, or an error if the camera lacks it.
+  absl::StatusOr<Extension> FindExtension(int index) const;
+
+  UvcDeviceHandle handle_;
+  const DeviceProfile& profile_;
+  // Indexed like the profile's extensions.
+  std::vector<std::optional<Extension>> extensions_;
+  std::array<bool, kNumControls> supported_ = {true, true, true,
+                                               true, true, true};
+  EventLoop* loop_ = nullptr;
+  int max_timeouts_ = 0;
+  std::string name_;
+  Reopen reopen_;
+  int timeouts_ = 0;
+  std::optional<absl::Time> wedged_since_;
+  EventLoop::TimerId recovery_timer_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_UVC_BACKEND_H_
@@ -0,0 +1,213 @@
+#include "v4l2_backend.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <optional>
+#include <utility>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/str_cat.h"
+
+namespace visca2uvc {
+namespace {
+
+// Controls read by Refresh and the shadow control each maps to.
+constexpr std::pair<uint32_t, Control> kRefreshed[] = {
+    {V4L2_CID_ZOOM_ABSOLUTE, Control::kZoomAbs},
+    {V4L2_CID_PAN_ABSOLUTE, Control::kPan},
+    {V4L2_CID_TILT_ABSOLUTE, Control::kTilt},
+    {V4L2_CID_FOCUS_ABSOLUTE, Control::kFocusAbs},
+    {V4L2_CID_FOCUS_AUTO, Control::kFocusAuto},
+};
+
+int Ioctl(int fd, unsigned long request, void* arg) {
+  int result;
+  do {
+    result = ioctl(fd, request, arg);
+  } while (result < 0 && errno == EINTR);
+  return result;
+}
+
+v4l2_ext_control Control32(uint32_t id, int32_t value) {
+  v4l2_ext_control control = {};
+  control.id = id;
+  control.value = value;
+  return control;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<V4l2Backend>> V4l2Backend::Create(
+    const std::string& path) {
+  Fd fd(open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC));
+  RETURN_IF_ERRNO(fd.get());
+  v4l2_capability capability = {};
+  RETURN_IF_ERRNO(Ioctl(fd.get(), VIDIOC_QUERYCAP, &capability));
+  return std::unique_ptr<V4l2Backend>(new V4l2Backend(path, std::move(fd)));
+}
+
+Capabilities V4l2Backend::Probe() {
+  auto query = [&](uint32_t id) -> std::optional<v4l2_query_ext_ctrl> {
+    v4l2_query_ext_ctrl control = {};
+    control.id = id;
+    if (Ioctl(fd_.get(), VIDIOC_QUERY_EXT_CTRL, &control) < 0 ||
+        (control.flags & V4L2_CTRL_FLAG_DISABLED)) {
+      return std::nullopt;
+    }
+    supported_.insert(id);
+    return control;
+  };
+  auto range = [](const v4l2_query_ext_ctrl& control) {
+    return Range{static_cast<int32_t>(control.minimum),
+                 static_cast<int32_t>(control.maximum)};
+  };
+  // Relative controls are signed speeds, the maximum is the top speed.
+  auto speed = [](const v4l2_query_ext_ctrl& control) {
+    return static_cast<uint8_t>(std::clamp<int64_t>(control.maximum, 0, 255));
+  };
+
+  Capabilities capabilities;
+  if (auto zoom = query(V4L2_CID_ZOOM_ABSOLUTE)) {
+    capabilities.zoom_abs = range(*zoom);
+  }
+  auto pan = query(V4L2_CID_PAN_ABSOLUTE);
+  auto tilt = query(V4L2_CID_TILT_ABSOLUTE);
+  if (pan.has_value() && tilt.has_value()) {
+    capabilities.pan = range(*pan);
+    capabilities.tilt = range(*tilt);
+  }
+  if (auto focus = query(V4L2_CID_FOCUS_ABSOLUTE)) {
+    capabilities.focus_abs = range(*focus);
+  }
+  query(V4L2_CID_FOCUS_AUTO);
+  if (auto zoom = query(V4L2_CID_ZOOM_CONTINUOUS)) {
+    capabilities.zoom_speed = speed(*zoom);
+  }
+  if (auto pan_speed = query(V4L2_CID_PAN_SPEED)) {
+    capabilities.pan_speed = speed(*pan_speed);
+  }
+  if (auto tilt_speed = query(V4L2_CID_TILT_SPEED)) {
+    capabilities.tilt_speed = speed(*tilt_speed);
+  }
+  return capabilities;
+}
+
+void V4l2Backend::Refresh() {
+  absl::InlinedVector<v4l2_ext_control, kNumControls> controls;
+  for (const auto& [id, control] : kRefreshed) {
+    if (supported_.contains(id)) controls.push_back(Control32(id, 0));
+  }
+  if (controls.empty()) return;
+
+  v4l2_ext_controls request = {};
+  request.which = V4L2_CTRL_WHICH_CUR_VAL;
+  request.count = controls.size();
+  request.controls = controls.data();
+  if (Ioctl(fd_.get(), VIDIOC_G_EXT_CTRLS, &request) < 0) {
+    const int error = errno;
+    // The driver names the failing control. Stop polling it if it can't be
+    // read at all, like the libuvc backend does. Other errors, e.g. EIO,
+    // EBUSY or ETIMEDOUT, may pass, and the next refresh tries again.
+    if (request.error_idx < controls.size() &&
+        (error == EINVAL || error == EACCES)) {
+      supported_.erase(controls[request.error_idx].id);
+    }
+    std::cerr << path_ << ": " << absl::ErrnoToStatus(error, "G_EXT_CTRLS")
+              << "\n";
+    return;
+  }
+
+  absl::InlinedVector<Value, kNumControls> values;
+  for (const v4l2_ext_control& read : controls) {
+    for (const auto& [id, control] : kRefreshed) {
+      if (id == read.id) values.push_back({control, read.value});
+    }
+  }
+  Report(values);
+}
+
+absl::Status V4l2Backend::SetZoomAbs(int32_t value) {
+  return Set({Control32(V4L2_CID_ZOOM_ABSOLUTE, value)});
+}
+
+absl::Status V4l2Backend::SetZoomRel(const ZoomRel& zoom) {
+  return Set({Control32(V4L2_CID_ZOOM_CONTINUOUS, zoom.zoom_rel * zoom.speed)});
+}
+
+absl::Status V4l2Backend::SetPanTiltAbs(const PanTiltAbs& pantilt) {
+  return Set({Control32(V4L2_CID_PAN_ABSOLUTE, pantilt.pan),
+              Control32(V4L2_CID_TILT_ABSOLUTE, pantilt.tilt)});
+}
+
+absl::Status V4l2Backend::SetPanTiltRel(const PanTiltRel& pantilt) {
+  return Set({Control32(V4L2_CID_PAN_SPEED,
+                        pantilt.pan_rel * pantilt.pan_speed),
+              Control32(V4L2_CID_TILT_SPEED,
+                        pantilt.tilt_rel * pantilt.tilt_speed)});
+}
+
+absl::Status V4l2Backend::SetFocusAbs(int32_t value) {
+  return Set({Control32(V4L2_CID_FOCUS_ABSOLUTE, value)});
+}
+
+absl::Status V4l2Backend::SetFocusRel(const FocusRel& focus) {
+  return absl::UnimplementedError(
+      "uvcvideo has no relative focus control");
+}
+
+absl::Status V4l2Backend::SetFocusAuto(bool enabled) {
+  return Set({Control32(V4L2_CID_FOCUS_AUTO, enabled)});
+}
+
+absl::Status V4l2Backend::EndBatch() {
+  batching_ = false;
+  if (pending_.empty()) return absl::OkStatus();
+  std::vector<v4l2_ext_control> controls = std::exchange(pending_, {});
+  // Absolute focus is only writable once auto focus is off, and the driver
+  // applies controls in order.
+  std::stable_partition(
+      controls.begin(), controls.end(),
+      [](const v4l2_ext_control& c) { return c.id == V4L2_CID_FOCUS_AUTO; });
+  return Write(controls);
+}
+
+absl::Status V4l2Backend::Set(
+    std::initializer_list<v4l2_ext_control> controls) {
+  for (const v4l2_ext_control& control : controls) {
+    if (!supported_.contains(control.id)) {
+      return absl::UnimplementedError(
+          absl::StrCat(path_, ": control ", control.id, " not supported"));
+    }
+  }
+  if (!batching_) {
+    std::vector<v4l2_ext_control> now(controls);
+    return Write(now);
+  }
+  for (const v4l2_ext_control& control : controls) {
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [&](const v4l2_ext_control& queued) {
+                             return queued.id == control.id;
+                           });
+    if (it != pending_.end()) {
+      *it = control;
+    } else {
+      pending_.push_back(control);
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status V4l2Backend::Write(std::vector<v4l2_ext_control>& controls) {
+  v4l2_ext_controls request = {};
+  request.which = V4L2_CTRL_WHICH_CUR_VAL;
+  request.count = controls.size();
+  request.controls = controls.data();
+  RETURN_IF_ERRNO(Ioctl(fd_.get(), VIDIOC_S_EXT_CTRLS, &request));
+  return absl::OkStatus();
+}
+
+}  // namespace visca2uvc
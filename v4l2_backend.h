@@ -0,0 +1,64 @@
+#ifndef VISCA2UVC_V4L2_BACKEND_H_
+#define VISCA2UVC_V4L2_BACKEND_H_
+
+#include <linux/videodev2.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
+#include "camera.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+// Controls a camera through the kernel's uvcvideo driver, so that other
+// programs can stream from the same /dev/videoN while the daemon controls
+// it. libuvc would claim the interface instead.
+//
+// Refresh reads all supported controls with one VIDIOC_G_EXT_CTRLS, and the
+// writes of a batch, e.g. a preset recall, go out with one
+// VIDIOC_S_EXT_CTRLS. The driver maps relative zoom and pan-tilt to signed
+// speeds, relative focus has no mapping and is unsupported.
+class V4l2Backend : public Backend {
+ public:
+  static absl::StatusOr<std::unique_ptr<V4l2Backend>> Create(
+      const std::string& path);
+
+  Capabilities Probe() override;
+  void Refresh() override;
+
+  absl::Status SetZoomAbs(int32_t value) override;
+  absl::Status SetZoomRel(const ZoomRel& zoom) override;
+  absl::Status SetPanTiltAbs(const PanTiltAbs& pantilt) override;
+  absl::Status SetPanTiltRel(const PanTiltRel& pantilt) override;
+  absl::Status SetFocusAbs(int32_t value) override;
+  absl::Status SetFocusRel(const FocusRel& focus) override;
+  absl::Status SetFocusAuto(bool enabled) override;
+
+  void BeginBatch() override { batching_ = true; }
+  absl::Status EndBatch() override;
+
+ private:
+  V4l2Backend(std::string path, Fd fd)
+      : path_(std::move(path)), fd_(std::move(fd)) {}
+
+  // Writes or, while batching, queues `controls`, replacing queued values
+  // of the same controls.
+  absl::Status Set(std::initializer_list<v4l2_ext_control> controls);
+  absl::Status Write(std::vector<v4l2_ext_control>& controls);
+
+  const std::string path_;
+  Fd fd_;
+  absl::flat_hash_set<uint32_t> supported_;
+  bool batching_ = false;
+  std::vector<v4l2_ext_control> pending_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_V4L2_BACKEND_H_
@@ -0,0 +1,451 @@
+#include "visca.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace visca2uvc {
+namespace {
+
+constexpr uint8_t kTerminator = 0xFF;
+constexpr uint8_t kBroadcast = 0x88;
+constexpr size_t kMaxPacket = 16;
+constexpr int kMaxAddress = 7;
+
+// Replies after the header, all from socket 1.
+constexpr absl::string_view kAck("\x41", 1);
+constexpr absl::string_view kCompletion("\x51", 1);
+constexpr absl::string_view kSyntaxError("\x60\x02", 2);
+constexpr absl::string_view kBufferFull("\x60\x03", 2);
+constexpr absl::string_view kNoSocket("\x61\x05", 2);
+constexpr absl::string_view kNotExecutable("\x61\x41", 2);
+constexpr absl::string_view kInquiryNotExecutable("\x60\x41", 2);
+
+// Zoom positions from wide to optical tele, then digital zoom up to its
+// maximum.
+constexpr int kZoomWide = 0x0000;
+constexpr int kZoomTele = 0x4000;
+constexpr int kDigitalTele = 0x7AC0;
+// Focus positions from infinity to near.
+constexpr int kFocusFar = 0x1000;
+constexpr int kFocusNear = 0xF000;
+// Pan-tilt positions are signed steps of 0.075 degrees, UVC uses arc seconds.
+constexpr int kArcSecondsPerStep = 270;
+// Pan-tilt drive speeds.
+constexpr int kMaxPanSpeed = 0x18;
+constexpr int kMaxTiltSpeed = 0x17;
+// Speed of the standard zoom and focus commands.
+constexpr float kStandardSpeed = 0.5f;
+
+using Message = std::vector<uint8_t>;
+
+bool Matches(const Message& message, std::initializer_list<uint8_t> prefix,
+             size_t size) {
+  return message.size() == size && std::equal(prefix.begin(), prefix.end(),
+                                               message.begin());
+}
+
+// Four nibbles 0p 0q 0r 0s starting at `offset`.
+int Nibbles(const Message& message, size_t offset) {
+  int value = 0;
+  for (size_t i = offset; i < offset + 4; ++i) {
+    value = value << 4 | (message[i] & 0x0F);
+  }
+  return value;
+}
+
+std::string ToNibbles(int value) {
+  std::string result;
+  for (int shift = 12; shift >= 0; shift -= 4) {
+    result.push_back((value >> shift) & 0x0F);
+  }
+  return result;
+}
+
+// Maps `value` in `from`..`to` onto `range`, `from` may be above `to`.
+int32_t FromVisca(int value, int from, int to, const Range& range) {
+  const double fraction =
+      std::clamp(static_cast<double>(value - from) / (to - from), 0.0, 1.0);
+  return range.min + static_cast<int32_t>(std::lround(
+                         fraction * (int64_t{range.max} - range.min)));
+}
+
+int ToVisca(int32_t value, int from, int to, const Range& range) {
+  if (range.max <= range.min) return from;
+  const double fraction = static_cast<double>(range.Clamp(value) - range.min) /
+                          (int64_t{range.max} - range.min);
+  return from + static_cast<int>(std::lround(fraction * (to - from)));
+}
+
+// Position on the camera's zoom axis for a VISCA zoom position.
+int32_t FromViscaZoom(int value, const Capabilities& caps) {
+  const Range& optical = *caps.zoom_abs;
+  if (value <= kZoomTele || caps.zoom_axis->max == optical.max) {
+    return FromVisca(std::min(value, kZoomTele), kZoomWide, kZoomTele,
+                     optical);
+  }
+  return optical.max +
+         FromVisca(value, kZoomTele, kDigitalTele,
+                   Range{0, caps.zoom_axis->max - optical.max});
+}
+
+// VISCA zoom position of the camera, optical unless digital zoom is in use.
+int ToViscaZoom(const CameraState& state, const Capabilities& caps) {
+  const std::optional<int32_t>& digital = state[Control::kDigitalZoom];
+  if (caps.digital_zoom.has_value() && digital.has_value() &&
+      *digital > caps.digital_zoom->min) {
+    return ToVisca(*digital - caps.digital_zoom->min, kZoomTele, kDigitalTele,
+                   Range{0, caps.digital_zoom->max - caps.digital_zoom->min});
+  }
+  return ToVisca(*state[Control::kZoomAbs], kZoomWide, kZoomTele,
+                 *caps.zoom_abs);
+}
+
+// Direction and variable speed nibble of zoom and focus drive commands.
+float DriveSpeed(uint8_t command) {
+  switch (command >> 4) {
+    case 0x0:
+      return command == 0x02   ? kStandardSpeed
+             : command == 0x03 ? -kStandardSpeed
+                               : 0;
+    case 0x2:
+      return ((command & 0x07) + 1) / 8.0f;
+    case 0x3:
+      return -((command & 0x07) + 1) / 8.0f;
+    default:
+      return 0;
+  }
+}
+
+// Whether `m` stops a zoom, focus or pan-tilt drive.
+bool IsStop(const Message& m) {
+  return ((Matches(m, {0x01, 0x04, 0x07}, 4) ||
+           Matches(m, {0x01, 0x04, 0x08}, 4)) &&
+          DriveSpeed(m[3]) == 0) ||
+         (Matches(m, {0x01, 0x06, 0x01}, 7) && m[5] == 0x03 && m[6] == 0x03);
+}
+
+// Index of the profile's extension control that `message` addresses, with
+// category 01 for commands and 09 for inquiries, or -1.
+int FindExtension(const DeviceProfile& profile, const Message& message,
+                  uint8_t category) {
+  for (size_t i = 0; i < profile.extensions.size(); ++i) {
+    const std::string& visca = profile.extensions[i].visca;
+    if (!visca.empty() && message.size() > visca.size() &&
+        message[0] == category &&
+        std::equal(visca.begin(), visca.end(), message.begin() + 1,
+                   [](char a, uint8_t b) { return uint8_t(a) == b; })) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Whether `m` is reserved for the owner of the control lock: anything that
+// moves the camera or changes its picture, except stops. Power and memory
+// set/reset are open to everyone.
+bool NeedsLock(const Message& m, const DeviceProfile& profile) {
+  if (IsStop(m)) return false;
+  return Matches(m, {0x01, 0x04, 0x07}, 4) ||
+         Matches(m, {0x01, 0x04, 0x47}, 7) ||
+         Matches(m, {0x01, 0x04, 0x08}, 4) ||
+         Matches(m, {0x01, 0x04, 0x48}, 7) ||
+         Matches(m, {0x01, 0x04, 0x38}, 4) ||
+         (Matches(m, {0x01, 0x04, 0x3F}, 5) && m[3] == 0x02) ||
+         Matches(m, {0x01, 0x06, 0x01}, 7) ||
+         Matches(m, {0x01, 0x06, 0x02}, 13) ||
+         Matches(m, {0x01, 0x06, 0x04}, 3) ||
+         FindExtension(profile, m, 0x01) >= 0;
+}
+
+}  // namespace
+
+ViscaSession::~ViscaSession() {
+  ClientScope scope(client_);
+  for (const int id : moving_) {
+    if (MotionController* motion = bridge_.motion(id)) motion->StopClient();
+  }
+}
+
+size_t ViscaSession::OnData(absl::string_view data) {
+  client_ = ClientScope::current();
+  size_t consumed = 0;
+  BridgeBatch batch(bridge_);
+  while (consumed < data.size()) {
+    // Packets start with a header byte 8x, data bytes are below 80.
+    if ((static_cast<uint8_t>(data[consumed]) & 0xF0) != 0x80) {
+      ++consumed;
+      continue;
+    }
+    const size_t end = data.find(static_cast<char>(kTerminator), consumed);
+    if (end == absl::string_view::npos) {
+      if (data.size() - consumed > kMaxPacket) ++consumed;
+      break;
+    }
+    if (end - consumed + 1 > kMaxPacket) {
+      consumed = end + 1;
+      continue;
+    }
+    HandlePacket(data.substr(consumed, end - consumed + 1));
+    consumed = end + 1;
+  }
+  return consumed;
+}
+
+int ViscaSession::CameraId(int address) const {
+  const int id = address - first_address_ + 1;
+  return address >= 1 && address <= kMaxAddress && id >= 1 &&
+                 id <= bridge_.size()
+             ? id
+             : 0;
+}
+
+void ViscaSession::Send(int address, absl::string_view payload) {
+  std::string packet = {static_cast<char>((address + 8) << 4)};
+  packet.append(payload.data(), payload.size());
+  packet.push_back(kTerminator);
+  reply_(packet);
+}
+
+void ViscaSession::HandlePacket(absl::string_view packet) {
+  const uint8_t header = packet[0];
+  const Message message(packet.begin() + 1, packet.end() - 1);
+
+  if (header == kBroadcast) {
+    if (Matches(message, {0x30}, 2) && message[1] >= 1 &&
+        message[1] <= kMaxAddress) {
+      // Address Set: the cameras number themselves and pass on the next
+      // free address.
+      first_address_ = message[1];
+      const int count =
+          std::min(bridge_.size(), kMaxAddress - first_address_ + 1);
+      reply_(std::string({static_cast<char>(kBroadcast), 0x30,
+                          static_cast<char>(first_address_ + count),
+                          static_cast<char>(kTerminator)}));
+    } else if (Matches(message, {0x01, 0x00, 0x01}, 3)) {
+      // IF_Clear for the whole chain comes back unchanged.
+      reply_(packet);
+    }
+    return;
+  }
+
+  const int address = header & 0x0F;
+  const int id = CameraId(address);
+  // Nobody at that address.
+  if (id == 0 || message.empty()) return;
+  if (Matches(message, {0x01, 0x00, 0x01}, 3)) {
+    // IF_Clear.
+    Send(address, "\x50");
+  } else if (message[0] == 0x01) {
+    HandleCommand(address, id, message);
+  } else if (message[0] == 0x09) {
+    HandleInquiry(address, id, message);
+  } else if ((message[0] & 0xF0) == 0x20 && message.size() == 1) {
+    // Commands complete right away, there is nothing left to cancel.
+    Send(address, kNoSocket);
+  } else {
+    Send(address, kSyntaxError);
+  }
+}
+
+void ViscaSession::HandleCommand(int address, int id, const Message& m) {
+  MotionController& motion = *bridge_.motion(id);
+  Camera& camera = motion.camera();
+  const Capabilities& caps = camera.capabilities();
+  bool executable = true;
+  // Still being probed.
+  if (!camera.ready()) {
+    Send(address, kNotExecutable);
+    return;
+  }
+  // A camera that can't keep up takes no new work, but stops go through.
+  if (motion.Congested() && !IsStop(m)) {
+    Send(address, kBufferFull);
+    return;
+  }
+  // Another controller has the camera.
+  if (NeedsLock(m, bridge_.profile()) && !motion.Acquire()) {
+    Send(address, kNotExecutable);
+    return;
+  }
+
+  if (IsStop(m) && motion.LockedOut()) {
+    // Stops are open to every client. A locked out one can only have drives
+    // left from before the lock, its stop isn't a refused request.
+    motion.StopClient();
+  } else if (Matches(m, {0x01, 0x04, 0x00}, 4)) {
+    // Power, always on.
+  } else if (Matches(m, {0x01, 0x04, 0x07}, 4)) {
+    motion.MoveZoom(DriveSpeed(m[3]));
+    moving_.insert(id);
+  } else if (Matches(m, {0x01, 0x04, 0x47}, 7)) {
+    executable = caps.zoom_axis.has_value();
+    if (executable) motion.SetZoomAxis(FromViscaZoom(Nibbles(m, 3), caps));
+  } else if (Matches(m, {0x01, 0x04, 0x08}, 4)) {
+    // VISCA drives far with 2p, UVC's positive focus direction is near.
+    motion.MoveFocus(-DriveSpeed(m[3]));
+    moving_.insert(id);
+  } else if (Matches(m, {0x01, 0x04, 0x48}, 7)) {
+    executable = caps.focus_abs.has_value();
+    if (executable) {
+      motion.SetFocusAbs(
+          FromVisca(Nibbles(m, 3), kFocusNear, kFocusFar, *caps.focus_abs));
+    }
+  } else if (Matches(m, {0x01, 0x04, 0x38}, 4)) {
+    const std::optional<int32_t>& current =
+        camera.state()[Control::kFocusAuto];
+    if (m[3] == 0x02 || m[3] == 0x03) {
+      motion.SetFocusAuto(m[3] == 0x02);
+    } else if (m[3] == 0x10 && current.has_value()) {
+      motion.SetFocusAuto(!*current);
+    } else {
+      executable = false;
+    }
+  } else if (Matches(m, {0x01, 0x04, 0x3F}, 5)) {
+    const int number = m[4];
+    if (m[3] == 0x00) {
+      camera.ClearPreset(number);
+    } else if (m[3] == 0x01) {
+      camera.SavePreset(number);
+    } else if (const CameraState* preset = camera.preset(number);
+               m[3] == 0x02 && preset != nullptr) {
+      motion.Recall(*preset);
+    } else {
+      executable = false;
+    }
+  } else if (Matches(m, {0x01, 0x06, 0x01}, 7)) {
+    const float pan_speed =
+        std::min(1.0f, static_cast<float>(m[3]) / kMaxPanSpeed);
+    const float tilt_speed =
+        std::min(1.0f, static_cast<float>(m[4]) / kMaxTiltSpeed);
+    const float pan = m[5] == 0x01   ? -pan_speed
+                      : m[5] == 0x02 ? pan_speed
+                                     : 0;
+    const float tilt = m[6] == 0x01   ? tilt_speed
+                       : m[6] == 0x02 ? -tilt_speed
+                                      : 0;
+    motion.MovePanTilt(pan, tilt);
+    moving_.insert(id);
+  } else if (Matches(m, {0x01, 0x06, 0x02}, 13)) {
+    executable = caps.pan.has_value() && caps.tilt.has_value();
+    if (executable) {
+      const auto pan = static_cast<int16_t>(Nibbles(m, 5));
+      const auto tilt = static_cast<int16_t>(Nibbles(m, 9));
+      motion.SetPanTiltAbs(pan * kArcSecondsPerStep,
+                           tilt * kArcSecondsPerStep);
+    }
+  } else if (Matches(m, {0x01, 0x06, 0x04}, 3)) {
+    executable = caps.pan.has_value() && caps.tilt.has_value();
+    if (executable) motion.SetPanTiltAbs(0, 0);
+  } else if (Matches(m, {0x01, 0x06, 0x05}, 3)) {
+    // Pan-tilt reset recalibrates, UVC cameras do that on their own.
+  } else if (const int index = FindExtension(bridge_.profile(), m, 0x01);
+             index >= 0) {
+    // The value follows as two nibbles per byte.
+    const size_t offset = 1 + bridge_.profile().extensions[index].visca.size();
+    const int size = index < static_cast<int>(caps.extension_sizes.size())
+                         ? caps.extension_sizes[index]
+                         : 0;
+    if ((m.size() - offset) % 2 != 0) {
+      Send(address, kSyntaxError);
+      return;
+    }
+    executable = static_cast<int>(m.size() - offset) == 2 * size;
+    if (executable) {
+      std::string data;
+      for (size_t i = offset; i < m.size(); i += 2) {
+        data.push_back((m[i] & 0x0F) << 4 | (m[i + 1] & 0x0F));
+      }
+      motion.SetExtension(index, std::move(data));
+    }
+  } else {
+    Send(address, kSyntaxError);
+    return;
+  }
+  Send(address, kAck);
+  Send(address, executable ? kCompletion : kNotExecutable);
+}
+
+void ViscaSession::HandleInquiry(int address, int id, const Message& m) {
+  const Camera& camera = *bridge_.camera(id);
+  const Capabilities& caps = camera.capabilities();
+  const CameraState& state = camera.state();
+  std::string reply = "\x50";
+  if (!camera.ready()) {
+    Send(address, kInquiryNotExecutable);
+    return;
+  }
+
+  if (Matches(m, {0x09, 0x04, 0x00}, 3)) {
+    reply.push_back(0x02);
+  } else if (Matches(m, {0x09, 0x04, 0x47}, 3) && caps.zoom_abs.has_value() &&
+             state[Control::kZoomAbs].has_value()) {
+    reply += ToNibbles(ToViscaZoom(state, caps));
+  } else if (Matches(m, {0x09, 0x04, 0x48}, 3) &&
+             caps.focus_abs.has_value() &&
+             state[Control::kFocusAbs].has_value()) {
+    reply += ToNibbles(ToVisca(*state[Control::kFocusAbs], kFocusNear,
+                               kFocusFar, *caps.focus_abs));
+  } else if (Matches(m, {0x09, 0x04, 0x38}, 3) &&
+             state[Control::kFocusAuto].has_value()) {
+    reply.push_back(*state[Control::kFocusAuto] ? 0x02 : 0x03);
+  } else if (Matches(m, {0x09, 0x06, 0x12}, 3) &&
+             state[Control::kPan].has_value() &&
+             state[Control::kTilt].has_value()) {
+    reply += ToNibbles(static_cast<uint16_t>(
+        std::lround(*state[Control::kPan] / double{kArcSecondsPerStep})));
+    reply += ToNibbles(static_cast<uint16_t>(
+        std::lround(*state[Control::kTilt] / double{kArcSecondsPerStep})));
+  } else if (Matches(m, {0x09, 0x00, 0x02}, 3)) {
+    // Vendor Sony, model and ROM version 0, socket count 2.
+    reply += std::string({0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x02});
+  } else if (const int index = FindExtension(bridge_.profile(), m, 0x09);
+             index >= 0 &&
+             m.size() == 1 + bridge_.profile().extensions[index].visca.size()) {
+    // Answered from the shadow like the standard controls, the camera's
+    // polls keep it current.
+    const std::string* data = bridge_.camera(id)->extension(index);
+    if (data == nullptr) {
+      Send(address, kInquiryNotExecutable);
+      return;
+    }
+    for (const char byte : *data) {
+      reply.push_back((byte >> 4) & 0x0F);
+      reply.push_back(byte & 0x0F);
+    }
+  } else if (Matches(m, {0x09, 0x04, 0x47}, 3) ||
+             Matches(m, {0x09, 0x04, 0x48}, 3) ||
+             Matches(m, {0x09, 0x04, 0x38}, 3) ||
+             Matches(m, {0x09, 0x06, 0x12}, 3)) {
+    Send(address, kInquiryNotExecutable);
+    return;
+  } else {
+    Send(address, kSyntaxError);
+    return;
+  }
+  Send(address, reply);
+}
+
+ViscaSerial::ViscaSerial(std::unique_ptr<SerialPort> port, Bridge& bridge)
+    : port_(std::move(port)),
+      session_(bridge, [p = port_.get()](absl::string_view data) {
+        p->Send(data);
+      }) {
+  port_->SetDataCallback(
+      [this](absl::string_view data) { return session_.OnData(data); });
+}
+
+absl::StatusOr<std::unique_ptr<ViscaSerial>> ViscaSerial::Create(
+    EventLoop& loop, const std::string& path, int baud, Bridge& bridge) {
+  absl::StatusOr<std::unique_ptr<SerialPort>> port =
+      SerialPort::Create(loop, path, baud);
+  if (!port.ok()) return port.status();
+  return std::unique_ptr<ViscaSerial>(
+      new ViscaSerial(*std::move(port), bridge));
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,90 @@
+#ifndef VISCA2UVC_VISCA_H_
+#define VISCA2UVC_VISCA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "bridge.h"
+#include "client.h"
+#include "event_loop.h"
+#include "serial.h"
+
+namespace visca2uvc {
+
+// Decodes VISCA packets from one controller and applies them to the cameras,
+// independent of the transport.
+//
+// Cameras answer at chain addresses 1..7. Until the controller sends Address
+// Set, address N is camera N; afterwards the cameras take consecutive
+// addresses from the one in the broadcast, as a daisy chain would, and the
+// reply tells the controller how many there are. IF_Clear is answered for
+// the whole chain or one camera.
+//
+// Commands: zoom and focus stop/tele/wide/far/near with variable speed,
+// direct zoom and focus positions, with digital zoom above 4000h when the
+// camera has it, auto/manual focus, pan-tilt drive with speeds, absolute
+// position, home, memory set/reset/recall and power.
+// Inquiries: power, zoom and focus position, focus mode, pan-tilt position
+// and version. Extension controls with a VISCA mapping in the device profile
+// are written and read with their command and inquiry, which like the other
+// inquiries is answered from the shadow state. Commands are
+// acknowledged and completed right away, the motion controller sends them
+// on its next tick, or refused with Command Buffer Full while the camera
+// is congested, except stops. Commands that move the camera are refused with
+// Command Not Executable while another client holds its control lock.
+// The drives a session started are stopped when it ends, unless another
+// client took them over.
+class ViscaSession {
+ public:
+  using Reply = std::function<void(absl::string_view)>;
+
+  ViscaSession(Bridge& bridge, Reply reply)
+      : bridge_(bridge), reply_(std::move(reply)) {}
+  ~ViscaSession();
+
+  // Returns how many bytes of `data` were consumed.
+  size_t OnData(absl::string_view data);
+
+ private:
+  void HandlePacket(absl::string_view packet);
+  // `message` holds the bytes between the header and the terminator.
+  void HandleCommand(int address, int id, const std::vector<uint8_t>& message);
+  void HandleInquiry(int address, int id, const std::vector<uint8_t>& message);
+  // Sends `payload` from chain address `address`, framed as a reply.
+  void Send(int address, absl::string_view payload);
+  // Camera at chain address `address`, or 0.
+  int CameraId(int address) const;
+
+  Bridge& bridge_;
+  const Reply reply_;
+  // Chain address of camera 1.
+  int first_address_ = 1;
+  // Cameras this session set in motion.
+  absl::flat_hash_set<int> moving_;
+  // Who the session serves, for stopping its drives when it ends.
+  ClientId client_;
+};
+
+// Reads VISCA from a serial line or pty, e.g. an RS-232 or RS-422 joystick.
+class ViscaSerial {
+ public:
+  static absl::StatusOr<std::unique_ptr<ViscaSerial>> Create(
+      EventLoop& loop, const std::string& path, int baud, Bridge& bridge);
+
+ private:
+  ViscaSerial(std::unique_ptr<SerialPort> port, Bridge& bridge);
+
+  std::unique_ptr<SerialPort> port_;
+  ViscaSession session_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_VISCA_H_
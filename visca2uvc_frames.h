@@ -0,0 +1,230 @@
+/* Shared memory video frames of visca2uvc, for local consumers such as
+ * tracking or recording software.
+ *
+ * A consumer connects to the daemon's --frame_socket, sends the 1-based
+ * camera number as one byte and receives a read-only memfd with a
+ * `struct v2u_frames` and an eventfd that the daemon writes once per frame.
+ * Frames are the camera's raw MJPEG or YUYV payload, read in place without
+ * copying. All consumers of a camera share one ring, so a slow consumer
+ * doesn't hold back the others but may see its frame overwritten: check
+ * v2u_frame_valid after using the data.
+ *
+ *   struct v2u_frame_client client;
+ *   if (v2u_frames_connect("/run/visca2uvc-frames.sock", 1, &client) < 0) ...
+ *   uint64_t count;
+ *   read(client.event_fd, &count, sizeof(count));
+ *   struct v2u_frame frame;
+ *   if (v2u_frame_latest(&client, &frame) == 0) {
+ *     decode(frame.data, frame.size);
+ *     if (!v2u_frame_valid(&client, &frame)) discard();
+ *   }
+ *   v2u_frames_close(&client);
+ *
+ * Plain C, needs GCC or Clang for the atomic builtins.
+ */
+
+#ifndef VISCA2UVC_FRAMES_H_
+#define VISCA2UVC_FRAMES_H_
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define V2U_FRAMES_MAGIC 0x46553256u /* "V2UF" */
+#define V2U_FRAMES_VERSION 1u
+#define V2U_MAX_FRAME_SLOTS 64u
+
+enum v2u_frame_format {
+  V2U_FRAME_MJPEG = 1,
+  V2U_FRAME_YUYV = 2,
+};
+
+/* Written by the daemon under a sequence lock: `sequence` is 2n + 1 while
+ * frame n is being written to the slot and 2n + 2 once it is complete. */
+struct v2u_frame_slot {
+  uint64_t sequence;
+  /* CLOCK_MONOTONIC time at which the frame was completely received. */
+  uint64_t capture_ns;
+  /* The camera's frame counter, gaps mean dropped frames. */
+  uint32_t uvc_sequence;
+  uint32_t size;
+};
+
+struct v2u_frames {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t camera;
+  uint32_t format; /* enum v2u_frame_format */
+  uint32_t width;
+  uint32_t height;
+  uint32_t slot_count;
+  uint32_t slot_size; /* Maximum frame size in bytes. */
+  /* Slot i's data starts at data_offset + i * slot_size from the start of
+   * the mapping, page aligned. */
+  uint64_t data_offset;
+  /* Number of frames written. Frame n is in slot n % slot_count. */
+  uint64_t head __attribute__((aligned(64)));
+  struct v2u_frame_slot slots[V2U_MAX_FRAME_SLOTS];
+};
+
+struct v2u_frame_client {
+  int socket_fd;
+  int event_fd;
+  const struct v2u_frames* frames;
+  size_t size;
+};
+
+/* A frame in the ring, valid until its slot is reused. */
+struct v2u_frame {
+  uint64_t number;
+  uint64_t capture_ns;
+  uint32_t uvc_sequence;
+  uint32_t size;
+  const uint8_t* data;
+};
+
+/* Returns 0 on success, -1 with errno set on failure. errno is ENOENT if the
+ * daemon doesn't export frames of `camera`. */
+static inline int v2u_frames_connect(const char* path, int camera,
+                                     struct v2u_frame_client* client) {
+  struct sockaddr_un addr;
+  char byte = (char)camera;
+  struct iovec iov = {&byte, 1};
+  union {
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  struct stat st;
+  int fds[2];
+  void* frames;
+  ssize_t received;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  client->socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (client->socket_fd < 0) return -1;
+  if (connect(client->socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      write(client->socket_fd, &byte, 1) != 1) {
+    goto fail;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  received = recvmsg(client->socket_fd, &msg, MSG_CMSG_CLOEXEC);
+  if (received == 0) errno = ENOENT;
+  if (received != 1) goto fail;
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+    errno = EPROTO;
+    goto fail;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  if (fstat(fds[0], &st) < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    goto fail;
+  }
+  frames = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fds[0], 0);
+  close(fds[0]);
+  if (frames == MAP_FAILED) {
+    close(fds[1]);
+    goto fail;
+  }
+  client->frames = (const struct v2u_frames*)frames;
+  client->size = st.st_size;
+  client->event_fd = fds[1];
+  if ((size_t)st.st_size < sizeof(struct v2u_frames) ||
+      client->frames->magic != V2U_FRAMES_MAGIC ||
+      client->frames->version != V2U_FRAMES_VERSION) {
+    munmap(frames, st.st_size);
+    close(fds[1]);
+    errno = EPROTO;
+    goto fail;
+  }
+  return 0;
+
+fail:
+  close(client->socket_fd);
+  return -1;
+}
+
+static inline void v2u_frames_close(struct v2u_frame_client* client) {
+  munmap((void*)client->frames, client->size);
+  close(client->event_fd);
+  close(client->socket_fd);
+}
+
+/* Looks up frame `number`. Returns 0 on success, -1 with errno EAGAIN if it
+ * hasn't been written yet or ENOENT if it was already overwritten. */
+static inline int v2u_frame_get(const struct v2u_frame_client* client,
+                                uint64_t number, struct v2u_frame* frame) {
+  const struct v2u_frames* frames = client->frames;
+  const struct v2u_frame_slot* slot =
+      &frames->slots[number % frames->slot_count];
+  const uint64_t complete = 2 * number + 2;
+  const uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+  if (sequence != complete) {
+    errno = sequence < complete ? EAGAIN : ENOENT;
+    return -1;
+  }
+  frame->number = number;
+  frame->capture_ns = __atomic_load_n(&slot->capture_ns, __ATOMIC_RELAXED);
+  frame->uvc_sequence = __atomic_load_n(&slot->uvc_sequence, __ATOMIC_RELAXED);
+  frame->size = __atomic_load_n(&slot->size, __ATOMIC_RELAXED);
+  frame->data = (const uint8_t*)frames + frames->data_offset +
+                (number % frames->slot_count) * (uint64_t)frames->slot_size;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != complete ||
+      frame->size > frames->slot_size) {
+    errno = ENOENT;
+    return -1;
+  }
+  return 0;
+}
+
+/* Looks up the newest complete frame. Returns 0 on success, -1 with errno
+ * EAGAIN if there is none yet. */
+static inline int v2u_frame_latest(const struct v2u_frame_client* client,
+                                   struct v2u_frame* frame) {
+  uint64_t head;
+  do {
+    head = __atomic_load_n(&client->frames->head, __ATOMIC_ACQUIRE);
+    if (head == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+  } while (v2u_frame_get(client, head - 1, frame) < 0);
+  return 0;
+}
+
+/* Returns 1 if `frame` was still intact after its data was used, 0 if the
+ * daemon started overwriting it. */
+static inline int v2u_frame_valid(const struct v2u_frame_client* client,
+                                  const struct v2u_frame* frame) {
+  const struct v2u_frames* frames = client->frames;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(
+             &frames->slots[frame->number % frames->slot_count].sequence,
+             __ATOMIC_RELAXED) == 2 * frame->number + 2;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VISCA2UVC_FRAMES_H_ */
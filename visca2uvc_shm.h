@@ -0,0 +1,216 @@
+/* Shared memory command channel of visca2uvc, for local high-rate clients
+ * such as auto-tracking.
+ *
+ * A client connects once to the daemon's --shm_socket and receives a memfd
+ * with a `struct v2u_shm` and an eventfd. From then on it submits commands
+ * into a single-producer single-consumer ring and reads the cameras' shadow
+ * state straight from shared memory, without socket syscalls. The eventfd is
+ * only written when the daemon may have drained the ring.
+ *
+ *   struct v2u_client client;
+ *   if (v2u_connect("/run/visca2uvc.sock", &client) < 0) ...
+ *   struct v2u_command move = {V2U_MOVE_PANTILT, 1};
+ *   move.speed[0] = 0.25f;
+ *   v2u_submit(&client, &move);
+ *   int32_t zoom;
+ *   v2u_read_state(&client, 1, V2U_ZOOM_ABS, &zoom);
+ *   v2u_close(&client);
+ *
+ * Plain C, needs GCC or Clang for the atomic builtins.
+ */
+
+#ifndef VISCA2UVC_SHM_H_
+#define VISCA2UVC_SHM_H_
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define V2U_SHM_MAGIC 0x56325553u /* "V2US" */
+#define V2U_SHM_VERSION 1u
+#define V2U_RING_SIZE 256u /* Power of two. */
+#define V2U_MAX_CAMERAS 16u
+#define V2U_NUM_CONTROLS 8u
+
+/* Command types. Speeds are -1..1, values are raw device positions. */
+enum v2u_command_type {
+  V2U_MOVE_PANTILT = 1, /* speed[0] pan, speed[1] tilt */
+  V2U_MOVE_ZOOM = 2,    /* speed[0] */
+  V2U_MOVE_FOCUS = 3,   /* speed[0] */
+  V2U_STOP = 4,         /* Also ends tracking. */
+  V2U_SET_PANTILT = 5, /* value[0] pan, value[1] tilt */
+  V2U_SET_ZOOM = 6,    /* value[0] */
+  V2U_SET_FOCUS = 7,   /* value[0] */
+  V2U_TRACK = 8,       /* speed[0] x, speed[1] y offset of the target, -1..1 */
+};
+
+/* Indices into `v2u_camera_state.values`, same as the daemon's controls. */
+enum v2u_control {
+  V2U_ZOOM_ABS = 0,
+  V2U_PAN = 1,
+  V2U_TILT = 2,
+  V2U_FOCUS_ABS = 3,
+  V2U_FOCUS_AUTO = 4,
+  V2U_DIGITAL_ZOOM = 5,
+};
+
+struct v2u_command {
+  uint8_t type;
+  uint8_t camera; /* 1-based */
+  uint16_t reserved;
+  float speed[2];
+  int32_t value[2];
+};
+
+/* Written by the daemon under a sequence lock: `sequence` is odd while the
+ * values are being updated. */
+struct v2u_camera_state {
+  uint32_t sequence;
+  uint32_t present; /* Bit i set if values[i] is known. */
+  int32_t values[V2U_NUM_CONTROLS];
+};
+
+struct v2u_shm {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_cameras;
+  /* Next slot the client writes, only written by the client. */
+  uint32_t head __attribute__((aligned(64)));
+  /* Next slot the daemon reads, only written by the daemon. */
+  uint32_t tail __attribute__((aligned(64)));
+  struct v2u_command ring[V2U_RING_SIZE] __attribute__((aligned(64)));
+  struct v2u_camera_state cameras[V2U_MAX_CAMERAS];
+};
+
+struct v2u_client {
+  int socket_fd;
+  int event_fd;
+  struct v2u_shm* shm;
+};
+
+/* Returns 0 on success, -1 with errno set on failure. */
+static inline int v2u_connect(const char* path, struct v2u_client* client) {
+  struct sockaddr_un addr;
+  char byte;
+  struct iovec iov = {&byte, 1};
+  union {
+    char buf[CMSG_SPACE(2 * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg;
+  struct cmsghdr* cmsg;
+  int fds[2];
+  void* shm;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  client->socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (client->socket_fd < 0) return -1;
+  if (connect(client->socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    goto fail;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  if (recvmsg(client->socket_fd, &msg, MSG_CMSG_CLOEXEC) != 1) goto fail;
+  cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+    errno = EPROTO;
+    goto fail;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  shm = mmap(NULL, sizeof(struct v2u_shm), PROT_READ | PROT_WRITE, MAP_SHARED,
+             fds[0], 0);
+  close(fds[0]);
+  if (shm == MAP_FAILED) {
+    close(fds[1]);
+    goto fail;
+  }
+  client->shm = (struct v2u_shm*)shm;
+  client->event_fd = fds[1];
+  if (client->shm->magic != V2U_SHM_MAGIC ||
+      client->shm->version != V2U_SHM_VERSION) {
+    munmap(shm, sizeof(struct v2u_shm));
+    close(fds[1]);
+    errno = EPROTO;
+    goto fail;
+  }
+  return 0;
+
+fail:
+  close(client->socket_fd);
+  return -1;
+}
+
+static inline void v2u_close(struct v2u_client* client) {
+  munmap(client->shm, sizeof(struct v2u_shm));
+  close(client->event_fd);
+  close(client->socket_fd);
+}
+
+/* Returns 0 on success, -1 with errno EAGAIN if the ring is full. */
+static inline int v2u_submit(struct v2u_client* client,
+                             const struct v2u_command* command) {
+  struct v2u_shm* shm = client->shm;
+  const uint32_t head = shm->head;
+  const uint32_t tail = __atomic_load_n(&shm->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= V2U_RING_SIZE) {
+    errno = EAGAIN;
+    return -1;
+  }
+  shm->ring[head & (V2U_RING_SIZE - 1)] = *command;
+  __atomic_store_n(&shm->head, head + 1, __ATOMIC_SEQ_CST);
+  /* The daemon drains the whole ring per wakeup and rechecks `head` after
+   * publishing `tail`, so it only needs a wakeup if it had consumed all
+   * earlier commands. */
+  if (__atomic_load_n(&shm->tail, __ATOMIC_SEQ_CST) == head) {
+    const uint64_t one = 1;
+    if (write(client->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Reads one control of a camera. Returns 0 on success, -1 with errno ENOENT
+ * if the value is unknown. */
+static inline int v2u_read_state(const struct v2u_client* client, int camera,
+                                 enum v2u_control control, int32_t* value) {
+  const struct v2u_camera_state* state;
+  uint32_t before, present;
+  if (camera < 1 || (uint32_t)camera > client->shm->num_cameras) {
+    errno = ENOENT;
+    return -1;
+  }
+  state = &client->shm->cameras[camera - 1];
+  do {
+    before = __atomic_load_n(&state->sequence, __ATOMIC_ACQUIRE);
+    present = __atomic_load_n(&state->present, __ATOMIC_RELAXED);
+    *value = __atomic_load_n(&state->values[control], __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((before & 1) ||
+           before != __atomic_load_n(&state->sequence, __ATOMIC_RELAXED));
+  if (!(present & (1u << control))) {
+    errno = ENOENT;
+    return -1;
+  }
+  return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VISCA2UVC_SHM_H_ */
@@ -0,0 +1,473 @@
+#include "visca_upstream.h"
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/time/time.h"
+#include "net.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr uint8_t kTerminator = 0xFF;
+constexpr size_t kMaxPacket = 16;
+constexpr int kMaxAddress = 7;
+constexpr absl::Duration kReplyTimeout = absl::Milliseconds(300);
+constexpr absl::Duration kReconnectDelay = absl::Seconds(2);
+
+// VISCA over IP payload types, in the 8 byte header before every packet.
+constexpr uint16_t kViscaCommand = 0x0100;
+constexpr uint16_t kViscaInquiry = 0x0110;
+constexpr uint16_t kViscaReply = 0x0111;
+constexpr uint16_t kControlCommand = 0x0200;
+constexpr size_t kIpHeader = 8;
+
+// Zoom positions from wide to tele.
+constexpr int32_t kZoomTele = 0x4000;
+// Focus positions from infinity (1000h) to near (F000h), reported inverted
+// so that values grow towards infinity like UVC's.
+constexpr int32_t kFocusNear = 0xF000;
+constexpr int32_t kFocusFar = 0x1000;
+// Pan-tilt positions are signed steps of 0.075 degrees.
+constexpr int32_t kArcSecondsPerStep = 270;
+constexpr int32_t kMaxPanSteps = 2267;
+constexpr int32_t kMinTiltSteps = -400;
+constexpr int32_t kMaxTiltSteps = 1200;
+constexpr uint8_t kMaxZoomSpeed = 8;
+constexpr uint8_t kMaxFocusSpeed = 8;
+constexpr uint8_t kMaxPanSpeed = 0x18;
+constexpr uint8_t kMaxTiltSpeed = 0x17;
+
+// Coalesced requests share these leading bytes: category and command.
+constexpr size_t kKindSize = 3;
+
+std::string ToNibbles(int value) {
+  std::string result;
+  for (int shift = 12; shift >= 0; shift -= 4) {
+    result.push_back((value >> shift) & 0x0F);
+  }
+  return result;
+}
+
+int Nibbles(absl::string_view data, size_t offset) {
+  int value = 0;
+  for (size_t i = offset; i < offset + 4; ++i) {
+    value = value << 4 | (data[i] & 0x0F);
+  }
+  return value;
+}
+
+// Drive byte of zoom and focus commands: stop, or 2p/3p with speed p.
+uint8_t DriveByte(int8_t direction, uint8_t speed, uint8_t max_speed,
+                  bool positive_is_2p) {
+  if (direction == 0) return 0x00;
+  const uint8_t p = std::clamp<int>(speed, 1, max_speed) - 1;
+  return ((direction > 0) == positive_is_2p ? 0x20 : 0x30) | p;
+}
+
+void PutU16(std::string& out, uint16_t value) {
+  out.push_back(value >> 8);
+  out.push_back(value & 0xFF);
+}
+
+void PutU32(std::string& out, uint32_t value) {
+  PutU16(out, value >> 16);
+  PutU16(out, value & 0xFFFF);
+}
+
+bool Inquiry(const CommandQueue::Command& command) {
+  return command.command_class == CommandClass::kRefresh;
+}
+
+std::string EndpointKey(bool tcp, const sockaddr_in& address) {
+  return absl::StrCat(tcp ? "tcp:" : "udp:", FormatIpv4(address), ":",
+                      ntohs(address.sin_port));
+}
+
+}  // namespace
+
+absl::StatusOr<ViscaUpstreamSpec> ParseViscaUpstream(absl::string_view spec) {
+  const absl::Status invalid = absl::InvalidArgumentError(absl::StrCat(
+      "Expected udp|tcp:<ip>:<port>[/<address>], got: ", spec));
+  ViscaUpstreamSpec result;
+  std::vector<absl::string_view> address_parts =
+      absl::StrSplit(spec, absl::MaxSplits('/', 1));
+  if (address_parts.size() == 2 &&
+      (!absl::SimpleAtoi(address_parts[1], &result.chain_address) ||
+       result.chain_address < 1 || result.chain_address > kMaxAddress)) {
+    return invalid;
+  }
+  std::vector<absl::string_view> parts = absl::StrSplit(address_parts[0], ':');
+  int port = 0;
+  if (parts.size() != 3 || (parts[0] != "udp" && parts[0] != "tcp") ||
+      !absl::SimpleAtoi(parts[2], &port) || port < 1 || port > 65535) {
+    return invalid;
+  }
+  result.tcp = parts[0] == "tcp";
+  absl::StatusOr<sockaddr_in> address = ParseIpv4(parts[1], port);
+  if (!address.ok()) return address.status();
+  result.address = *address;
+  return result;
+}
+
+ViscaLink::ViscaLink(EventLoop& loop, bool tcp, const sockaddr_in& address)
+    : loop_(loop), tcp_(tcp), address_(address) {
+  Connect();
+}
+
+ViscaLink::~ViscaLink() {
+  loop_.CancelTimer(reconnect_timer_);
+  if (fd_.valid()) loop_.UnwatchFd(fd_.get());
+}
+
+void ViscaLink::Connect() {
+  reconnect_timer_ = 0;
+  fd_.Reset(socket(AF_INET,
+                   (tcp_ ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK |
+                       SOCK_CLOEXEC,
+                   0));
+  if (!fd_.valid()) {
+    Disconnect(absl::ErrnoToStatus(errno, "socket"));
+    return;
+  }
+  // Connected UDP sockets only receive from the camera.
+  if (connect(fd_.get(), reinterpret_cast<const sockaddr*>(&address_),
+              sizeof(address_)) < 0 &&
+      errno != EINPROGRESS) {
+    Disconnect(absl::ErrnoToStatus(errno, "connect"));
+    return;
+  }
+  loop_.WatchFd(fd_.get(), tcp_ ? POLLOUT : POLLIN,
+                [this](short revents) { OnEvents(revents); });
+  if (!tcp_) {
+    connected_ = true;
+    // Cameras drop packets whose sequence number isn't the next one
+    // expected, start over.
+    std::string reset;
+    PutU16(reset, kControlCommand);
+    PutU16(reset, 1);
+    PutU32(reset, 0);
+    reset.push_back(0x01);
+    sequence_ = 0;
+    send(fd_.get(), reset.data(), reset.size(), MSG_NOSIGNAL);
+  }
+}
+
+void ViscaLink::OnEvents(short revents) {
+  if (tcp_ && !connected_) {
+    int error = 0;
+    socklen_t size = sizeof(error);
+    getsockopt(fd_.get(), SOL_SOCKET, SO_ERROR, &error, &size);
+    if (error != 0) {
+      Disconnect(absl::ErrnoToStatus(error, "connect"));
+      return;
+    }
+    connected_ = true;
+    std::cerr << EndpointKey(tcp_, address_) << ": connected\n";
+    loop_.UpdateFd(fd_.get(), POLLIN);
+    return;
+  }
+  if (revents & (POLLIN | POLLERR | POLLHUP)) Read();
+}
+
+void ViscaLink::Read() {
+  char buffer[1024];
+  const ssize_t n = recv(fd_.get(), buffer, sizeof(buffer), 0);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+  if (!tcp_) {
+    // Nobody listening yet, the backends time out until the camera is up.
+    if (n < 0) return;
+    absl::string_view datagram(buffer, n);
+    if (datagram.size() <= kIpHeader) return;
+    const uint16_t type = static_cast<uint8_t>(datagram[0]) << 8 |
+                          static_cast<uint8_t>(datagram[1]);
+    if (type == kViscaReply) Dispatch(datagram.substr(kIpHeader));
+    return;
+  }
+  if (n <= 0) {
+    Disconnect(n < 0 ? absl::ErrnoToStatus(errno, "recv")
+                     : absl::UnavailableError("Connection closed"));
+    return;
+  }
+  input_.append(buffer, n);
+  size_t end;
+  while ((end = input_.find(static_cast<char>(kTerminator))) !=
+         std::string::npos) {
+    Dispatch(absl::string_view(input_).substr(0, end + 1));
+    input_.erase(0, end + 1);
+  }
+  // No terminator in sight, resynchronize.
+  if (input_.size() > kMaxPacket) input_.clear();
+}
+
+void ViscaLink::Dispatch(absl::string_view packet) {
+  // Replies start with (address + 8) << 4.
+  if (packet.size() < 3) return;
+  const int address = (static_cast<uint8_t>(packet[0]) >> 4) - 8;
+  if (auto it = receivers_.find(address);
+      it != receivers_.end() && it->second) {
+    it->second(packet);
+  }
+}
+
+bool ViscaLink::Send(absl::string_view packet, bool inquiry) {
+  if (!connected_) return false;
+  std::string datagram;
+  if (!tcp_) {
+    PutU16(datagram, inquiry ? kViscaInquiry : kViscaCommand);
+    PutU16(datagram, packet.size());
+    PutU32(datagram, sequence_++);
+  }
+  datagram.append(packet.data(), packet.size());
+  if (send(fd_.get(), datagram.data(), datagram.size(), MSG_NOSIGNAL) < 0) {
+    if (errno == EAGAIN || !tcp_) return false;
+    Disconnect(absl::ErrnoToStatus(errno, "send"));
+    return false;
+  }
+  return true;
+}
+
+void ViscaLink::Disconnect(const absl::Status& status) {
+  std::cerr << EndpointKey(tcp_, address_) << ": " << status
+            << ", reconnecting\n";
+  if (fd_.valid()) loop_.UnwatchFd(fd_.get());
+  fd_.Reset();
+  connected_ = false;
+  input_.clear();
+  reconnect_timer_ = loop_.AddTimer(kReconnectDelay, [this] { Connect(); });
+}
+
+ViscaLink& ViscaLinkPool::Get(bool tcp, const sockaddr_in& address) {
+  std::unique_ptr<ViscaLink>& link = links_[EndpointKey(tcp, address)];
+  if (link == nullptr) link = std::make_unique<ViscaLink>(loop_, tcp, address);
+  return *link;
+}
+
+ViscaBackend::ViscaBackend(EventLoop& loop, ViscaLink& link,
+                           int chain_address,
+                           const CommandDeadlines& deadlines, int queue_size)
+    : loop_(loop),
+      link_(link),
+      chain_address_(chain_address),
+      queue_(deadlines, queue_size) {
+  link_.SetReceiver(chain_address_,
+                    [this](absl::string_view packet) { OnReply(packet); });
+}
+
+ViscaBackend::~ViscaBackend() {
+  loop_.CancelTimer(timeout_);
+  link_.SetReceiver(chain_address_, nullptr);
+}
+
+Capabilities ViscaBackend::Probe() {
+  Capabilities capabilities;
+  capabilities.zoom_abs = Range{0, kZoomTele};
+  capabilities.pan = Range{-kMaxPanSteps * kArcSecondsPerStep,
+                           kMaxPanSteps * kArcSecondsPerStep};
+  capabilities.tilt = Range{kMinTiltSteps * kArcSecondsPerStep,
+                            kMaxTiltSteps * kArcSecondsPerStep};
+  capabilities.focus_abs = Range{0, kFocusNear - kFocusFar};
+  capabilities.zoom_speed = kMaxZoomSpeed;
+  capabilities.pan_speed = kMaxPanSpeed;
+  capabilities.tilt_speed = kMaxTiltSpeed;
+  capabilities.focus_speed = kMaxFocusSpeed;
+  return capabilities;
+}
+
+void ViscaBackend::Refresh() {
+  // Refreshes while the link is down would only fail.
+  if (!link_.connected()) return;
+  for (const char inquiry : {'\x47', '\x48', '\x38'}) {
+    Enqueue(std::string({'\x09', '\x04', inquiry}), CommandClass::kRefresh)
+        .IgnoreError();
+  }
+  Enqueue(std::string({'\x09', '\x06', '\x12'}), CommandClass::kRefresh)
+      .IgnoreError();
+}
+
+absl::Status ViscaBackend::SetZoomAbs(int32_t value) {
+  return Enqueue(absl::StrCat(std::string({'\x01', '\x04', '\x47'}),
+                              ToNibbles(std::clamp(value, 0, kZoomTele))),
+                 CommandClass::kAbsolute);
+}
+
+absl::Status ViscaBackend::SetZoomRel(const ZoomRel& zoom) {
+  // Tele is 2p, like UVC's positive direction.
+  const uint8_t drive =
+      DriveByte(zoom.zoom_rel, zoom.speed, kMaxZoomSpeed, true);
+  return Enqueue(std::string({'\x01', '\x04', '\x07',
+                              static_cast<char>(drive)}),
+                 drive == 0 ? CommandClass::kStop : CommandClass::kMotion);
+}
+
+absl::Status ViscaBackend::SetPanTiltAbs(const PanTiltAbs& pantilt) {
+  const int pan = std::clamp(pantilt.pan / kArcSecondsPerStep, -kMaxPanSteps,
+                             kMaxPanSteps);
+  const int tilt = std::clamp(pantilt.tilt / kArcSecondsPerStep,
+                              kMinTiltSteps, kMaxTiltSteps);
+  return Enqueue(absl::StrCat(std::string({'\x01', '\x06', '\x02',
+                                           static_cast<char>(kMaxPanSpeed),
+                                           static_cast<char>(kMaxTiltSpeed)}),
+                              ToNibbles(pan & 0xFFFF),
+                              ToNibbles(tilt & 0xFFFF)),
+                 CommandClass::kAbsolute);
+}
+
+absl::Status ViscaBackend::SetPanTiltRel(const PanTiltRel& pantilt) {
+  // UVC pans clockwise and tilts up for positive values, VISCA drives left
+  // and up with 01, right and down with 02, and stops with 03.
+  const char pan = pantilt.pan_rel > 0 ? 0x02 : pantilt.pan_rel < 0 ? 0x01
+                                                                    : 0x03;
+  const char tilt = pantilt.tilt_rel > 0   ? 0x01
+                    : pantilt.tilt_rel < 0 ? 0x02
+                                           : 0x03;
+  const char pan_speed = std::clamp<int>(pantilt.pan_speed, 1, kMaxPanSpeed);
+  const char tilt_speed =
+      std::clamp<int>(pantilt.tilt_speed, 1, kMaxTiltSpeed);
+  return Enqueue(
+      std::string({'\x01', '\x06', '\x01', pan_speed, tilt_speed, pan, tilt}),
+      pan == 0x03 && tilt == 0x03 ? CommandClass::kStop
+                                  : CommandClass::kMotion);
+}
+
+absl::Status ViscaBackend::SetFocusAbs(int32_t value) {
+  const int32_t visca =
+      kFocusNear - std::clamp(value, 0, kFocusNear - kFocusFar);
+  return Enqueue(absl::StrCat(std::string({'\x01', '\x04', '\x48'}),
+                              ToNibbles(visca)),
+                 CommandClass::kAbsolute);
+}
+
+absl::Status ViscaBackend::SetFocusRel(const FocusRel& focus) {
+  // UVC's positive direction is near, 3p in VISCA.
+  const uint8_t drive =
+      DriveByte(focus.focus_rel, focus.speed, kMaxFocusSpeed, false);
+  return Enqueue(std::string({'\x01', '\x04', '\x08',
+                              static_cast<char>(drive)}),
+                 drive == 0 ? CommandClass::kStop : CommandClass::kMotion);
+}
+
+absl::Status ViscaBackend::SetFocusAuto(bool enabled) {
+  return Enqueue(
+      std::string({'\x01', '\x04', '\x38', enabled ? '\x02' : '\x03'}),
+      CommandClass::kAbsolute);
+}
+
+absl::Status ViscaBackend::Enqueue(std::string message,
+                                   CommandClass command_class) {
+  if (!link_.connected()) {
+    return absl::UnavailableError("VISCA camera not connected");
+  }
+  std::string key = message.substr(0, kKindSize);
+  if (!queue_.Push(std::move(key), std::move(message), command_class,
+                   absl::Now())) {
+    return absl::ResourceExhaustedError("VISCA camera queue full");
+  }
+  if (!outstanding_.has_value()) SendNext();
+  return absl::OkStatus();
+}
+
+void ViscaBackend::SendNext() {
+  while (std::optional<CommandQueue::Command> request =
+             queue_.Pop(absl::Now())) {
+    std::string packet(1, static_cast<char>(0x80 | chain_address_));
+    packet.append(request->message);
+    packet.push_back(kTerminator);
+    if (!link_.Send(packet, Inquiry(*request))) continue;
+    outstanding_ = *std::move(request);
+    timeout_ = loop_.AddTimer(kReplyTimeout, [this] {
+      timeout_ = 0;
+      if (responding_) {
+        std::cerr << "VISCA camera " << chain_address_
+                  << " not responding\n";
+        responding_ = false;
+      }
+      outstanding_.reset();
+      SendNext();
+    });
+    return;
+  }
+}
+
+void ViscaBackend::OnReply(absl::string_view packet) {
+  if (!responding_) {
+    std::cerr << "VISCA camera " << chain_address_ << " responding again\n";
+    responding_ = true;
+  }
+  // Payload between the header and the terminator.
+  const absl::string_view payload = packet.substr(1, packet.size() - 2);
+  const uint8_t type = static_cast<uint8_t>(payload[0]) >> 4;
+  const uint16_t socket = uint16_t{1} << (payload[0] & 0x0F);
+  if ((type == 0x5 || type == 0x6) && (executing_ & socket & ~1)) {
+    // Completion or error of an earlier command, not the outstanding one.
+    executing_ &= ~socket;
+    return;
+  }
+  if (!outstanding_.has_value()) return;
+  switch (type) {
+    case 0x4:
+      // Acknowledged, the camera executes it on its own.
+      if (!Inquiry(*outstanding_)) {
+        executing_ |= socket;
+        Finish();
+      }
+      break;
+    case 0x5:
+      if (Inquiry(*outstanding_) && payload.size() > 1) {
+        HandleInquiryReply(*outstanding_, payload.substr(1));
+        Finish();
+      } else if (!Inquiry(*outstanding_) && payload.size() == 1) {
+        // Completed without a separate acknowledgement.
+        Finish();
+      }
+      break;
+    case 0x6:
+      Finish();
+      break;
+  }
+}
+
+void ViscaBackend::HandleInquiryReply(const CommandQueue::Command& request,
+                                      absl::string_view payload) {
+  const absl::string_view kind = absl::string_view(request.message);
+  if (kind == absl::string_view("\x09\x04\x47", 3) && payload.size() == 4) {
+    const Value values[] = {{Control::kZoomAbs, Nibbles(payload, 0)}};
+    Report(values);
+  } else if (kind == absl::string_view("\x09\x04\x48", 3) &&
+             payload.size() == 4) {
+    const int32_t focus =
+        kFocusNear - std::clamp(Nibbles(payload, 0), kFocusFar, kFocusNear);
+    const Value values[] = {{Control::kFocusAbs, focus}};
+    Report(values);
+  } else if (kind == absl::string_view("\x09\x04\x38", 3) &&
+             payload.size() == 1) {
+    const Value values[] = {{Control::kFocusAuto, payload[0] == 0x02}};
+    Report(values);
+  } else if (kind == absl::string_view("\x09\x06\x12", 3) &&
+             payload.size() == 8) {
+    const auto pan = static_cast<int16_t>(Nibbles(payload, 0));
+    const auto tilt = static_cast<int16_t>(Nibbles(payload, 4));
+    const Value values[] = {{Control::kPan, pan * kArcSecondsPerStep},
+                            {Control::kTilt, tilt * kArcSecondsPerStep}};
+    Report(values);
+  }
+}
+
+void ViscaBackend::Finish() {
+  loop_.CancelTimer(timeout_);
+  timeout_ = 0;
+  outstanding_.reset();
+  SendNext();
+}
+
+}  // namespace visca2uvc
@@ -0,0 +1,142 @@
+#ifndef VISCA2UVC_VISCA_UPSTREAM_H_
+#define VISCA2UVC_VISCA_UPSTREAM_H_
+
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "camera.h"
+#include "command_queue.h"
+#include "event_loop.h"
+#include "fd.h"
+
+namespace visca2uvc {
+
+// Where an upstream VISCA camera is reached.
+struct ViscaUpstreamSpec {
+  // Raw VISCA over TCP, e.g. serial-to-IP converters, or Sony's VISCA over
+  // IP over UDP.
+  bool tcp = false;
+  sockaddr_in address = {};
+  // Chain address of the camera behind the endpoint.
+  int chain_address = 1;
+};
+
+// Parses "udp:<ip>:<port>" or "tcp:<ip>:<port>", optionally followed by
+// "/<chain address>".
+absl::StatusOr<ViscaUpstreamSpec> ParseViscaUpstream(absl::string_view spec);
+
+// A connection to an upstream VISCA endpoint, shared by all cameras behind
+// it. TCP connections are re-established after failures.
+class ViscaLink {
+ public:
+  // Called with every reply packet from the camera at its chain address.
+  using Receiver = std::function<void(absl::string_view packet)>;
+
+  ViscaLink(EventLoop& loop, bool tcp, const sockaddr_in& address);
+  ~ViscaLink();
+
+  void SetReceiver(int chain_address, Receiver receiver) {
+    receivers_[chain_address] = std::move(receiver);
+  }
+
+  bool connected() const { return connected_; }
+  // Sends a whole packet, returns false if the link is down.
+  bool Send(absl::string_view packet, bool inquiry);
+
+ private:
+  void Connect();
+  void OnEvents(short revents);
+  void Read();
+  void Dispatch(absl::string_view packet);
+  void Disconnect(const absl::Status& status);
+
+  EventLoop& loop_;
+  const bool tcp_;
+  const sockaddr_in address_;
+  Fd fd_;
+  bool connected_ = false;
+  std::string input_;
+  uint32_t sequence_ = 0;
+  EventLoop::TimerId reconnect_timer_ = 0;
+  absl::flat_hash_map<int, Receiver> receivers_;
+};
+
+// Hands out one link per endpoint.
+class ViscaLinkPool {
+ public:
+  explicit ViscaLinkPool(EventLoop& loop) : loop_(loop) {}
+
+  ViscaLink& Get(bool tcp, const sockaddr_in& address);
+
+ private:
+  EventLoop& loop_;
+  absl::flat_hash_map<std::string, std::unique_ptr<ViscaLink>> links_;
+};
+
+// Controls an upstream VISCA camera, so the bridge can route to real PTZ
+// cameras as well as UVC ones.
+//
+// The camera gets one request at a time. Requests wait in a CommandQueue,
+// earliest deadline first, and a newer request of the same kind replaces a
+// queued one, so the queue stays bounded while the camera is slow. Drives
+// that waited past their deadline are dropped rather than sent late. When
+// the queue is full, refreshes make room first and other requests fail. Set
+// calls only queue, inquiry replies reach the observer as they arrive.
+//
+// Values are zoom 0..4000h, focus 0..E000h growing towards infinity and
+// pan/tilt in arc seconds, like UVC.
+class ViscaBackend : public Backend {
+ public:
+  ViscaBackend(EventLoop& loop, ViscaLink& link, int chain_address,
+               const CommandDeadlines& deadlines, int queue_size);
+  ~ViscaBackend() override;
+
+  Capabilities Probe() override;
+  void Refresh() override;
+
+  absl::Status SetZoomAbs(int32_t value) override;
+  absl::Status SetZoomRel(const ZoomRel& zoom) override;
+  absl::Status SetPanTiltAbs(const PanTiltAbs& pantilt) override;
+  absl::Status SetPanTiltRel(const PanTiltRel& pantilt) override;
+  absl::Status SetFocusAbs(int32_t value) override;
+  absl::Status SetFocusRel(const FocusRel& focus) override;
+  absl::Status SetFocusAuto(bool enabled) override;
+
+  const CommandQueueStats* queue_stats() const override {
+    return &queue_.stats();
+  }
+  bool congested() const override { return queue_.full(); }
+
+ private:
+  // `message` goes between the header and the terminator.
+  absl::Status Enqueue(std::string message, CommandClass command_class);
+  void SendNext();
+  void OnReply(absl::string_view packet);
+  void HandleInquiryReply(const CommandQueue::Command& request,
+                          absl::string_view payload);
+  void Finish();
+
+  EventLoop& loop_;
+  ViscaLink& link_;
+  const int chain_address_;
+  CommandQueue queue_;
+  std::optional<CommandQueue::Command> outstanding_;
+  EventLoop::TimerId timeout_ = 0;
+  bool responding_ = true;
+  // Sockets the camera acknowledged commands on and hasn't completed them,
+  // by bit. Their completions and errors arrive while the next request is
+  // outstanding.
+  uint16_t executing_ = 0;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_VISCA_UPSTREAM_H_
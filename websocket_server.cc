@@ -0,0 +1,346 @@
+#include "websocket_server.h"
+
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "client.h"
+#include "sha1.h"
+#include "state_message.h"
+
+namespace visca2uvc {
+namespace {
+
+constexpr absl::string_view kAcceptGuid =
+    "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+constexpr size_t kMaxHandshake = 8192;
+constexpr size_t kMaxMessage = 65536;
+
+enum Opcode : uint8_t {
+  kContinuation = 0x0,
+  kText = 0x1,
+  kBinary = 0x2,
+  kClose = 0x8,
+  kPing = 0x9,
+  kPong = 0xA,
+};
+
+enum Command : uint8_t {
+  kMovePanTilt = 0x01,
+  kMoveZoom = 0x02,
+  kMoveFocus = 0x03,
+  kStop = 0x04,
+  kTrack = 0x05,
+  kTrackZoom = 0x06,
+  kPanTiltAbs = 0x10,
+  kZoomAbs = 0x11,
+  kFocusAbs = 0x12,
+  kFocusAuto = 0x13,
+};
+
+// Big-endian reader that fails softly at the end of the data.
+class Reader {
+ public:
+  explicit Reader(absl::string_view data) : data_(data) {}
+
+  bool empty() const { return data_.empty(); }
+
+  bool U8(uint8_t& value) {
+    if (data_.empty()) return false;
+    value = data_[0];
+    data_.remove_prefix(1);
+    return true;
+  }
+  bool I8(float& speed) {
+    uint8_t value;
+    if (!U8(value)) return false;
+    speed = static_cast<int8_t>(value) / 127.0f;
+    return true;
+  }
+  bool I16(float& offset) {
+    uint8_t high, low;
+    if (!U8(high) || !U8(low)) return false;
+    offset = static_cast<int16_t>(high << 8 | low) / 32767.0f;
+    return true;
+  }
+  bool I32(int32_t& value) {
+    if (data_.size() < 4) return false;
+    const auto* p = reinterpret_cast<const uint8_t*>(data_.data());
+    value = static_cast<int32_t>(uint32_t{p[0]} << 24 | uint32_t{p[1]} << 16 |
+                                 uint32_t{p[2]} << 8 | p[3]);
+    data_.remove_prefix(4);
+    return true;
+  }
+
+ private:
+  absl::string_view data_;
+};
+
+}  // namespace
+
+class WebSocketServer::Session : public TcpConnection::Handler {
+ public:
+  Session(WebSocketServer& server, TcpConnection& connection)
+      : server_(server), connection_(connection) {
+    server_.sessions_.insert(this);
+  }
+
+  ~Session() override {
+    server_.sessions_.erase(this);
+    ClientScope scope(client_);
+    for (const int id : moving_) {
+      if (Tracker* tracker = server_.bridge_.tracker(id)) {
+        tracker->StopClient();
+      }
+      if (MotionController* motion = server_.bridge_.motion(id)) {
+        motion->StopClient();
+      }
+    }
+  }
+
+  size_t OnData(absl::string_view data) override {
+    client_ = ClientScope::current();
+    size_t consumed = 0;
+    if (!open_) {
+      consumed = Handshake(data);
+      if (!open_) return consumed;
+    }
+    while (consumed < data.size()) {
+      const size_t frame = ParseFrame(data.substr(consumed));
+      if (frame == 0) break;
+      consumed += frame;
+    }
+    return consumed;
+  }
+
+  void PushState(StateMessageType type, const Camera& camera,
+                 absl::Span<const Control> controls) {
+    if (!open_) return;
+    SendFrame(kBinary,
+              EncodeStateMessage(type, sequence_++, camera, controls));
+  }
+
+ private:
+  size_t Handshake(absl::string_view data) {
+    const size_t end = data.find("\r\n\r\n");
+    if (end == absl::string_view::npos) {
+      if (data.size() > kMaxHandshake) connection_.Close();
+      return 0;
+    }
+    std::string key;
+    bool upgrade = false;
+    for (absl::string_view line :
+         absl::StrSplit(data.substr(0, end), "\r\n")) {
+      std::pair<absl::string_view, absl::string_view> header =
+          absl::StrSplit(line, absl::MaxSplits(':', 1));
+      const absl::string_view value =
+          absl::StripAsciiWhitespace(header.second);
+      if (absl::EqualsIgnoreCase(header.first, "Sec-WebSocket-Key")) {
+        key = std::string(value);
+      } else if (absl::EqualsIgnoreCase(header.first, "Upgrade")) {
+        upgrade = absl::EqualsIgnoreCase(value, "websocket");
+      }
+    }
+    if (!absl::StartsWith(data, "GET ") || !upgrade || key.empty()) {
+      connection_.Send(
+          "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n");
+      connection_.Close();
+      return end + 4;
+    }
+    const std::array<uint8_t, 20> digest = Sha1(absl::StrCat(key, kAcceptGuid));
+    connection_.Send(absl::StrCat(
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: ",
+        absl::Base64Escape(absl::string_view(
+            reinterpret_cast<const char*>(digest.data()), digest.size())),
+        "\r\n\r\n"));
+    open_ = true;
+    for (const Camera* camera : server_.bridge_.cameras()) {
+      PushState(StateMessageType::kSnapshot, *camera, kAllControls);
+    }
+    return end + 4;
+  }
+
+  // Returns the size of the frame at the start of `data`, 0 if incomplete.
+  size_t ParseFrame(absl::string_view data) {
+    if (data.size() < 2) return 0;
+    const auto* p = reinterpret_cast<const uint8_t*>(data.data());
+    const bool fin = p[0] & 0x80;
+    const uint8_t opcode = p[0] & 0x0F;
+    const bool masked = p[1] & 0x80;
+    uint64_t length = p[1] & 0x7F;
+    size_t header = 2;
+    if (length == 126) {
+      if (data.size() < 4) return 0;
+      length = uint64_t{p[2]} << 8 | p[3];
+      header = 4;
+    } else if (length == 127) {
+      if (data.size() < 10) return 0;
+      length = 0;
+      for (int i = 2; i < 10; ++i) length = length << 8 | p[i];
+      header = 10;
+    }
+    if (!masked || length > kMaxMessage) {
+      // Clients must mask, and nothing we accept is this large.
+      connection_.Close();
+      return data.size();
+    }
+    if (data.size() < header + 4 + length) return 0;
+    const uint8_t* mask = p + header;
+    std::string payload(data.substr(header + 4, length));
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] ^= mask[i % 4];
+
+    switch (opcode) {
+      case kContinuation:
+      case kText:
+      case kBinary:
+        if (opcode != kContinuation) message_opcode_ = opcode;
+        message_ += payload;
+        if (message_.size() > kMaxMessage) {
+          connection_.Close();
+          break;
+        }
+        if (fin) {
+          if (message_opcode_ == kBinary) OnMessage(message_);
+          message_.clear();
+        }
+        break;
+      case kClose:
+        SendFrame(kClose, payload.substr(0, 2));
+        connection_.Close();
+        break;
+      case kPing:
+        SendFrame(kPong, payload);
+        break;
+      default:
+        break;
+    }
+    return header + 4 + length;
+  }
+
+  void OnMessage(absl::string_view message) {
+    Reader reader(message);
+    while (!reader.empty()) {
+      uint8_t op, id;
+      if (!reader.U8(op) || !reader.U8(id)) return;
+      MotionController* motion = server_.bridge_.motion(id);
+      if (motion == nullptr) return;
+      float pan, tilt, speed, x, y, size;
+      int32_t a, b;
+      uint8_t flag;
+      switch (op) {
+        case kMovePanTilt:
+          if (!reader.I8(pan) || !reader.I8(tilt)) return;
+          motion->MovePanTilt(pan, tilt);
+          moving_.insert(id);
+          break;
+        case kMoveZoom:
+          if (!reader.I8(speed)) return;
+          motion->MoveZoom(speed);
+          moving_.insert(id);
+          break;
+        case kMoveFocus:
+          if (!reader.I8(speed)) return;
+          motion->MoveFocus(speed);
+          moving_.insert(id);
+          break;
+        case kStop:
+          if (Tracker* tracker = server_.bridge_.tracker(id)) tracker->Stop();
+          motion->Stop();
+          moving_.erase(id);
+          break;
+        case kTrack:
+          if (!reader.I16(x) || !reader.I16(y)) return;
+          if (Tracker* tracker = server_.bridge_.tracker(id)) {
+            tracker->SetTarget(x, y);
+          }
+          moving_.insert(id);
+          break;
+        case kTrackZoom:
+          if (!reader.I16(x) || !reader.I16(y) || !reader.I16(size)) return;
+          if (Tracker* tracker = server_.bridge_.tracker(id)) {
+            tracker->SetTarget(x, y, size);
+          }
+          moving_.insert(id);
+          break;
+        case kPanTiltAbs:
+          if (!reader.I32(a) || !reader.I32(b)) return;
+          motion->SetPanTiltAbs(a, b);
+          break;
+        case kZoomAbs:
+          if (!reader.I32(a)) return;
+          motion->SetZoomAbs(a);
+          break;
+        case kFocusAbs:
+          if (!reader.I32(a)) return;
+          motion->SetFocusAbs(a);
+          break;
+        case kFocusAuto:
+          if (!reader.U8(flag)) return;
+          motion->SetFocusAuto(flag != 0);
+          break;
+        default:
+          // The rest of the message can't be framed.
+          return;
+      }
+    }
+  }
+
+  void SendFrame(uint8_t opcode, absl::string_view payload) {
+    std::string frame = {static_cast<char>(0x80 | opcode)};
+    if (payload.size() < 126) {
+      frame.push_back(payload.size());
+    } else if (payload.size() <= 0xFFFF) {
+      frame.push_back(126);
+      frame.push_back(payload.size() >> 8);
+      frame.push_back(payload.size());
+    } else {
+      frame.push_back(127);
+      for (int i = 7; i >= 0; --i) {
+        frame.push_back(static_cast<uint64_t>(payload.size()) >> (i * 8));
+      }
+    }
+    frame.append(payload.data(), payload.size());
+    connection_.Send(frame);
+  }
+
+  WebSocketServer& server_;
+  TcpConnection& connection_;
+  bool open_ = false;
+  uint8_t message_opcode_ = kBinary;
+  std::string message_;
+  uint32_t sequence_ = 0;
+  // Who this is, for stopping its drives when it goes away.
+  ClientId client_;
+  // Cameras this client set in motion.
+  absl::flat_hash_set<int> moving_;
+};
+
+absl::StatusOr<std::unique_ptr<WebSocketServer>> WebSocketServer::Create(
+    EventLoop& loop, uint16_t port, Bridge& bridge) {
+  std::unique_ptr<WebSocketServer> server(new WebSocketServer(bridge));
+  absl::StatusOr<std::unique_ptr<TcpServer>> tcp_server = TcpServer::Create(
+      loop, port, [s = server.get()](TcpConnection& connection) {
+        return std::make_unique<Session>(*s, connection);
+      });
+  if (!tcp_server.ok()) return tcp_server.status();
+  server->tcp_server_ = *std::move(tcp_server);
+  for (Camera* camera : bridge.cameras()) {
+    camera->AddListener([s = server.get()](const Camera& camera,
+                                           absl::Span<const Control> changed) {
+      for (Session* session : s->sessions_) {
+        session->PushState(StateMessageType::kDelta, camera, changed);
+      }
+    });
+  }
+  return server;
+}
+
+}  // namespace visca2uvc
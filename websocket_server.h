@@ -0,0 +1,56 @@
+#ifndef VISCA2UVC_WEBSOCKET_SERVER_H_
+#define VISCA2UVC_WEBSOCKET_SERVER_H_
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
+#include "bridge.h"
+#include "event_loop.h"
+#include "tcp_server.h"
+
+namespace visca2uvc {
+
+// WebSocket control and state API for browser based panels.
+//
+// Clients send binary messages holding one or more commands, each starting
+// with u8 op, u8 camera id, followed by the arguments, all integers
+// big-endian:
+//
+//   0x01 move pan/tilt   i8 pan speed, i8 tilt speed
+//   0x02 move zoom       i8 speed
+//   0x03 move focus      i8 speed
+//   0x04 stop            also ends tracking
+//   0x05 track           i16 x offset, i16 y offset
+//   0x06 track and zoom  i16 x offset, i16 y offset, i16 size error
+//   0x10 pan/tilt abs    i32 pan, i32 tilt
+//   0x11 zoom abs        i32 zoom
+//   0x12 focus abs       i32 focus
+//   0x13 focus auto      u8 enabled
+//
+// Speeds are -127..127, tracking offsets -32767..32767, see tracking.h.
+// Commands go through the same `MotionController` as every other protocol.
+// The server pushes a snapshot of every camera on connect and then binary
+// state messages, see state_message.h, as the state changes. The drives a
+// client started are stopped when it disconnects, unless another client took
+// them over.
+class WebSocketServer {
+ public:
+  static absl::StatusOr<std::unique_ptr<WebSocketServer>> Create(
+      EventLoop& loop, uint16_t port, Bridge& bridge);
+
+ private:
+  class Session;
+
+  explicit WebSocketServer(Bridge& bridge) : bridge_(bridge) {}
+
+  Bridge& bridge_;
+  // Sessions erase themselves when the TCP server destroys them.
+  absl::flat_hash_set<Session*> sessions_;
+  std::unique_ptr<TcpServer> tcp_server_;
+};
+
+}  // namespace visca2uvc
+
+#endif  // VISCA2UVC_WEBSOCKET_SERVER_H_